@@ -0,0 +1,330 @@
+/**********************************
+ * File:     Batched.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/1
+ ***********************************/
+
+#ifndef LA_BATCHED_H
+#define LA_BATCHED_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include "Matrix.h"
+#include "Memory.h"
+#include "ThreadPool.h"
+
+namespace LinearAlgebra {
+
+/// 一批形状相同的小矩阵, 跨批交错存放 (SoA):
+/// 第 b 个矩阵的元素 (i, j) 位于 data()[(i * cols + j) * stride() + b].
+/// 同一位置的元素在所有矩阵间是连续的, SIMD 的各个通道分别处理不同的矩阵
+template <typename E>
+class MatrixBatch {
+public:
+  typedef E value_type;
+
+  /// 一次处理的矩阵个数, stride 按它向上取整
+  static constexpr int Lanes = 16;
+
+private:
+  E *value;
+  int cnt, row, col, ld;
+
+public:
+  MatrixBatch(int count, int r, int c)
+      : cnt(count), row(r), col(c), ld((count + Lanes - 1) / Lanes * Lanes) {
+    assert(count > 0 && r > 0 && c > 0);
+    std::size_t n = (std::size_t)row * col * ld;
+    value = detail::allocate<E>(n);
+    std::fill(value, value + n, E(0));
+  }
+
+  ~MatrixBatch() {
+    detail::deallocate(value);
+  }
+
+  MatrixBatch(const MatrixBatch &other) : MatrixBatch(other.cnt, other.row, other.col) {
+    std::copy(other.value, other.value + (std::size_t)row * col * ld, value);
+  }
+
+  MatrixBatch(MatrixBatch &&other) noexcept
+      : value(other.value), cnt(other.cnt), row(other.row), col(other.col), ld(other.ld) {
+    other.value = nullptr;
+    other.cnt = other.row = other.col = other.ld = 0;
+  }
+
+  MatrixBatch &operator=(MatrixBatch other) noexcept {
+    std::swap(value, other.value);
+    std::swap(cnt, other.cnt);
+    std::swap(row, other.row);
+    std::swap(col, other.col);
+    std::swap(ld, other.ld);
+    return *this;
+  }
+
+  int count() const {
+    return cnt;
+  }
+
+  int row_num() const {
+    return row;
+  }
+
+  int col_num() const {
+    return col;
+  }
+
+  /// 相邻两个元素位置之间的距离
+  int stride() const {
+    return ld;
+  }
+
+  /// 第 b 个矩阵的元素 (i, j)
+  E &operator()(int b, int i, int j) {
+    return value[((std::size_t)i * col + j) * ld + b];
+  }
+
+  const E &operator()(int b, int i, int j) const {
+    return value[((std::size_t)i * col + j) * ld + b];
+  }
+
+  /// 所有矩阵的元素 (i, j), 长度为 stride()
+  E *lane(int i, int j) {
+    return value + ((std::size_t)i * col + j) * ld;
+  }
+
+  const E *lane(int i, int j) const {
+    return value + ((std::size_t)i * col + j) * ld;
+  }
+
+  E *data() {
+    return value;
+  }
+
+  const E *data() const {
+    return value;
+  }
+
+  /// 写入第 b 个矩阵
+  void set(int b, const Matrix<E> &m) {
+    assert(m.row_num() == row && m.col_num() == col);
+    for (int i = 0; i < row; ++i)
+      for (int j = 0; j < col; ++j)
+        (*this)(b, i, j) = m(i, j);
+  }
+
+  /// 取出第 b 个矩阵
+  Matrix<E> get(int b) const {
+    Matrix<E> m(row, col);
+    for (int i = 0; i < row; ++i)
+      for (int j = 0; j < col; ++j)
+        m(i, j) = (*this)(b, i, j);
+    return m;
+  }
+};
+
+namespace batch {
+
+namespace detail {
+
+/// 把批内 [lo, hi) 个 Lanes 宽的块分给线程, work 为每块的乘加次数
+template <typename E, typename Fn>
+void for_blocks(const MatrixBatch<E> &A, long long work, Fn fn) {
+  int blocks = A.stride() / MatrixBatch<E>::Lanes;
+  Parallel::for_range(0, blocks, 1, work * blocks, fn);
+}
+
+/// d[l] -= f[l] * s[l]; __restrict 让编译器在 -O2 下也能直接向量化
+template <typename E, int L>
+inline void lane_fnma(E *__restrict d, const E *__restrict f, const E *__restrict s) {
+  for (int l = 0; l < L; ++l)
+    d[l] -= f[l] * s[l];
+}
+
+/// 对 sel[l] == key 的通道交换 r1[l] 和 r2[l]
+template <typename E, int L>
+inline void lane_swap(E *__restrict r1, E *__restrict r2, const int *__restrict sel, int key) {
+  for (int l = 0; l < L; ++l) {
+    bool sw = sel[l] == key;
+    E a = r1[l], b = r2[l];
+    r1[l] = sw ? b : a;
+    r2[l] = sw ? a : b;
+  }
+}
+}
+
+/// C[b] = alpha * A[b] * B[b] + beta * C[b], 对批内每个矩阵
+template <typename E>
+void gemm(E alpha, const MatrixBatch<E> &A, const MatrixBatch<E> &B, E beta, MatrixBatch<E> &C) {
+  const int L = MatrixBatch<E>::Lanes;
+  int m = A.row_num(), k = A.col_num(), n = B.col_num();
+  assert(B.row_num() == k && C.row_num() == m && C.col_num() == n);
+  assert(A.count() == B.count() && A.count() == C.count());
+  LA_OP_SCOPE("batch::gemm", m, n, k, 2.0 * m * n * k * A.count(),
+              ((double)m * k + (double)k * n + 2.0 * m * n) * A.count() * sizeof(E));
+
+  detail::for_blocks(A, (long long)m * n * k * L, [&](int lo, int hi) {
+    for (int blk = lo; blk < hi; ++blk) {
+      int off = blk * L;
+      for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+          E acc[L] = {};
+          for (int p = 0; p < k; ++p) {
+            const E *a = A.lane(i, p) + off;
+            const E *b = B.lane(p, j) + off;
+            for (int l = 0; l < L; ++l)
+              acc[l] += a[l] * b[l];
+          }
+          E *c = C.lane(i, j) + off;
+          for (int l = 0; l < L; ++l)
+            c[l] = alpha * acc[l] + (beta == E(0) ? E(0) : beta * c[l]);
+        }
+      }
+    }
+  });
+}
+
+/// 求解 A[b] X[b] = B[b], 结果写回 B; A 不变.
+/// 每个矩阵各自选主元, 消元在整批上向量化. 返回奇异系统的个数,
+/// singular 非空时记录每个系统是否奇异 (奇异系统的结果无意义)
+template <typename E>
+int solve(const MatrixBatch<E> &A, MatrixBatch<E> &B, std::vector<bool> *singular = nullptr) {
+  const int L = MatrixBatch<E>::Lanes;
+  int n = A.row_num(), m = B.col_num();
+  assert(A.col_num() == n && B.row_num() == n && A.count() == B.count());
+  LA_OP_SCOPE("batch::solve", n, n, m, (2.0 * n * n * n / 3 + 2.0 * n * n * m) * A.count(),
+              ((double)n * n + 2.0 * n * m) * A.count() * sizeof(E));
+
+  int total = A.count();
+  std::vector<char> bad(A.stride(), 0);
+
+  detail::for_blocks(A, (long long)n * n * (n + m) * L, [&](int lo, int hi) {
+    /// 每个任务一份局部工作区, 块与块之间复用
+    std::vector<E> a((std::size_t)n * n * L), x((std::size_t)n * m * L), inv((std::size_t)n * L);
+    auto at = [&](int i, int j) { return a.data() + ((std::size_t)i * n + j) * L; };
+    auto xt = [&](int i, int j) { return x.data() + ((std::size_t)i * m + j) * L; };
+
+    for (int blk = lo; blk < hi; ++blk) {
+      int off = blk * L;
+      for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j)
+          std::copy(A.lane(i, j) + off, A.lane(i, j) + off + L, at(i, j));
+        for (int j = 0; j < m; ++j)
+          std::copy(B.lane(i, j) + off, B.lane(i, j) + off + L, xt(i, j));
+      }
+
+      /// 各通道的主元阈值 kPivotTolerance * max|A_ij|
+      E tol[L];
+      std::fill(tol, tol + L, E(0));
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+          const E *aij = at(i, j);
+          for (int l = 0; l < L; ++l)
+            tol[l] = std::max(tol[l], (E)std::abs(aij[l]));
+        }
+      for (int l = 0; l < L; ++l)
+        tol[l] *= E(kPivotTolerance);
+
+      for (int k = 0; k < n; ++k) {
+
+        /// 各通道独立选主元, 行交换用按通道的条件选择完成, 整个过程没有分支
+        E maxVal[L];
+        int piv[L];
+        const E *akk = at(k, k);
+        for (int l = 0; l < L; ++l) {
+          maxVal[l] = std::abs(akk[l]);
+          piv[l] = k;
+        }
+        for (int i = k + 1; i < n; ++i) {
+          const E *aik = at(i, k);
+          for (int l = 0; l < L; ++l) {
+            E v = std::abs(aik[l]);
+            bool better = v > maxVal[l];
+            maxVal[l] = better ? v : maxVal[l];
+            piv[l] = better ? i : piv[l];
+          }
+        }
+        for (int i = k + 1; i < n; ++i) {
+          for (int j = k; j < n; ++j)
+            detail::lane_swap<E, L>(at(k, j), at(i, j), piv, i);
+          for (int j = 0; j < m; ++j)
+            detail::lane_swap<E, L>(xt(k, j), xt(i, j), piv, i);
+        }
+
+        /// 奇异或填充通道: 用 1 代替主元, 避免产生 inf
+        E *pk = at(k, k);
+        for (int l = 0; l < L; ++l) {
+          bool tiny = !(maxVal[l] > tol[l]);
+          bad[off + l] |= tiny;
+          pk[l] = tiny ? E(1) : pk[l];
+        }
+
+        E *ik = inv.data() + (std::size_t)k * L;
+        for (int l = 0; l < L; ++l)
+          ik[l] = E(1) / pk[l];
+
+        for (int i = k + 1; i < n; ++i) {
+          E f[L];
+          const E *aik = at(i, k);
+          for (int l = 0; l < L; ++l)
+            f[l] = aik[l] * ik[l];
+          for (int j = k + 1; j < n; ++j)
+            detail::lane_fnma<E, L>(at(i, j), f, at(k, j));
+          for (int j = 0; j < m; ++j)
+            detail::lane_fnma<E, L>(xt(i, j), f, xt(k, j));
+        }
+      }
+
+      /// 回代
+      for (int i = n - 1; i >= 0; --i) {
+        const E *ii = inv.data() + (std::size_t)i * L;
+        for (int j = 0; j < m; ++j) {
+          E *d = xt(i, j);
+          for (int p = i + 1; p < n; ++p)
+            detail::lane_fnma<E, L>(d, at(i, p), xt(p, j));
+          for (int l = 0; l < L; ++l)
+            d[l] *= ii[l];
+        }
+      }
+
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < m; ++j)
+          std::copy(xt(i, j), xt(i, j) + L, B.lane(i, j) + off);
+    }
+  });
+
+  int count = 0;
+  for (int b = 0; b < total; ++b)
+    count += bad[b];
+  if (singular) {
+    singular->assign(total, false);
+    for (int b = 0; b < total; ++b)
+      (*singular)[b] = bad[b] != 0;
+  }
+  return count;
+}
+
+/// 批量求逆, 返回奇异矩阵的个数
+template <typename E>
+MatrixBatch<E> inverse(const MatrixBatch<E> &A, int *singularCount = nullptr,
+                       std::vector<bool> *singular = nullptr) {
+  int n = A.row_num();
+  assert(A.col_num() == n);
+  MatrixBatch<E> X(A.count(), n, n);
+  for (int i = 0; i < n; ++i)
+    std::fill(X.lane(i, i), X.lane(i, i) + X.stride(), E(1));
+  int c = solve(A, X, singular);
+  if (singularCount)
+    *singularCount = c;
+  return X;
+}
+}
+}
+
+#endif // LA_BATCHED_H
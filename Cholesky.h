@@ -0,0 +1,456 @@
+/**********************************
+ * File:     Cholesky.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/30
+ ***********************************/
+
+#ifndef LA_CHOLESKY_H
+#define LA_CHOLESKY_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "Gemm.h"
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+namespace detail {
+
+/// 对称秩 k 更新的下三角部分: C[lower] -= L * W^T, L 和 W 都是 n x k.
+/// 按 64 行一块, 对角块左边的矩形直接走 GEMM; 对角块先算到临时缓冲区,
+/// 只累加下三角, 保持 C 的上三角不变
+template <typename E>
+void syrk_lower(int n, int k, const E *L, int ldl, const E *W, int ldw, E *C, int ldc) {
+  const int BS = 64;
+  std::vector<E> tmp((std::size_t)BS * BS);
+  for (int r0 = 0; r0 < n; r0 += BS) {
+    int b = std::min(BS, n - r0);
+    const E *Lr = L + (std::size_t)r0 * ldl;
+    E *Cr = C + (std::size_t)r0 * ldc;
+    if (r0 > 0)
+      blas::gemm(b, r0, k, E(-1), Lr, ldl, 1, W, 1, ldw, E(1), Cr, ldc, 1);
+    blas::gemm(b, b, k, E(1), Lr, ldl, 1, W + (std::size_t)r0 * ldw, 1, ldw, E(0), tmp.data(),
+               BS, 1);
+    for (int i = 0; i < b; ++i)
+      for (int j = 0; j <= i; ++j)
+        Cr[(std::size_t)i * ldc + r0 + j] -= tmp[(std::size_t)i * BS + j];
+  }
+}
+}
+
+/// 对称正定矩阵的 Cholesky 分解: A = L * L^T
+///
+/// 只读取 A 的下三角, 也只写 L 的下三角 (上三角保持为 0).
+/// 分块右视算法: 对角块做非分块分解, 面板做三角求解, 尾部做对称秩 k 更新.
+/// 矩阵不是正定时 success() 返回 false, failed_at() 给出失败的主元位置.
+template <typename E>
+class Cholesky {
+private:
+  Matrix<E> L;
+  int failedAt;
+
+  static constexpr int NB = 64;
+
+  /// 对角块 [k, k + nb) 的非分块分解
+  bool factor_diag(int k, int nb) {
+    for (int j = k; j < k + nb; ++j) {
+      E *lj = L.row_ptr(j);
+      E d = lj[j] - simd::dot(lj + k, lj + k, j - k);
+      if (!(d > E(0))) {
+        failedAt = j;
+        return false;
+      }
+      lj[j] = std::sqrt(d);
+      for (int i = j + 1; i < k + nb; ++i) {
+        E *li = L.row_ptr(i);
+        li[j] = (li[j] - simd::dot(li + k, lj + k, j - k)) / lj[j];
+      }
+    }
+    return true;
+  }
+
+  void factor() {
+    int n = L.row_num();
+    int ld = L.leading_dim();
+    LA_OP_SCOPE("Cholesky::factor", n, n, 0, (double)n * n * n / 3, (double)n * n * sizeof(E));
+    for (int k = 0; k < n; k += NB) {
+      int nb = std::min(NB, n - k);
+      if (!factor_diag(k, nb))
+        return;
+
+      int rest = n - k - nb;
+      if (rest <= 0)
+        continue;
+
+      /// L21 = A21 * L11^-T, 每一行独立做一次前代
+      Parallel::for_range(k + nb, n, 16, (long long)rest * nb * nb, [&](int lo, int hi) {
+        for (int i = lo; i < hi; ++i) {
+          E *li = L.row_ptr(i);
+          for (int j = k; j < k + nb; ++j) {
+            const E *lj = L.row_ptr(j);
+            li[j] = (li[j] - simd::dot(li + k, lj + k, j - k)) / lj[j];
+          }
+        }
+      });
+
+      /// A22 -= L21 * L21^T (只更新下三角)
+      const E *L21 = L.row_ptr(k + nb) + k;
+      detail::syrk_lower(rest, nb, L21, ld, L21, ld, L.row_ptr(k + nb) + k + nb, ld);
+    }
+  }
+
+public:
+  explicit Cholesky(const Matrix<E> &A) : L(A.row_num(), A.col_num()), failedAt(-1) {
+    assert(A.row_num() == A.col_num() && "Cholesky requires a square matrix");
+    int n = A.row_num();
+    for (int i = 0; i < n; ++i)
+      std::copy(A.row_ptr(i), A.row_ptr(i) + i + 1, L.row_ptr(i));
+    factor();
+  }
+
+private:
+  /// A + sign * X X^T 的旋转修正, X 为 n x k, 每列对应一次秩 1 修正.
+  ///
+  /// 位置 p 上的旋转 (c = r / L_pp, s = w_p / L_pp) 把 (L_ip, w_i) 变为
+  /// l' = (l + sign s w) / c, w' = c w - s l'. 下降时这种先算 l' 再用它求 w'
+  /// 的混合形式比直接展开更稳定. 第 i 行要先依次应用前 i 个位置上的
+  /// k 组旋转, 再在对角元上生成本位置的旋转; 只按行访问 L, 整个修正只扫一遍 L.
+  /// 同一组 R 行在公共的前 i0 个位置上互不依赖, 交错执行以隐藏依赖链的延迟
+  bool rotate(const Matrix<E> &X, E sign) {
+    const int R = 4;
+    int n = L.row_num(), k = X.col_num();
+    LA_OP_SCOPE("Cholesky::update", n, n, k, 3.0 * k * n * n, (double)n * n * sizeof(E));
+    /// 位置 p 第 j 组旋转的 (c, s, 1 / c) 位于 rot[3 * (p * k + j)]
+    std::vector<E> rot((std::size_t)3 * n * k), w((std::size_t)R * k);
+
+    auto apply = [&](const E *cs, E &l, E *wr) {
+      for (int j = 0; j < k; ++j) {
+        E c = cs[3 * j], s = cs[3 * j + 1], ic = cs[3 * j + 2];
+        l = (l + sign * s * wr[j]) * ic;
+        wr[j] = c * wr[j] - s * l;
+      }
+    };
+
+    for (int i0 = 0; i0 < n; i0 += R) {
+      int rows = std::min(R, n - i0);
+      for (int r = 0; r < rows; ++r)
+        std::copy(X.row_ptr(i0 + r), X.row_ptr(i0 + r) + k, w.begin() + (std::size_t)r * k);
+
+      for (int p = 0; p < i0; ++p) {
+        const E *cs = rot.data() + (std::size_t)3 * p * k;
+        for (int r = 0; r < rows; ++r)
+          apply(cs, L.row_ptr(i0 + r)[p], w.data() + (std::size_t)r * k);
+      }
+
+      for (int r = 0; r < rows; ++r) {
+        int i = i0 + r;
+        E *li = L.row_ptr(i), *wr = w.data() + (std::size_t)r * k;
+        for (int p = i0; p < i; ++p)
+          apply(rot.data() + (std::size_t)3 * p * k, li[p], wr);
+
+        E d = li[i];
+        E *cs = rot.data() + (std::size_t)3 * i * k;
+        for (int j = 0; j < k; ++j) {
+          E r2 = d * d + sign * wr[j] * wr[j];
+          if (!(r2 > E(0))) {
+            failedAt = i;
+            return false;
+          }
+          E rr = std::sqrt(r2);
+          cs[3 * j] = rr / d;
+          cs[3 * j + 1] = wr[j] / d;
+          cs[3 * j + 2] = d / rr;
+          d = rr;
+        }
+        li[i] = d;
+      }
+    }
+    return true;
+  }
+
+public:
+  /// 秩 k 更新: 把分解改为 A + X X^T 的分解, X 为 n x k. O(k n^2), 不重新分解.
+  /// 只有 X 含 inf/NaN 等使旋转失败时返回 false, 此时 success() 为 false, 需要重新分解
+  bool update(const Matrix<E> &X) {
+    assert(success() && "matrix is not positive definite");
+    assert(X.row_num() == L.row_num());
+    return rotate(X, E(1));
+  }
+
+  /// 秩 k 下降: 把分解改为 A - X X^T 的分解. 先解 L P = X, I - P^T P 不正定
+  /// (即结果不再正定) 时返回 false, 分解保持不变; 旋转中途因舍入失败时
+  /// 同样返回 false, 此时 success() 为 false, 需要重新分解
+  bool downdate(const Matrix<E> &X) {
+    assert(success() && "matrix is not positive definite");
+    assert(X.row_num() == L.row_num());
+    int n = L.row_num(), k = X.col_num();
+
+    /// P 按列存放 (Pt 的第 j 行为 P 的第 j 列), 前代时每步是一次连续的点积
+    Matrix<E> Pt(k, n);
+    blas::transpose(n, k, X.data(), X.leading_dim(), Pt.data(), Pt.leading_dim());
+    for (int i = 0; i < n; ++i) {
+      const E *li = L.row_ptr(i);
+      for (int j = 0; j < k; ++j) {
+        E *pj = Pt.row_ptr(j);
+        pj[i] = (pj[i] - simd::dot(li, pj, i)) / li[i];
+      }
+    }
+    Matrix<E> G = Matrix<E>::identify(k);
+    blas::gemm(k, k, n, E(-1), Pt.data(), Pt.leading_dim(), 1, Pt.data(), 1, Pt.leading_dim(),
+               E(1), G.data(), G.leading_dim(), 1);
+    if (!Cholesky(G).success())
+      return false;
+    return rotate(X, E(-1));
+  }
+
+  /// 秩 1 更新 A + x x^T, 返回值同 update(const Matrix &)
+  bool update(const Vector<E> &x) {
+    return update(Matrix<E>(x.size(), 1, std::vector<E>(x.data(), x.data() + x.size())));
+  }
+
+  /// 秩 1 下降 A - x x^T
+  bool downdate(const Vector<E> &x) {
+    return downdate(Matrix<E>(x.size(), 1, std::vector<E>(x.data(), x.data() + x.size())));
+  }
+
+  /// 是否分解成功, 即 A 是否(数值上)对称正定
+  bool success() const {
+    return failedAt < 0;
+  }
+
+  /// 失败时第一个非正主元的下标, 成功时为 -1
+  int failed_at() const {
+    return failedAt;
+  }
+
+  /// 判断对称矩阵是否正定
+  static bool is_spd(const Matrix<E> &A) {
+    return A.row_num() == A.col_num() && Cholesky(A).success();
+  }
+
+  int size() const {
+    return L.row_num();
+  }
+
+  /// 下三角因子 L
+  const Matrix<E> &matrixL() const {
+    return L;
+  }
+
+  /// 原地求解 A x = b: 调用时 x 存放 b, 返回时存放解
+  void solve_in_place(E *x) const {
+    assert(success() && "matrix is not positive definite");
+    int n = L.row_num();
+
+    /// L y = b
+    for (int i = 0; i < n; ++i) {
+      const E *li = L.row_ptr(i);
+      x[i] = (x[i] - simd::dot(li, x, i)) / li[i];
+    }
+
+    /// L^T x = y, 按行 axpy 避免按列访问 L
+    for (int i = n - 1; i >= 0; --i) {
+      const E *li = L.row_ptr(i);
+      x[i] /= li[i];
+      simd::axpy(i, E(-x[i]), li, x);
+    }
+  }
+
+  /// 求解 A x = b
+  Vector<E> solve(const Vector<E> &b) const {
+    assert(b.size() == L.row_num());
+    Vector<E> x(b);
+    solve_in_place(x.data());
+    return x;
+  }
+
+  /// 求解 A X = B, B 的每一列是一个右端项
+  Matrix<E> solve(const Matrix<E> &B) const {
+    assert(success() && "matrix is not positive definite");
+    assert(B.row_num() == L.row_num());
+
+    int n = L.row_num(), m = B.col_num();
+    Matrix<E> X(B);
+
+    for (int i = 0; i < n; ++i) {
+      const E *li = L.row_ptr(i);
+      E *xi = X.row_ptr(i);
+      for (int j = 0; j < i; ++j)
+        if (li[j] != E(0))
+          simd::axpy(m, E(-li[j]), X.row_ptr(j), xi);
+      simd::scale(m, E(1) / li[i], xi, xi);
+    }
+
+    for (int i = n - 1; i >= 0; --i) {
+      const E *li = L.row_ptr(i);
+      E *xi = X.row_ptr(i);
+      simd::scale(m, E(1) / li[i], xi, xi);
+      for (int j = 0; j < i; ++j)
+        if (li[j] != E(0))
+          simd::axpy(m, E(-li[j]), xi, X.row_ptr(j));
+    }
+    return X;
+  }
+
+  /// log(det(A)) = 2 * sum(log(L_ii)), 不会像 det 那样上溢
+  double log_det() const {
+    assert(success() && "matrix is not positive definite");
+    double s = 0;
+    for (int i = 0; i < L.row_num(); ++i)
+      s += std::log((double)L.row_ptr(i)[i]);
+    return 2 * s;
+  }
+};
+
+template <typename E>
+constexpr int Cholesky<E>::NB;
+
+/// 对称矩阵的 LDL^T 分解: A = L * D * L^T, L 为单位下三角
+///
+/// 不开平方, 也适用于对角元为负的对称矩阵 (不选主元, 主元过小时报告失败).
+/// 只读取 A 的下三角, 严格下三角存 L, 对角线存 D.
+template <typename E>
+class LDLT {
+private:
+  Matrix<E> LD;
+  int failedAt;
+
+  static constexpr int NB = 64;
+
+  /// 对角块的非分块分解, w 为长度 n 的工作区
+  bool factor_diag(int k, int nb, std::vector<E> &w) {
+    for (int j = k; j < k + nb; ++j) {
+      E *lj = LD.row_ptr(j);
+      for (int p = k; p < j; ++p)
+        w[p] = lj[p] * LD.row_ptr(p)[p];
+      E d = lj[j] - simd::dot(lj + k, w.data() + k, j - k);
+      if (std::abs(d) < 1e-12) {
+        failedAt = j;
+        return false;
+      }
+      lj[j] = d;
+      for (int i = j + 1; i < k + nb; ++i) {
+        E *li = LD.row_ptr(i);
+        li[j] = (li[j] - simd::dot(li + k, w.data() + k, j - k)) / d;
+      }
+    }
+    return true;
+  }
+
+  void factor() {
+    int n = LD.row_num();
+    int ld = LD.leading_dim();
+    LA_OP_SCOPE("LDLT::factor", n, n, 0, (double)n * n * n / 3, (double)n * n * sizeof(E));
+    std::vector<E> w(n);
+    for (int k = 0; k < n; k += NB) {
+      int nb = std::min(NB, n - k);
+      if (!factor_diag(k, nb, w))
+        return;
+
+      int rest = n - k - nb;
+      if (rest <= 0)
+        continue;
+
+      /// 先求 W21 = A21 * L11^-T (即 L21 * D1), 暂存在 W, 再得到 L21 = W21 * D1^-1
+      Matrix<E> W(rest, nb);
+      Parallel::for_range(0, rest, 16, (long long)rest * nb * nb, [&](int lo, int hi) {
+        for (int r = lo; r < hi; ++r) {
+          E *wr = W.row_ptr(r);
+          E *li = LD.row_ptr(k + nb + r);
+          for (int j = 0; j < nb; ++j) {
+            const E *lj = LD.row_ptr(k + j) + k;
+            wr[j] = li[k + j] - simd::dot(wr, lj, j);
+          }
+          for (int j = 0; j < nb; ++j)
+            li[k + j] = wr[j] / LD.row_ptr(k + j)[k + j];
+        }
+      });
+
+      /// A22 -= L21 * W21^T
+      detail::syrk_lower(rest, nb, LD.row_ptr(k + nb) + k, ld, W.data(), W.leading_dim(),
+                         LD.row_ptr(k + nb) + k + nb, ld);
+    }
+  }
+
+public:
+  explicit LDLT(const Matrix<E> &A) : LD(A.row_num(), A.col_num()), failedAt(-1) {
+    assert(A.row_num() == A.col_num() && "LDLT requires a square matrix");
+    int n = A.row_num();
+    for (int i = 0; i < n; ++i)
+      std::copy(A.row_ptr(i), A.row_ptr(i) + i + 1, LD.row_ptr(i));
+    factor();
+  }
+
+  bool success() const {
+    return failedAt < 0;
+  }
+
+  int failed_at() const {
+    return failedAt;
+  }
+
+  int size() const {
+    return LD.row_num();
+  }
+
+  /// D 的全部对角元都为正时 A 正定
+  bool is_positive() const {
+    if (!success())
+      return false;
+    for (int i = 0; i < LD.row_num(); ++i)
+      if (!(LD.row_ptr(i)[i] > E(0)))
+        return false;
+    return true;
+  }
+
+  /// 紧凑存储: 严格下三角为 L, 对角线为 D
+  const Matrix<E> &packed() const {
+    return LD;
+  }
+
+  /// 原地求解 A x = b
+  void solve_in_place(E *x) const {
+    assert(success() && "LDLT factorization failed");
+    int n = LD.row_num();
+
+    for (int i = 1; i < n; ++i)
+      x[i] -= simd::dot(LD.row_ptr(i), x, i);
+
+    for (int i = 0; i < n; ++i)
+      x[i] /= LD.row_ptr(i)[i];
+
+    for (int i = n - 1; i > 0; --i)
+      simd::axpy(i, E(-x[i]), LD.row_ptr(i), x);
+  }
+
+  /// 求解 A x = b
+  Vector<E> solve(const Vector<E> &b) const {
+    assert(b.size() == LD.row_num());
+    Vector<E> x(b);
+    solve_in_place(x.data());
+    return x;
+  }
+
+  /// log(|det(A)|)
+  double log_abs_det() const {
+    assert(success() && "LDLT factorization failed");
+    double s = 0;
+    for (int i = 0; i < LD.row_num(); ++i)
+      s += std::log(std::abs((double)LD.row_ptr(i)[i]));
+    return s;
+  }
+};
+
+template <typename E>
+constexpr int LDLT<E>::NB;
+}
+
+#endif // LA_CHOLESKY_H
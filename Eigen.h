@@ -0,0 +1,965 @@
+/**********************************
+ * File:     Eigen.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/10
+ ***********************************/
+
+#ifndef LA_EIGEN_H
+#define LA_EIGEN_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <random>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "Gemm.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include "IterativeSolver.h"
+
+namespace LinearAlgebra {
+
+namespace detail {
+
+/// 对称矩阵的 Householder 三对角化 Q^T A Q = T. A 为完整的 n x n 对称矩阵,
+/// 返回时第 k 行的 [k + 1, n) 存放第 k 个反射向量 v (v[0] = 1), tau[k] 为其系数
+/// (0 表示没有反射). d, e 为 T 的对角与次对角, e[n - 1] = 0. work 长度 2n.
+/// 尾部更新 B -= v w^T + w v^T 两边都维护, 这样每一步都只读写连续的行
+template <typename E>
+void tridiagonalize(int n, E *A, int lda, E *d, E *e, E *tau, E *work) {
+  auto a = [&](int i, int j) -> E & { return A[(std::size_t)i * lda + j]; };
+  E *p = work, *w = work + n;
+  for (int k = 0; k + 2 < n; ++k) {
+    int r = n - k - 1;
+    E *x = &a(k, k + 1);
+    E *B = &a(k + 1, k + 1);
+    d[k] = a(k, k);
+
+    E alpha = x[0];
+    E sigma = simd::sum_sq(x + 1, r - 1);
+    if (sigma == E(0)) {
+      tau[k] = 0;
+      e[k] = alpha;
+      continue;
+    }
+    E norm = std::sqrt(alpha * alpha + sigma);
+    E beta = alpha <= 0 ? norm : -norm;
+    E t = tau[k] = (beta - alpha) / beta;
+    simd::scale(r - 1, E(1) / (alpha - beta), x + 1, x + 1);
+    x[0] = 1;
+    e[k] = beta;
+
+    /// p = tau B v, w = p - (tau / 2)(p^T v) v
+    Parallel::for_range(0, r, std::max(1, 4096 / r), (long long)r * r, [&](int lo, int hi) {
+      for (int i = lo; i < hi; ++i)
+        p[i] = t * simd::dot(B + (std::size_t)i * lda, x, r);
+    });
+    E K = t / 2 * simd::dot(p, x, r);
+    std::copy(p, p + r, w);
+    simd::axpy(r, -K, x, w);
+
+    Parallel::for_range(0, r, std::max(1, 2048 / r), 2LL * r * r, [&](int lo, int hi) {
+      for (int i = lo; i < hi; ++i) {
+        E *bi = B + (std::size_t)i * lda;
+        simd::axpy(r, -x[i], w, bi);
+        simd::axpy(r, -w[i], x, bi);
+      }
+    });
+  }
+  if (n >= 2) {
+    d[n - 2] = a(n - 2, n - 2);
+    e[n - 2] = a(n - 2, n - 1);
+    tau[n - 2] = 0;
+  }
+  d[n - 1] = a(n - 1, n - 1);
+  e[n - 1] = 0;
+  tau[n - 1] = 0;
+}
+
+/// 对称三对角矩阵的隐式对称 QR 迭代 (Golub & Van Loan, 8.3 节). d 为对角, e[i]
+/// 连接 i 与 i + 1. 返回时 d 为特征值 (未排序).
+///
+/// 从底部收缩: 末尾的次对角元可忽略时该特征值已分离, 否则在以它结尾的不可约块上
+/// 做一步 Wilkinson 位移 QR: 第一个 Givens 旋转由 T - mu I 的第一列决定, 之后的
+/// 旋转把它产生的凸起沿对角线推出块外. Zt 非空时把每个旋转作用到它的行上: 初值
+/// 为单位阵时第 i 行就是第 i 个特征向量, 旋转只涉及相邻两行, 都是连续内存.
+/// 总步数超过 30n 时返回 false
+template <typename E>
+bool tridiagonal_qr(int n, E *d, E *e, E *Zt, int ldz, int zcols) {
+  const E eps = std::numeric_limits<E>::epsilon();
+  auto negligible = [&](int i) {
+    return std::abs(e[i]) <= eps * (std::abs(d[i]) + std::abs(d[i + 1]));
+  };
+  int steps = 30 * n;
+  int hi = n - 1;
+  while (hi > 0) {
+    if (negligible(hi - 1)) {
+      e[hi - 1] = 0;
+      --hi;
+      continue;
+    }
+    int lo = hi - 1;
+    while (lo > 0 && !negligible(lo - 1))
+      --lo;
+    if (lo > 0)
+      e[lo - 1] = 0;
+    if (steps-- == 0)
+      return false;
+
+    /// Wilkinson 位移: 末尾 2 x 2 块中更接近 d[hi] 的特征值
+    E delta = (d[hi - 1] - d[hi]) / 2, b = e[hi - 1];
+    E root = std::hypot(delta, b);
+    E mu = d[hi] - b * b / (delta + (delta >= 0 ? root : -root));
+
+    E x = d[lo] - mu, z = e[lo];
+    for (int k = lo; k < hi; ++k) {
+      /// 凸起已在舍入误差以内时, 余下的旋转都是恒等, 直接丢掉它 (后向稳定)
+      if (k > lo && std::abs(z) <= eps * std::abs(x))
+        break;
+      /// 旋转 [c s; -s c] 把 (x, z) 变为 (r, 0), 作用于第 k, k + 1 行和列
+      E r = std::hypot(x, z);
+      E c = r > E(0) ? x / r : E(1), s = r > E(0) ? z / r : E(0);
+      if (k > lo)
+        e[k - 1] = r;
+      E p = d[k], q = e[k], t = d[k + 1];
+      d[k] = c * c * p + 2 * c * s * q + s * s * t;
+      d[k + 1] = s * s * p - 2 * c * s * q + c * c * t;
+      e[k] = c * s * (t - p) + (c * c - s * s) * q;
+      if (k + 1 < hi) {
+        /// 凸起落在 (k + 2, k), 下一步消去它
+        x = e[k];
+        z = s * e[k + 1];
+        e[k + 1] *= c;
+      }
+      if (Zt)
+        simd::rot(zcols, Zt + (std::size_t)k * ldz, Zt + (std::size_t)(k + 1) * ldz, c, s);
+    }
+  }
+  return true;
+}
+
+/// 把三对角化的反射作用到 Zt 的每一行: z <- H_0 H_1 ... H_{n-3} z.
+/// 每行独立, 按行并行; 反射向量由 tridiagonalize 存在 A 的行里
+template <typename E>
+void apply_reflectors(int n, const E *A, int lda, const E *tau, E *Zt, int ldz, int rows) {
+  Parallel::for_range(0, rows, 4, (long long)rows * n * n, [&](int lo, int hi) {
+    for (int i = lo; i < hi; ++i) {
+      E *z = Zt + (std::size_t)i * ldz;
+      for (int k = n - 3; k >= 0; --k) {
+        if (tau[k] == E(0))
+          continue;
+        int r = n - k - 1;
+        const E *v = A + (std::size_t)k * lda + k + 1;
+        E s = tau[k] * simd::dot(v, z + k + 1, r);
+        simd::axpy(r, -s, v, z + k + 1);
+      }
+    }
+  });
+}
+
+/// 对称矩阵特征分解的核心: A (完整对称, 被覆盖) 的特征值升序写入 w,
+/// Zt 非空时第 i 行为 w[i] 的单位特征向量. work 长度 4n. 不收敛返回 false
+template <typename E>
+bool symmetric_eigen(int n, E *A, int lda, E *w, E *Zt, int ldz, E *work) {
+  if (n == 0)
+    return true;
+  E *e = work, *tau = work + n, *tmp = work + 2 * n;
+  tridiagonalize(n, A, lda, w, e, tau, tmp);
+  /// 次对角元通常自上而下变小, 而 tridiagonal_qr 从底部收缩: 从小的一端收缩时
+  /// 特征向量里会积累大量非规格化数 (float 下慢数倍). 此时改为分解 P T P
+  /// (上下翻转), Zt 相应地从 P 开始累积, 第 i 行仍是 T 的特征向量
+  bool flip = n > 1 && std::abs(e[0]) > std::abs(e[n - 2]);
+  if (flip) {
+    std::reverse(w, w + n);
+    std::reverse(e, e + n - 1);
+  }
+  if (Zt) {
+    for (int i = 0; i < n; ++i) {
+      E *z = Zt + (std::size_t)i * ldz;
+      std::fill(z, z + n, E(0));
+      z[flip ? n - 1 - i : i] = 1;
+    }
+  }
+  if (!tridiagonal_qr(n, w, e, Zt, ldz, n))
+    return false;
+  if (Zt)
+    apply_reflectors(n, A, lda, tau, Zt, ldz, n);
+
+  /// 选择排序, 行交换只有 O(n) 次
+  for (int i = 0; i + 1 < n; ++i) {
+    int k = (int)(std::min_element(w + i, w + n) - w);
+    if (k == i)
+      continue;
+    std::swap(w[i], w[k]);
+    if (Zt)
+      std::swap_ranges(Zt + (std::size_t)i * ldz, Zt + (std::size_t)i * ldz + n,
+                       Zt + (std::size_t)k * ldz);
+  }
+  return true;
+}
+
+/// 上 Hessenberg 矩阵的全部特征值: Francis 隐式双位移 QR (Golub & Van Loan,
+/// 7.5 节), 只求值.
+///
+/// 从底部收缩: 末尾分离出 1 x 1 块得到一个实特征值, 2 x 2 块得到一对实根或共轭
+/// 复根. 否则在以它结尾的不可约块上做一步双位移: 位移取末尾 2 x 2 块的两个特征值,
+/// (H - mu1 I)(H - mu2 I) 的第一列只有三个非零元, 由它构造 3 维 Householder
+/// 反射, 之后的反射把凸起沿对角线推出块外; 连续 10 步没有收缩时换一次特殊位移
+/// 打破循环. 只求特征值, 所以变换只作用于当前块. H 被覆盖. 总步数超过
+/// 30 max(n, 10) 时返回 false
+template <typename E>
+bool hessenberg_eigenvalues(int n, E *H, int ldh, E *wr, E *wi) {
+  const E eps = std::numeric_limits<E>::epsilon();
+  auto a = [&](int i, int j) -> E & { return H[(std::size_t)i * ldh + j]; };
+  E hmax = 0;
+  for (int i = 0; i < n; ++i)
+    for (int j = std::max(i - 1, 0); j < n; ++j)
+      hmax = std::max(hmax, std::abs(a(i, j)));
+
+  /// 反射 I - beta v v^T 把 x (len 维) 变为 (alpha, 0, ...), x 为零时 beta = 0
+  auto house = [](int len, const E *x, E *v, E &beta) {
+    E nrm = 0;
+    for (int t = 0; t < len; ++t)
+      nrm += x[t] * x[t];
+    nrm = std::sqrt(nrm);
+    beta = 0;
+    if (nrm == E(0))
+      return;
+    E alpha = x[0] > 0 ? -nrm : nrm;
+    E vv = 0;
+    for (int t = 0; t < len; ++t) {
+      v[t] = t == 0 ? x[0] - alpha : x[t];
+      vv += v[t] * v[t];
+    }
+    beta = 2 / vv;
+  };
+
+  /// 把反射作用到块 [lo, hi] 的第 k 行起的 len 行 (左乘) 和 len 列 (右乘)
+  auto reflect = [&](int k, int len, const E *v, E beta, int lo, int hi) {
+    for (int j = std::max(k - 1, lo); j <= hi; ++j) {
+      E s = 0;
+      for (int t = 0; t < len; ++t)
+        s += v[t] * a(k + t, j);
+      s *= beta;
+      for (int t = 0; t < len; ++t)
+        a(k + t, j) -= s * v[t];
+    }
+    for (int i = lo, last = std::min(k + 3, hi); i <= last; ++i) {
+      E s = 0;
+      for (int t = 0; t < len; ++t)
+        s += a(i, k + t) * v[t];
+      s *= beta;
+      for (int t = 0; t < len; ++t)
+        a(i, k + t) -= s * v[t];
+    }
+  };
+
+  int steps = 30 * std::max(n, 10), stalled = 0;
+  int hi = n - 1;
+  while (hi >= 0) {
+    int lo = hi;
+    for (; lo > 0; --lo) {
+      E scale = std::abs(a(lo - 1, lo - 1)) + std::abs(a(lo, lo));
+      if (std::abs(a(lo, lo - 1)) <= eps * (scale > E(0) ? scale : hmax)) {
+        a(lo, lo - 1) = 0;
+        break;
+      }
+    }
+
+    if (lo == hi) {
+      wr[hi] = a(hi, hi);
+      wi[hi] = 0;
+      --hi;
+      stalled = 0;
+      continue;
+    }
+    if (lo == hi - 1) {
+      /// [p q; r s] 的特征值 (p + s) / 2 +- sqrt(((p - s) / 2)^2 + q r)
+      E p = a(lo, lo), q = a(lo, hi), r = a(hi, lo), s = a(hi, hi);
+      E half = (p - s) / 2, disc = half * half + q * r;
+      if (disc >= 0) {
+        /// 先求模较大的根, 另一个由两根之积得到, 避免相消
+        E far = half + (half >= 0 ? std::sqrt(disc) : -std::sqrt(disc));
+        wr[lo] = s + far;
+        wr[hi] = far != E(0) ? s - q * r / far : s;
+        wi[lo] = wi[hi] = 0;
+      } else {
+        wr[lo] = wr[hi] = s + half;
+        wi[lo] = std::sqrt(-disc);
+        wi[hi] = -wi[lo];
+      }
+      hi -= 2;
+      stalled = 0;
+      continue;
+    }
+
+    if (steps-- == 0)
+      return false;
+
+    /// 两个位移之和 tr 与之积 det
+    E tr, det;
+    if (++stalled % 10 == 0) {
+      E mu = a(hi, hi) + std::abs(a(hi, hi - 1)) + std::abs(a(hi - 1, hi - 2));
+      tr = 2 * mu;
+      det = mu * mu;
+    } else {
+      tr = a(hi - 1, hi - 1) + a(hi, hi);
+      det = a(hi - 1, hi - 1) * a(hi, hi) - a(hi - 1, hi) * a(hi, hi - 1);
+    }
+
+    E x[3], v[3], beta;
+    x[0] = a(lo, lo) * a(lo, lo) + a(lo, lo + 1) * a(lo + 1, lo) - tr * a(lo, lo) + det;
+    x[1] = a(lo + 1, lo) * (a(lo, lo) + a(lo + 1, lo + 1) - tr);
+    x[2] = a(lo + 1, lo) * a(lo + 2, lo + 1);
+    for (int k = lo; k + 2 <= hi; ++k) {
+      house(3, x, v, beta);
+      if (beta != E(0))
+        reflect(k, 3, v, beta, lo, hi);
+      if (k > lo) {
+        /// 凸起已被推到下一列, 这里的残余只是舍入误差
+        a(k + 1, k - 1) = 0;
+        a(k + 2, k - 1) = 0;
+      }
+      x[0] = a(k + 1, k);
+      x[1] = a(k + 2, k);
+      x[2] = k + 3 <= hi ? a(k + 3, k) : E(0);
+    }
+    house(2, x, v, beta);
+    if (beta != E(0))
+      reflect(hi - 1, 2, v, beta, lo, hi);
+    a(hi, hi - 2) = 0;
+  }
+  return true;
+}
+
+/// Krylov 基的经典 Gram-Schmidt 正交化, 做两遍 (CGS2): w -= V^T (V w).
+/// V 为 j 个连续存放的长度 n 的向量, 系数累加到 h. 全部是 gemv, 不分配内存
+template <typename E>
+void orthogonalize(int j, int n, const E *V, E *w, E *h, E *tmp) {
+  std::fill(h, h + j, E(0));
+  for (int pass = 0; pass < 2; ++pass) {
+    blas::gemv(blas::Transpose::No, j, n, E(1), V, n, w, 1, E(0), tmp, 1);
+    blas::gemv(blas::Transpose::Yes, j, n, E(-1), V, n, tmp, 1, E(1), w, 1);
+    for (int i = 0; i < j; ++i)
+      h[i] += tmp[i];
+  }
+}
+
+/// 随机起始向量, 与前 j 个基向量正交并单位化. 落在它们张成的空间里时返回 false
+template <typename E>
+bool random_basis(int j, int n, const E *V, E *v, E *h, E *tmp, std::mt19937 &rng) {
+  std::uniform_real_distribution<double> dist(-1, 1);
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    for (int i = 0; i < n; ++i)
+      v[i] = (E)dist(rng);
+    double before = norm2(n, v);
+    if (j > 0)
+      orthogonalize(j, n, V, v, h, tmp);
+    double nrm = norm2(n, v);
+    if (nrm > before * 1e-6) {
+      simd::scale(n, E(1 / nrm), v, v);
+      return true;
+    }
+  }
+  return false;
+}
+}
+
+/// 特征值的选取方式
+enum class EigenWhich {
+  /// 对称问题取代数值最大的, 一般问题取模最大的
+  Largest,
+  /// 对称问题取代数值最小的, 一般问题取模最小的
+  Smallest
+};
+
+/// Krylov 特征值求解参数
+struct EigenOptions {
+  /// 子空间维数 m, 0 表示取 max(2k + 1, 20), 不超过 n
+  int subspace = 0;
+  /// 最多重启次数
+  int maxRestarts = 300;
+  /// Ritz 对的残差 ||A x - theta x|| <= tolerance * |theta| 时视为收敛
+  double tolerance = 1e-10;
+  /// 随机起始向量的种子, 相同的种子得到相同的结果
+  unsigned seed = 1;
+};
+
+/// Krylov 特征值求解结果
+struct EigenResult {
+  bool converged = false;
+  int restarts = 0;
+  /// 算子乘法次数
+  int matvecs = 0;
+  /// 已收敛的所求特征对个数
+  int convergedCount = 0;
+};
+
+/// 稠密对称矩阵的全部特征对: Householder 三对角化后做隐式对称 QR 迭代.
+///
+/// 只读取 A 的下三角. 特征向量按行累积, QR 的每次旋转和反射的回代都只读写
+/// 连续的行, 回代按行并行. 不需要特征向量时只做 O(n^2) 的三对角迭代.
+template <typename E>
+class SymmetricEigen {
+private:
+  Vector<E> w;
+  /// 第 i 行为第 i 个特征向量
+  Matrix<E> Zt;
+  bool ok;
+  bool vectors;
+
+public:
+  explicit SymmetricEigen(const Matrix<E> &A, bool computeVectors = true)
+      : w(Vector<E>::zero(A.row_num())), Zt(computeVectors ? A.row_num() : 1, computeVectors ? A.row_num() : 1),
+        ok(true), vectors(computeVectors) {
+    assert(A.row_num() == A.col_num() && "eigen decomposition requires a square matrix");
+    int n = A.row_num();
+    LA_OP_SCOPE("SymmetricEigen", n, n, 0,
+                (computeVectors ? 4.0 * n * n * n : 4.0 * n * n * n / 3),
+                (double)n * n * sizeof(E));
+
+    Matrix<E> a(n, n);
+    for (int i = 0; i < n; ++i) {
+      const E *s = A.row_ptr(i);
+      E *d = a.row_ptr(i);
+      std::copy(s, s + i + 1, d);
+    }
+    for (int i = 0; i < n; ++i)
+      for (int j = i + 1; j < n; ++j)
+        a(i, j) = a(j, i);
+
+    std::vector<E> work(4 * (std::size_t)n);
+    ok = detail::symmetric_eigen(n, a.data(), a.leading_dim(), w.data(),
+                                 computeVectors ? Zt.data() : (E *)nullptr, Zt.leading_dim(),
+                                 work.data());
+  }
+
+  /// QR 迭代是否收敛
+  bool converged() const {
+    return ok;
+  }
+
+  int size() const {
+    return w.size();
+  }
+
+  /// 升序排列的特征值
+  const Vector<E> &eigenvalues() const {
+    return w;
+  }
+
+  /// 第 i 个特征值的单位特征向量
+  VectorView<const E> eigenvector(int i) const {
+    assert(vectors && "eigenvectors were not computed");
+    return Zt.row_view(i);
+  }
+
+  /// 特征向量按列排成的正交矩阵 V, A = V diag(w) V^T
+  Matrix<E> eigenvectors() const {
+    assert(vectors && "eigenvectors were not computed");
+    return Zt.T();
+  }
+};
+
+/// 对称算子的厚重启 Lanczos: 求 k 个最大或最小的特征对.
+///
+/// 每步对整个 Krylov 基做两遍 Gram-Schmidt (gemv), 保持正交性, 不会出现重复的
+/// Ritz 值. 子空间满 m 维后在 m x m 的投影矩阵上求特征分解, 保留靠近所求一端的
+/// Ritz 向量继续扩展 (thick restart, 与隐式重启 Lanczos 等价).
+/// 只需要 y = A x, 稠密, 稀疏和无矩阵算子都可以. 基与投影矩阵在第一次 solve 时
+/// 分配, 迭代过程中不再分配内存.
+template <typename E>
+class Lanczos {
+private:
+  EigenOptions opts;
+  /// Krylov 基, 第 i 个向量从 V[i * n] 开始; W 为重启时的目标
+  std::vector<E> V, W;
+  std::vector<E> h, tmp, S;
+  /// 投影矩阵 H 与它的特征分解
+  std::vector<double> H, T, theta, Yt, work;
+  std::vector<int> order;
+  std::mt19937 rng;
+
+public:
+  explicit Lanczos(EigenOptions opts = EigenOptions()) : opts(opts) {
+  }
+
+  /// A 必须对称. values 按所求一端排列 (Largest 降序, Smallest 升序),
+  /// vectors 为 n x k, 第 j 列是 values[j] 的单位特征向量. 投影矩阵的特征分解
+  /// 不收敛时立即返回, converged 为 false, values 和 vectors 不变
+  EigenResult solve(const LinearOperator<E> &A, int k, EigenWhich which, Vector<E> &values,
+                    Matrix<E> &vectors) {
+    int n = A.row_num();
+    assert(A.col_num() == n && "eigenvalues require a square operator");
+    assert(k >= 1 && k <= n);
+    int m = opts.subspace > 0 ? opts.subspace : std::max(2 * k + 1, 20);
+    m = std::min(std::max(m, k + 1), n);
+    LA_OP_SCOPE("Lanczos::solve", n, n, k, 0, 0);
+
+    V.resize((std::size_t)(m + 1) * n);
+    W.resize((std::size_t)(m + 1) * n);
+    h.resize(m + 1), tmp.resize(m + 1), S.resize((std::size_t)m * m);
+    H.assign((std::size_t)m * m, 0.0), T.resize((std::size_t)m * m);
+    theta.resize(m), Yt.resize((std::size_t)m * m), work.resize(4 * (std::size_t)m);
+    order.resize(m);
+    rng.seed(opts.seed);
+
+    auto basis = [&](int i) { return V.data() + (std::size_t)i * n; };
+    auto hh = [&](int i, int j) -> double & { return H[(std::size_t)i * m + j]; };
+    const double eps = std::numeric_limits<E>::epsilon();
+
+    EigenResult res;
+    detail::random_basis(0, n, V.data(), basis(0), h.data(), tmp.data(), rng);
+    int kept = 0;
+    double beta = 0;
+
+    while (true) {
+      /// 从第 kept 个基向量开始扩展到 m 维
+      for (int j = kept; j < m; ++j) {
+        E *w = basis(j + 1);
+        A.apply(basis(j), w);
+        ++res.matvecs;
+        double before = detail::norm2(n, w);
+        detail::orthogonalize(j + 1, n, V.data(), w, h.data(), tmp.data());
+        for (int i = 0; i <= j; ++i)
+          hh(i, j) = hh(j, i) = h[i];
+        beta = detail::norm2(n, w);
+
+        /// 不变子空间: 换一个正交的随机方向继续, 耦合系数为 0
+        if (beta <= 100 * eps * before) {
+          beta = 0;
+          if (j + 1 < m) {
+            detail::random_basis(j + 1, n, V.data(), w, h.data(), tmp.data(), rng);
+            hh(j + 1, j) = hh(j, j + 1) = 0;
+          }
+          continue;
+        }
+        simd::scale(n, E(1 / beta), w, w);
+        if (j + 1 < m)
+          hh(j + 1, j) = hh(j, j + 1) = beta;
+      }
+
+      /// Rayleigh-Ritz: H = Y diag(theta) Y^T, 升序
+      for (int i = 0; i < m; ++i)
+        std::copy(&hh(i, 0), &hh(i, 0) + m, T.data() + (std::size_t)i * m);
+      if (!detail::symmetric_eigen(m, T.data(), m, theta.data(), Yt.data(), m, work.data())) {
+        res.converged = false;
+        return res;
+      }
+      for (int i = 0; i < m; ++i)
+        order[i] = which == EigenWhich::Largest ? m - 1 - i : i;
+
+      double anorm = std::max(std::abs(theta[0]), std::abs(theta[m - 1]));
+      double floor = anorm * std::pow(eps, 2.0 / 3);
+      int kk = std::min(k, m);
+      res.convergedCount = 0;
+      for (int i = 0; i < kk; ++i) {
+        int idx = order[i];
+        double r = std::abs(beta * Yt[(std::size_t)idx * m + m - 1]);
+        if (r <= opts.tolerance * std::max(std::abs(theta[idx]), floor))
+          ++res.convergedCount;
+      }
+      res.converged = res.convergedCount == kk;
+
+      /// 保留 p 个 Ritz 向量: V[0, p) = Y_p^T V, 残差方向放在第 p 个
+      int p = res.converged || res.restarts >= opts.maxRestarts
+                  ? kk
+                  : std::min(m - 1, kk + (m - kk) / 2);
+      for (int i = 0; i < p; ++i) {
+        const double *y = Yt.data() + (std::size_t)order[i] * m;
+        for (int j = 0; j < m; ++j)
+          S[(std::size_t)i * m + j] = (E)y[j];
+      }
+      blas::gemm(p, n, m, E(1), S.data(), m, V.data(), n, E(0), W.data(), n);
+
+      if (res.converged || res.restarts >= opts.maxRestarts) {
+        values = Vector<E>::zero(kk);
+        for (int i = 0; i < kk; ++i)
+          values[i] = (E)theta[order[i]];
+        vectors = Matrix<E>(n, kk);
+        blas::transpose(kk, n, W.data(), n, vectors.data(), vectors.leading_dim());
+        return res;
+      }
+
+      std::copy(basis(m), basis(m) + n, W.data() + (std::size_t)p * n);
+      V.swap(W);
+      std::fill(H.begin(), H.end(), 0.0);
+      for (int i = 0; i < p; ++i) {
+        double s = beta * Yt[(std::size_t)order[i] * m + m - 1];
+        hh(i, i) = theta[order[i]];
+        hh(i, p) = hh(p, i) = s;
+      }
+      kept = p;
+      ++res.restarts;
+    }
+  }
+};
+
+/// 一般 (可以不对称) 算子的隐式重启 Arnoldi: 求 k 个模最大或最小的特征对.
+///
+/// m 步 Arnoldi (两遍 Gram-Schmidt) 之后, 用 m x m Hessenberg 矩阵的 Francis QR
+/// 求 Ritz 值, 把不要的 Ritz 值作为位移做隐式 QR (实位移单步, 共轭复位移成对地
+/// 做双位移), 把 Krylov 分解压缩回 k 维后继续扩展 (Sorensen 的 IRA, 与 ARPACK 相同).
+/// 共轭复特征值不会被拆开, 因此可能多返回一个. 基与小矩阵在第一次 solve 时
+/// 分配, 迭代过程中不再分配内存.
+template <typename E>
+class Arnoldi {
+private:
+  typedef std::complex<double> Complex;
+
+  EigenOptions opts;
+  std::vector<E> V, W;
+  std::vector<E> h, tmp, S, xr, xi;
+  /// Hessenberg 矩阵 H, 位移累积的正交阵 Q, Francis QR 的工作副本
+  std::vector<double> H, Q, T, wr, wi;
+  std::vector<int> order;
+  /// 复 Ritz 向量的反迭代工作区
+  std::vector<Complex> M, y, mult;
+  std::vector<char> swapped;
+  std::mt19937 rng;
+  int m;
+
+  double &hh(int i, int j) {
+    return H[(std::size_t)i * m + j];
+  }
+
+  double &qq(int i, int j) {
+    return Q[(std::size_t)i * m + j];
+  }
+
+  /// 先按模排序, 共轭对按实部和虚部排在一起, 虚部为正的在前
+  void sort_ritz(EigenWhich which) {
+    for (int i = 0; i < m; ++i)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+      double ma = std::hypot(wr[a], wi[a]), mb = std::hypot(wr[b], wi[b]);
+      if (ma != mb)
+        return which == EigenWhich::Largest ? ma > mb : ma < mb;
+      if (wr[a] != wr[b])
+        return wr[a] > wr[b];
+      return wi[a] > wi[b];
+    });
+  }
+
+  /// 对 H 的 i, i + 1 行 (列 [c0, m)) 和 i, i + 1 列 (行 [0, r1]) 做相似旋转, 并累积到 Q
+  void givens(int i, double c, double s, int c0, int r1) {
+    for (int j = c0; j < m; ++j) {
+      double a = hh(i, j), b = hh(i + 1, j);
+      hh(i, j) = c * a + s * b;
+      hh(i + 1, j) = -s * a + c * b;
+    }
+    for (int j = 0; j <= r1; ++j) {
+      double a = hh(j, i), b = hh(j, i + 1);
+      hh(j, i) = c * a + s * b;
+      hh(j, i + 1) = -s * a + c * b;
+    }
+    for (int j = 0; j < m; ++j) {
+      double a = qq(j, i), b = qq(j, i + 1);
+      qq(j, i) = c * a + s * b;
+      qq(j, i + 1) = -s * a + c * b;
+    }
+  }
+
+  /// 实位移 mu 的隐式单位移 QR 步
+  void shift_single(double mu) {
+    double x = hh(0, 0) - mu, y0 = hh(1, 0);
+    for (int i = 0; i + 1 < m; ++i) {
+      double r = std::hypot(x, y0);
+      double c = r == 0 ? 1 : x / r, s = r == 0 ? 0 : y0 / r;
+      givens(i, c, s, std::max(0, i - 1), std::min(i + 2, m - 1));
+      if (i > 0)
+        hh(i + 1, i - 1) = 0;
+      if (i + 2 < m) {
+        x = hh(i + 1, i);
+        y0 = hh(i + 2, i);
+      }
+    }
+  }
+
+  /// 对 H 的 k 起连续 len 行 (列 [c0, m)) 和列 (行 [0, r1]) 做 Householder 相似变换
+  void reflect(int k, int len, const double *x, int c0, int r1) {
+    double v[3], alpha = 0;
+    for (int i = 0; i < len; ++i)
+      alpha += x[i] * x[i];
+    alpha = std::sqrt(alpha);
+    if (alpha == 0)
+      return;
+    if (x[0] > 0)
+      alpha = -alpha;
+    for (int i = 0; i < len; ++i)
+      v[i] = x[i];
+    v[0] -= alpha;
+    double vv = 0;
+    for (int i = 0; i < len; ++i)
+      vv += v[i] * v[i];
+    double beta = 2 / vv;
+    for (int j = c0; j < m; ++j) {
+      double s = 0;
+      for (int i = 0; i < len; ++i)
+        s += v[i] * hh(k + i, j);
+      s *= beta;
+      for (int i = 0; i < len; ++i)
+        hh(k + i, j) -= s * v[i];
+    }
+    for (int j = 0; j <= r1; ++j) {
+      double s = 0;
+      for (int i = 0; i < len; ++i)
+        s += hh(j, k + i) * v[i];
+      s *= beta;
+      for (int i = 0; i < len; ++i)
+        hh(j, k + i) -= s * v[i];
+    }
+    for (int j = 0; j < m; ++j) {
+      double s = 0;
+      for (int i = 0; i < len; ++i)
+        s += qq(j, k + i) * v[i];
+      s *= beta;
+      for (int i = 0; i < len; ++i)
+        qq(j, k + i) -= s * v[i];
+    }
+  }
+
+  /// 共轭复位移 re +- i im 的 Francis 双位移步, 全程实数运算
+  void shift_double(double re, double im) {
+    double s = 2 * re, t = re * re + im * im;
+    double x[3];
+    x[0] = hh(0, 0) * hh(0, 0) + hh(0, 1) * hh(1, 0) - s * hh(0, 0) + t;
+    x[1] = hh(1, 0) * (hh(0, 0) + hh(1, 1) - s);
+    x[2] = hh(1, 0) * hh(2, 1);
+    for (int k = 0; k + 2 < m; ++k) {
+      reflect(k, 3, x, std::max(0, k - 1), std::min(k + 3, m - 1));
+      if (k > 0)
+        hh(k + 1, k - 1) = hh(k + 2, k - 1) = 0;
+      x[0] = hh(k + 1, k);
+      x[1] = hh(k + 2, k);
+      x[2] = k + 3 < m ? hh(k + 3, k) : 0;
+    }
+    reflect(m - 2, 2, x, m - 3, m - 1);
+    hh(m - 1, m - 3) = 0;
+  }
+
+  /// H 对应 Ritz 值 lambda 的单位特征向量 (复), 用两步反迭代, 写入 y
+  void ritz_vector(Complex lambda, double hnorm) {
+    auto mm = [&](int i, int j) -> Complex & { return M[(std::size_t)i * m + j]; };
+    for (int i = 0; i < m; ++i)
+      for (int j = 0; j < m; ++j)
+        mm(i, j) = j >= i - 1 ? Complex(hh(i, j)) : Complex(0);
+    for (int i = 0; i < m; ++i)
+      mm(i, i) -= lambda;
+
+    /// Hessenberg 的部分选主元 LU, 只可能与下一行交换
+    double tiny = std::numeric_limits<double>::epsilon() * std::max(hnorm, 1e-300);
+    for (int i = 0; i < m; ++i) {
+      swapped[i] = 0;
+      if (i + 1 < m && std::abs(mm(i + 1, i)) > std::abs(mm(i, i))) {
+        for (int j = i; j < m; ++j)
+          std::swap(mm(i, j), mm(i + 1, j));
+        swapped[i] = 1;
+      }
+      if (std::abs(mm(i, i)) < tiny)
+        mm(i, i) = tiny;
+      if (i + 1 < m) {
+        Complex l = mult[i] = mm(i + 1, i) / mm(i, i);
+        for (int j = i + 1; j < m; ++j)
+          mm(i + 1, j) -= l * mm(i, j);
+      }
+    }
+
+    std::fill(y.begin(), y.end(), Complex(1));
+    for (int it = 0; it < 2; ++it) {
+      for (int i = 0; i + 1 < m; ++i) {
+        if (swapped[i])
+          std::swap(y[i], y[i + 1]);
+        y[i + 1] -= mult[i] * y[i];
+      }
+      for (int i = m - 1; i >= 0; --i) {
+        Complex s = y[i];
+        for (int j = i + 1; j < m; ++j)
+          s -= mm(i, j) * y[j];
+        y[i] = s / mm(i, i);
+      }
+      double nrm = 0;
+      for (int i = 0; i < m; ++i)
+        nrm += std::norm(y[i]);
+      nrm = std::sqrt(nrm);
+      for (int i = 0; i < m; ++i)
+        y[i] /= nrm;
+    }
+  }
+
+public:
+  explicit Arnoldi(EigenOptions opts = EigenOptions()) : opts(opts), m(0) {
+  }
+
+  /// values 按所求一端排列; vectors 为 n x values.size(). 实特征值占一列单位特征向量,
+  /// 共轭对 a +- bi 占相邻两列, 分别是 a + bi 的特征向量的实部和虚部.
+  /// Hessenberg 矩阵的 QR 迭代不收敛时立即返回, converged 为 false, 输出不变
+  EigenResult solve(const LinearOperator<E> &A, int k, EigenWhich which,
+                    std::vector<std::complex<E>> &values, Matrix<E> &vectors) {
+    int n = A.row_num();
+    assert(A.col_num() == n && "eigenvalues require a square operator");
+    m = opts.subspace > 0 ? opts.subspace : std::max(2 * k + 1, 20);
+    m = std::min(std::max(m, k + 2), n);
+    assert(k >= 1 && k + 2 <= m && "Arnoldi needs at least k + 2 basis vectors");
+    LA_OP_SCOPE("Arnoldi::solve", n, n, k, 0, 0);
+
+    V.resize((std::size_t)(m + 1) * n);
+    W.resize((std::size_t)(m + 1) * n);
+    h.resize(m + 1), tmp.resize(m + 1), S.resize((std::size_t)(m + 1) * m);
+    xr.resize(n), xi.resize(n);
+    H.assign((std::size_t)m * m, 0.0), Q.resize((std::size_t)m * m), T.resize((std::size_t)m * m);
+    wr.resize(m), wi.resize(m), order.resize(m);
+    M.resize((std::size_t)m * m), y.resize(m), mult.resize(m), swapped.resize(m);
+    rng.seed(opts.seed);
+
+    auto basis = [&](int i) { return V.data() + (std::size_t)i * n; };
+    const double eps = std::numeric_limits<E>::epsilon();
+
+    EigenResult res;
+    detail::random_basis(0, n, V.data(), basis(0), h.data(), tmp.data(), rng);
+    int kept = 0;
+    double beta = 0;
+
+    while (true) {
+      for (int j = kept; j < m; ++j) {
+        E *w = basis(j + 1);
+        A.apply(basis(j), w);
+        ++res.matvecs;
+        double before = detail::norm2(n, w);
+        detail::orthogonalize(j + 1, n, V.data(), w, h.data(), tmp.data());
+        for (int i = 0; i <= j; ++i)
+          hh(i, j) = h[i];
+        beta = detail::norm2(n, w);
+
+        if (beta <= 100 * eps * before) {
+          beta = 0;
+          if (j + 1 < m) {
+            detail::random_basis(j + 1, n, V.data(), w, h.data(), tmp.data(), rng);
+            hh(j + 1, j) = 0;
+          }
+          continue;
+        }
+        simd::scale(n, E(1 / beta), w, w);
+        if (j + 1 < m)
+          hh(j + 1, j) = beta;
+      }
+
+      /// Ritz 值
+      std::copy(H.begin(), H.end(), T.begin());
+      if (!detail::hessenberg_eigenvalues(m, T.data(), m, wr.data(), wi.data())) {
+        res.converged = false;
+        return res;
+      }
+      sort_ritz(which);
+      int kk = k;
+      if (wi[order[kk - 1]] > 0)
+        ++kk;
+
+      double hnorm = 0;
+      for (int i = 0; i < m; ++i)
+        hnorm = std::max(hnorm, std::hypot(wr[i], wi[i]));
+      double floor = hnorm * std::pow(eps, 2.0 / 3);
+      res.convergedCount = 0;
+      for (int i = 0; i < kk; ++i) {
+        int idx = order[i];
+        ritz_vector(Complex(wr[idx], wi[idx]), hnorm);
+        double r = beta * std::abs(y[m - 1]);
+        if (r <= opts.tolerance * std::max(std::hypot(wr[idx], wi[idx]), floor))
+          ++res.convergedCount;
+      }
+      res.converged = res.convergedCount >= kk;
+
+      if (res.converged || res.restarts >= opts.maxRestarts) {
+        values.resize(kk);
+        vectors = Matrix<E>(n, kk);
+        for (int i = 0; i < kk; ++i) {
+          int idx = order[i];
+          values[i] = std::complex<E>((E)wr[idx], (E)wi[idx]);
+          if (wi[idx] < 0)
+            continue;
+          ritz_vector(Complex(wr[idx], wi[idx]), hnorm);
+          for (int j = 0; j < m; ++j)
+            tmp[j] = (E)y[j].real();
+          blas::gemv(blas::Transpose::Yes, m, n, E(1), V.data(), n, tmp.data(), 1, E(0),
+                     xr.data(), 1);
+          for (int r = 0; r < n; ++r)
+            vectors(r, i) = xr[r];
+          if (wi[idx] > 0 && i + 1 < kk) {
+            for (int j = 0; j < m; ++j)
+              tmp[j] = (E)y[j].imag();
+            blas::gemv(blas::Transpose::Yes, m, n, E(1), V.data(), n, tmp.data(), 1, E(0),
+                       xi.data(), 1);
+            for (int r = 0; r < n; ++r)
+              vectors(r, i + 1) = xi[r];
+          } else if (wi[idx] == 0) {
+            /// 实特征向量的相位任意, 取实部后重新单位化
+            double nrm = detail::norm2(n, xr.data());
+            for (int r = 0; r < n; ++r)
+              vectors(r, i) = nrm > 0 ? E(xr[r] / nrm) : xr[r];
+          }
+        }
+        return res;
+      }
+
+      /// 用不要的 Ritz 值做隐式位移
+      for (int i = 0; i < m; ++i)
+        for (int j = 0; j < m; ++j)
+          qq(i, j) = i == j;
+      for (int i = kk; i < m; ++i) {
+        int idx = order[i];
+        if (wi[idx] != 0) {
+          shift_double(wr[idx], std::abs(wi[idx]));
+          ++i;
+        } else {
+          shift_single(wr[idx]);
+        }
+      }
+      for (int i = 0; i < m; ++i)
+        for (int j = 0; j + 1 < i; ++j)
+          hh(i, j) = 0;
+
+      /// V[0, kk] = Q[:, 0..kk]^T V, f = H(kk, kk-1) V Q[:, kk] + beta Q(m-1, kk-1) v_m
+      for (int i = 0; i <= kk; ++i)
+        for (int j = 0; j < m; ++j)
+          S[(std::size_t)i * m + j] = (E)qq(j, i);
+      blas::gemm(kk + 1, n, m, E(1), S.data(), m, V.data(), n, E(0), W.data(), n);
+      E *f = W.data() + (std::size_t)kk * n;
+      simd::scale(n, E(hh(kk, kk - 1)), f, f);
+      simd::axpy(n, E(beta * qq(m - 1, kk - 1)), basis(m), f);
+      V.swap(W);
+
+      for (int i = 0; i < m; ++i)
+        for (int j = kk; j < m; ++j)
+          hh(i, j) = 0;
+      for (int i = kk; i < m; ++i)
+        for (int j = 0; j < kk; ++j)
+          hh(i, j) = 0;
+
+      /// 残差重新与保留的基正交, 作为第 kk 个基向量; 去掉的分量并入 H 的第 kk - 1 列
+      E *v = basis(kk);
+      detail::orthogonalize(kk, n, V.data(), v, h.data(), tmp.data());
+      for (int i = 0; i < kk; ++i)
+        hh(i, kk - 1) += h[i];
+      double fb = detail::norm2(n, v);
+      if (fb > 0) {
+        simd::scale(n, E(1 / fb), v, v);
+      } else {
+        detail::random_basis(kk, n, V.data(), v, h.data(), tmp.data(), rng);
+      }
+      hh(kk, kk - 1) = fb;
+      kept = kk;
+      ++res.restarts;
+    }
+  }
+};
+}
+
+#endif // LA_EIGEN_H
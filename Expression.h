@@ -0,0 +1,552 @@
+/**********************************
+ * File:     Expression.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/27
+ ***********************************/
+
+#ifndef LA_EXPRESSION_H
+#define LA_EXPRESSION_H
+
+#include <cassert>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+/// 维数在运行期确定; 编译期维数的特化见 FixedSize.h
+constexpr int Dynamic = -1;
+
+template <typename E, int N = Dynamic> class Vector;
+template <typename E, int R = Dynamic, int C = Dynamic> class Matrix;
+
+/// 惰性表达式模板: 向量/矩阵的加减和数乘不立即计算, 而是构造一棵表达式树,
+/// 赋值给 Vector/Matrix 时才在一个融合循环里逐元素求值并直接写入目标.
+///
+/// 注意生命周期: 左值 Vector/Matrix 操作数只保存引用. auto c = a + b; 之后修改 a
+/// 会改变 c 求出的值, a 析构后 c 悬空. 需要保存结果时直接写 Vector<E> c = a + b;
+/// 或调用 .eval(). 右值操作数 (函数返回的临时对象) 会被移动进表达式按值保存,
+/// 所以 auto e = f() + b; 中的 f() 在 e 的整个生命周期内有效. 嵌套的子表达式
+/// 同样被移动进父节点, (f() + a) * 2 + b 只分配 f() 和结果两块内存; 把左值
+/// 表达式 e 再作为操作数时 e 被拷贝, 其中 f() 的数据也随之拷贝一份
+namespace expr {
+
+struct Add {
+  template <typename T>
+  static T apply(T a, T b) { return a + b; }
+};
+
+struct Sub {
+  template <typename T>
+  static T apply(T a, T b) { return a - b; }
+};
+
+struct Mul {
+  template <typename T>
+  static T apply(T a, T b) { return a * b; }
+};
+
+struct Div {
+  template <typename T>
+  static T apply(T a, T b) { return a / b; }
+};
+
+/// 右值叶子: 接管临时 Vector/Matrix 的缓冲区后按值保存. 所在节点被移动进
+/// 父节点时它也随之移动, 整棵表达式树里数据始终只有这一份
+template <typename T>
+struct Temp : T {
+  explicit Temp(T &&t) : T(std::move(t)) {
+  }
+};
+
+template <typename E>
+using TempVector = Temp<Vector<E>>;
+
+template <typename E>
+using TempMatrix = Temp<Matrix<E>>;
+
+/// 表达式节点按值保存子节点, 但左值 Vector/Matrix 叶子只保存引用, 避免拷贝数据.
+/// 子节点不是 const 的, 这样右值节点可以被移动进父节点
+template <typename T>
+struct Storage {
+  typedef T type;
+};
+
+template <typename E>
+struct Storage<Vector<E>> {
+  typedef const Vector<E> &type;
+};
+
+template <typename E>
+struct Storage<Matrix<E>> {
+  typedef const Matrix<E> &type;
+};
+}
+
+/// 向量表达式的 CRTP 基类
+template <typename Derived>
+struct VecExpr {
+  const Derived &self() const {
+    return static_cast<const Derived &>(*this);
+  }
+
+  /// 立即求值为一个 Vector
+  template <typename D = Derived>
+  Vector<typename D::value_type> eval() const {
+    return Vector<typename D::value_type>(*this);
+  }
+};
+
+/// 逐元素二元运算 l op r
+template <typename Op, typename L, typename R>
+class VecBinary : public VecExpr<VecBinary<Op, L, R>> {
+private:
+  typename expr::Storage<L>::type l;
+  typename expr::Storage<R>::type r;
+public:
+  typedef typename L::value_type value_type;
+
+  template <typename A, typename B>
+  VecBinary(A &&a, B &&b) : l(std::forward<A>(a)), r(std::forward<B>(b)) {
+    assert(l.size() == r.size() && "Length of vectors must be same.");
+  }
+
+  value_type operator[](int index) const {
+    return Op::apply(l[index], r[index]);
+  }
+
+  int size() const {
+    return l.size();
+  }
+
+  const L &lhs() const {
+    return l;
+  }
+
+  const R &rhs() const {
+    return r;
+  }
+};
+
+/// 与标量的逐元素运算 l op k
+template <typename Op, typename L>
+class VecScalar : public VecExpr<VecScalar<Op, L>> {
+public:
+  typedef typename L::value_type value_type;
+
+private:
+  typename expr::Storage<L>::type l;
+  value_type k;
+
+public:
+  template <typename A>
+  VecScalar(A &&a, value_type k) : l(std::forward<A>(a)), k(k) {
+  }
+
+  value_type operator[](int index) const {
+    return Op::apply(l[index], k);
+  }
+
+  int size() const {
+    return l.size();
+  }
+
+  const L &lhs() const {
+    return l;
+  }
+
+  value_type scalar() const {
+    return k;
+  }
+};
+
+namespace expr {
+
+/// 运算符的转发引用参数 A 在节点里保存的子节点类型: 左值 Vector/Matrix 叶子
+/// 原样 (Storage 只保存引用), 右值 Vector/Matrix 包成 Temp 接管缓冲区, 表达式
+/// 节点按值保存 (右值移动, 左值拷贝)
+template <typename A>
+struct Operand {
+  typedef typename std::decay<A>::type type;
+};
+
+template <typename E>
+struct Operand<Vector<E>> {
+  typedef TempVector<E> type;
+};
+
+template <typename E>
+struct Operand<Matrix<E>> {
+  typedef TempMatrix<E> type;
+};
+
+template <typename A>
+struct IsVec
+    : std::is_base_of<VecExpr<typename std::decay<A>::type>, typename std::decay<A>::type> {};
+
+/// 向量运算符的返回类型, 操作数不是向量表达式时从重载中移除
+template <typename Op, typename L, typename R>
+using VecOp = typename std::enable_if<
+    IsVec<L>::value && IsVec<R>::value,
+    VecBinary<Op, typename Operand<L>::type, typename Operand<R>::type>>::type;
+
+template <typename Op, typename L>
+using VecOpK =
+    typename std::enable_if<IsVec<L>::value, VecScalar<Op, typename Operand<L>::type>>::type;
+}
+
+/// 向量加法
+template <typename L, typename R>
+expr::VecOp<expr::Add, L, R> operator+(L &&l, R &&r) {
+  return expr::VecOp<expr::Add, L, R>(std::forward<L>(l), std::forward<R>(r));
+}
+
+/// 向量减法
+template <typename L, typename R>
+expr::VecOp<expr::Sub, L, R> operator-(L &&l, R &&r) {
+  return expr::VecOp<expr::Sub, L, R>(std::forward<L>(l), std::forward<R>(r));
+}
+
+/// 数量乘法 self * k
+template <typename L>
+expr::VecOpK<expr::Mul, L> operator*(L &&l, typename std::decay<L>::type::value_type k) {
+  return expr::VecOpK<expr::Mul, L>(std::forward<L>(l), k);
+}
+
+/// 数量乘法 k * self
+template <typename L>
+expr::VecOpK<expr::Mul, L> operator*(typename std::decay<L>::type::value_type k, L &&l) {
+  return expr::VecOpK<expr::Mul, L>(std::forward<L>(l), k);
+}
+
+/// 数量除法 self / k
+template <typename L>
+expr::VecOpK<expr::Div, L> operator/(L &&l, typename std::decay<L>::type::value_type k) {
+  assert(k != 0);
+  return expr::VecOpK<expr::Div, L>(std::forward<L>(l), k);
+}
+
+/// neg
+template <typename L>
+expr::VecOpK<expr::Mul, L> operator-(L &&l) {
+  typedef typename std::decay<L>::type::value_type value_type;
+  return expr::VecOpK<expr::Mul, L>(std::forward<L>(l), value_type(-1));
+}
+
+/// pos
+template <typename L>
+const L &operator+(const VecExpr<L> &l) {
+  return l.self();
+}
+
+/// 打印向量表达式, 格式与 Vector 相同
+template <typename D>
+std::ostream &operator<<(std::ostream &os, const VecExpr<D> &e) {
+  const D &v = e.self();
+  os << "(";
+  int sz = v.size();
+  for (int i = 0; i < sz - 1; ++i)
+    os << v[i] << ",";
+  if (sz > 0)
+    os << v[sz - 1];
+  os << ")";
+  return os;
+}
+
+namespace expr {
+
+/// 通用求值: 一个融合循环, 每个元素只读写一次
+template <typename E, typename X>
+void assign(E *dst, const X &e) {
+  int n = e.size();
+  for (int i = 0; i < n; ++i)
+    dst[i] = e[i];
+}
+
+/// 简单的单层表达式直接走 SIMD 内核
+template <typename E>
+void assign(E *dst, const VecBinary<Add, Vector<E>, Vector<E>> &e) {
+  simd::add(e.size(), e.lhs().data(), e.rhs().data(), dst);
+}
+
+template <typename E>
+void assign(E *dst, const VecBinary<Sub, Vector<E>, Vector<E>> &e) {
+  simd::sub(e.size(), e.lhs().data(), e.rhs().data(), dst);
+}
+
+template <typename E>
+void assign(E *dst, const VecScalar<Mul, Vector<E>> &e) {
+  simd::scale(e.size(), e.scalar(), e.lhs().data(), dst);
+}
+
+/// dst += e
+template <typename E, typename X>
+void add_assign(E *dst, const X &e) {
+  int n = e.size();
+  for (int i = 0; i < n; ++i)
+    dst[i] += e[i];
+}
+
+template <typename E>
+void add_assign(E *dst, const Vector<E> &e) {
+  simd::add(e.size(), dst, e.data(), dst);
+}
+
+/// y += k * x 即 axpy
+template <typename E>
+void add_assign(E *dst, const VecScalar<Mul, Vector<E>> &e) {
+  simd::axpy(e.size(), e.scalar(), e.lhs().data(), dst);
+}
+
+/// dst -= e
+template <typename E, typename X>
+void sub_assign(E *dst, const X &e) {
+  int n = e.size();
+  for (int i = 0; i < n; ++i)
+    dst[i] -= e[i];
+}
+
+template <typename E>
+void sub_assign(E *dst, const Vector<E> &e) {
+  simd::sub(e.size(), dst, e.data(), dst);
+}
+
+template <typename E>
+void sub_assign(E *dst, const VecScalar<Mul, Vector<E>> &e) {
+  simd::axpy(e.size(), E(-e.scalar()), e.lhs().data(), dst);
+}
+}
+
+/// 矩阵表达式的 CRTP 基类, 节点提供 row_num(), col_num() 和 (i, j) 取值
+template <typename Derived>
+struct MatExpr {
+  const Derived &self() const {
+    return static_cast<const Derived &>(*this);
+  }
+
+  /// 立即求值为一个 Matrix
+  template <typename D = Derived>
+  Matrix<typename D::value_type> eval() const {
+    return Matrix<typename D::value_type>(*this);
+  }
+};
+
+/// 逐元素二元运算 l op r
+template <typename Op, typename L, typename R>
+class MatBinary : public MatExpr<MatBinary<Op, L, R>> {
+private:
+  typename expr::Storage<L>::type l;
+  typename expr::Storage<R>::type r;
+public:
+  typedef typename L::value_type value_type;
+
+  template <typename A, typename B>
+  MatBinary(A &&a, B &&b) : l(std::forward<A>(a)), r(std::forward<B>(b)) {
+    assert(l.row_num() == r.row_num() && l.col_num() == r.col_num() &&
+           "Shape of matrices must be same.");
+  }
+
+  const L &lhs() const {
+    return l;
+  }
+
+  const R &rhs() const {
+    return r;
+  }
+
+  value_type operator()(int i, int j) const {
+    return Op::apply(l(i, j), r(i, j));
+  }
+
+  int row_num() const {
+    return l.row_num();
+  }
+
+  int col_num() const {
+    return l.col_num();
+  }
+};
+
+/// 与标量的逐元素运算 l op k
+template <typename Op, typename L>
+class MatScalar : public MatExpr<MatScalar<Op, L>> {
+public:
+  typedef typename L::value_type value_type;
+
+private:
+  typename expr::Storage<L>::type l;
+  value_type k;
+
+public:
+  template <typename A>
+  MatScalar(A &&a, value_type k) : l(std::forward<A>(a)), k(k) {
+  }
+
+  const L &lhs() const {
+    return l;
+  }
+
+  value_type operator()(int i, int j) const {
+    return Op::apply(l(i, j), k);
+  }
+
+  int row_num() const {
+    return l.row_num();
+  }
+
+  int col_num() const {
+    return l.col_num();
+  }
+};
+
+namespace expr {
+
+/// 原地求值到 dst (行跨度 ld, rows x cols) 时, 表达式是否会读到 dst 里已被改写的
+/// 其他位置. 逐元素表达式中的 Matrix 叶子只读同一位置, 所以默认不会; 与 dst
+/// 重叠且布局不同的视图 (例如自身的转置) 需要先求值到临时矩阵
+template <typename X>
+struct Alias {
+  template <typename T>
+  static bool check(const X &, const T *, int, int, int) {
+    return false;
+  }
+};
+
+template <typename Op, typename L, typename R>
+struct Alias<MatBinary<Op, L, R>> {
+  template <typename T>
+  static bool check(const MatBinary<Op, L, R> &e, const T *dst, int ld, int rows, int cols) {
+    return Alias<L>::check(e.lhs(), dst, ld, rows, cols) ||
+           Alias<R>::check(e.rhs(), dst, ld, rows, cols);
+  }
+};
+
+template <typename Op, typename L>
+struct Alias<MatScalar<Op, L>> {
+  template <typename T>
+  static bool check(const MatScalar<Op, L> &e, const T *dst, int ld, int rows, int cols) {
+    return Alias<L>::check(e.lhs(), dst, ld, rows, cols);
+  }
+};
+}
+
+namespace expr {
+
+template <typename A>
+struct IsMat
+    : std::is_base_of<MatExpr<typename std::decay<A>::type>, typename std::decay<A>::type> {};
+
+/// 矩阵运算符的返回类型, 子节点类型的规则同 VecOp
+template <typename Op, typename L, typename R>
+using MatOp = typename std::enable_if<
+    IsMat<L>::value && IsMat<R>::value,
+    MatBinary<Op, typename Operand<L>::type, typename Operand<R>::type>>::type;
+
+template <typename Op, typename L>
+using MatOpK =
+    typename std::enable_if<IsMat<L>::value, MatScalar<Op, typename Operand<L>::type>>::type;
+}
+
+/// 返回两个矩阵的加法
+template <typename L, typename R>
+expr::MatOp<expr::Add, L, R> operator+(L &&l, R &&r) {
+  return expr::MatOp<expr::Add, L, R>(std::forward<L>(l), std::forward<R>(r));
+}
+
+/// 返回两个矩阵的减法
+template <typename L, typename R>
+expr::MatOp<expr::Sub, L, R> operator-(L &&l, R &&r) {
+  return expr::MatOp<expr::Sub, L, R>(std::forward<L>(l), std::forward<R>(r));
+}
+
+/// 返回矩阵的数量乘法 self * k
+template <typename L>
+expr::MatOpK<expr::Mul, L> operator*(L &&l, typename std::decay<L>::type::value_type k) {
+  return expr::MatOpK<expr::Mul, L>(std::forward<L>(l), k);
+}
+
+/// 返回矩阵的数量乘法 k * self
+template <typename L>
+expr::MatOpK<expr::Mul, L> operator*(typename std::decay<L>::type::value_type k, L &&l) {
+  return expr::MatOpK<expr::Mul, L>(std::forward<L>(l), k);
+}
+
+/// 返回数量除法结果
+template <typename L>
+expr::MatOpK<expr::Div, L> operator/(L &&l, typename std::decay<L>::type::value_type k) {
+  assert(k != 0);
+  return expr::MatOpK<expr::Div, L>(std::forward<L>(l), k);
+}
+
+/// neg
+template <typename L>
+expr::MatOpK<expr::Mul, L> operator-(L &&l) {
+  typedef typename std::decay<L>::type::value_type value_type;
+  return expr::MatOpK<expr::Mul, L>(std::forward<L>(l), value_type(-1));
+}
+
+/// pos
+template <typename L>
+const L &operator+(const MatExpr<L> &l) {
+  return l.self();
+}
+
+/// 打印矩阵表达式, 格式与 Matrix 相同
+template <typename D>
+std::ostream &operator<<(std::ostream &os, const MatExpr<D> &e) {
+  const D &mat = e.self();
+  os << "Matrix(" << std::endl;
+  for (int i = 0; i < mat.row_num(); ++i) {
+    os << "[";
+    int col = mat.col_num();
+    for (int j = 0; j < col - 1; ++j)
+      os << mat(i, j) << ",";
+    os << mat(i, col - 1) << "]" << std::endl;
+  }
+  os << ")" << std::endl;
+  return os;
+}
+
+namespace expr {
+
+/// 逐行求值, dst 是行跨度为 ld 的行主序缓冲区
+template <typename E, typename X>
+void assign(E *dst, int ld, const X &e) {
+  int rows = e.row_num(), cols = e.col_num();
+  for (int i = 0; i < rows; ++i) {
+    E *d = dst + (std::size_t)i * ld;
+    for (int j = 0; j < cols; ++j)
+      d[j] = e(i, j);
+  }
+}
+
+/// dst += e
+template <typename E, typename X>
+void add_assign(E *dst, int ld, const X &e) {
+  int rows = e.row_num(), cols = e.col_num();
+  for (int i = 0; i < rows; ++i) {
+    E *d = dst + (std::size_t)i * ld;
+    for (int j = 0; j < cols; ++j)
+      d[j] += e(i, j);
+  }
+}
+
+/// dst -= e
+template <typename E, typename X>
+void sub_assign(E *dst, int ld, const X &e) {
+  int rows = e.row_num(), cols = e.col_num();
+  for (int i = 0; i < rows; ++i) {
+    E *d = dst + (std::size_t)i * ld;
+    for (int j = 0; j < cols; ++j)
+      d[j] -= e(i, j);
+  }
+}
+}
+}
+
+#endif // LA_EXPRESSION_H
@@ -0,0 +1,661 @@
+/**********************************
+ * File:     FixedSize.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/1
+ ***********************************/
+
+#ifndef LA_FIXEDSIZE_H
+#define LA_FIXEDSIZE_H
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include "Vector.h"
+#include "Matrix.h"
+
+/// 编译期循环次数已知, 要求编译器完全展开
+#if defined(__clang__)
+#define LA_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define LA_UNROLL _Pragma("GCC unroll 16")
+#else
+#define LA_UNROLL
+#endif
+
+namespace LinearAlgebra {
+
+/// 编译期维数的向量: 数据内联存放 (在栈上或寄存器里), 不分配堆内存.
+/// 维数不匹配的运算在编译期就无法通过重载决议
+template <typename E, int N>
+class Vector {
+  static_assert(N > 0, "dimension must be positive");
+
+public:
+  typedef E value_type;
+
+private:
+  E v[N];
+
+public:
+  /// 零向量
+  constexpr Vector() : v{} {
+  }
+
+  /// Vector<double, 3> v(1, 2, 3), 参数个数必须等于 N
+  template <typename... Args>
+  constexpr explicit Vector(E first, Args... rest) : v{first, E(rest)...} {
+    static_assert(sizeof...(Args) + 1 == N, "number of elements must equal the dimension");
+  }
+
+  /// 从运行期向量拷贝, 长度在运行期检查
+  explicit Vector(const Vector<E> &other) : v{} {
+    assert(other.size() == N && "Length of vectors must be same.");
+    for (int i = 0; i < N; ++i)
+      v[i] = other[i];
+  }
+
+  /// 转换为运行期向量
+  Vector<E> to_dynamic() const {
+    return Vector<E>(v, N);
+  }
+
+  static constexpr int size() {
+    return N;
+  }
+
+  constexpr E &operator[](int index) {
+    return v[index];
+  }
+
+  constexpr const E &operator[](int index) const {
+    return v[index];
+  }
+
+  E *data() {
+    return v;
+  }
+
+  const E *data() const {
+    return v;
+  }
+
+  static constexpr Vector zero() {
+    return Vector();
+  }
+
+  constexpr Vector &operator+=(const Vector &o) {
+    LA_UNROLL
+    for (int i = 0; i < N; ++i)
+      v[i] += o.v[i];
+    return *this;
+  }
+
+  constexpr Vector &operator-=(const Vector &o) {
+    LA_UNROLL
+    for (int i = 0; i < N; ++i)
+      v[i] -= o.v[i];
+    return *this;
+  }
+
+  constexpr Vector &operator*=(E k) {
+    LA_UNROLL
+    for (int i = 0; i < N; ++i)
+      v[i] *= k;
+    return *this;
+  }
+
+  constexpr Vector &operator/=(E k) {
+    LA_UNROLL
+    for (int i = 0; i < N; ++i)
+      v[i] /= k;
+    return *this;
+  }
+
+  /// 向量点乘
+  constexpr E dot(const Vector &o) const {
+    E s = 0;
+    LA_UNROLL
+    for (int i = 0; i < N; ++i)
+      s += v[i] * o.v[i];
+    return s;
+  }
+
+  /// 返回向量的模
+  double norm() const {
+    return std::sqrt((double)dot(*this));
+  }
+
+  /// 归一化, 单位向量
+  Vector normalize() const {
+    double normVal = norm();
+    if (normVal < 1e-8)
+      throw ZeroDivisionError("Normalize error! norm is zero.");
+    Vector res(*this);
+    res *= E(1 / normVal);
+    return res;
+  }
+
+  friend constexpr Vector operator+(Vector a, const Vector &b) {
+    return a += b;
+  }
+
+  friend constexpr Vector operator-(Vector a, const Vector &b) {
+    return a -= b;
+  }
+
+  friend constexpr Vector operator*(Vector a, E k) {
+    return a *= k;
+  }
+
+  friend constexpr Vector operator*(E k, Vector a) {
+    return a *= k;
+  }
+
+  friend constexpr Vector operator/(Vector a, E k) {
+    return a /= k;
+  }
+
+  friend constexpr Vector operator-(Vector a) {
+    return a *= E(-1);
+  }
+
+  friend constexpr const Vector &operator+(const Vector &a) {
+    return a;
+  }
+
+  friend constexpr bool operator==(const Vector &a, const Vector &b) {
+    for (int i = 0; i < N; ++i)
+      if (a.v[i] != b.v[i])
+        return false;
+    return true;
+  }
+
+  friend constexpr bool operator!=(const Vector &a, const Vector &b) {
+    return !(a == b);
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const Vector &a) {
+    os << "(";
+    for (int i = 0; i < N - 1; ++i)
+      os << a.v[i] << ",";
+    os << a.v[N - 1] << ")";
+    return os;
+  }
+};
+
+/// 三维叉乘
+template <typename E>
+constexpr Vector<E, 3> cross(const Vector<E, 3> &a, const Vector<E, 3> &b) {
+  return Vector<E, 3>(a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                      a[0] * b[1] - a[1] * b[0]);
+}
+
+namespace detail {
+template <typename E, int N> struct FixedSquare;
+}
+
+/// 编译期维数的行主序矩阵, 数据内联存放, 不分配堆内存
+template <typename E, int R, int C>
+class Matrix {
+  static_assert(R > 0 && C > 0, "dimension must be positive");
+
+public:
+  typedef E value_type;
+
+private:
+  E v[R * C];
+
+public:
+  /// 零矩阵
+  constexpr Matrix() : v{} {
+  }
+
+  /// 按行主序给出全部 R * C 个元素
+  template <typename... Args>
+  constexpr explicit Matrix(E first, Args... rest) : v{first, E(rest)...} {
+    static_assert(sizeof...(Args) + 1 == R * C, "number of elements must equal rows * cols");
+  }
+
+  /// 从运行期矩阵拷贝, 形状在运行期检查
+  explicit Matrix(const Matrix<E> &other) : v{} {
+    assert(other.row_num() == R && other.col_num() == C && "Shape of matrices must be same.");
+    for (int i = 0; i < R; ++i)
+      for (int j = 0; j < C; ++j)
+        v[i * C + j] = other(i, j);
+  }
+
+  /// 转换为运行期矩阵
+  Matrix<E> to_dynamic() const {
+    Matrix<E> res(R, C);
+    for (int i = 0; i < R; ++i)
+      std::copy(v + i * C, v + (i + 1) * C, res.row_ptr(i));
+    return res;
+  }
+
+  static constexpr int row_num() {
+    return R;
+  }
+
+  static constexpr int col_num() {
+    return C;
+  }
+
+  constexpr E &operator()(int i, int j) {
+    return v[i * C + j];
+  }
+
+  constexpr const E &operator()(int i, int j) const {
+    return v[i * C + j];
+  }
+
+  /// 第 index 行
+  RowView<E> operator[](int index) {
+    assert(index >= 0 && index < R && "out of index");
+    return RowView<E>(v + index * C, C);
+  }
+
+  RowView<const E> operator[](int index) const {
+    assert(index >= 0 && index < R && "out of index");
+    return RowView<const E>(v + index * C, C);
+  }
+
+  E *data() {
+    return v;
+  }
+
+  const E *data() const {
+    return v;
+  }
+
+  static constexpr Matrix zero() {
+    return Matrix();
+  }
+
+  /// 单位矩阵
+  static constexpr Matrix identify() {
+    static_assert(R == C, "identity matrix must be square");
+    Matrix res;
+    for (int i = 0; i < R; ++i)
+      res.v[i * C + i] = E(1);
+    return res;
+  }
+
+  constexpr Matrix &operator+=(const Matrix &o) {
+    LA_UNROLL
+    for (int i = 0; i < R * C; ++i)
+      v[i] += o.v[i];
+    return *this;
+  }
+
+  constexpr Matrix &operator-=(const Matrix &o) {
+    LA_UNROLL
+    for (int i = 0; i < R * C; ++i)
+      v[i] -= o.v[i];
+    return *this;
+  }
+
+  constexpr Matrix &operator*=(E k) {
+    LA_UNROLL
+    for (int i = 0; i < R * C; ++i)
+      v[i] *= k;
+    return *this;
+  }
+
+  constexpr Matrix &operator/=(E k) {
+    LA_UNROLL
+    for (int i = 0; i < R * C; ++i)
+      v[i] /= k;
+    return *this;
+  }
+
+  /// mat * vector, 形状由类型保证
+  constexpr Vector<E, R> dot(const Vector<E, C> &x) const {
+    Vector<E, R> y;
+    LA_UNROLL
+    for (int i = 0; i < R; ++i) {
+      E s = 0;
+      LA_UNROLL
+      for (int j = 0; j < C; ++j)
+        s += v[i * C + j] * x[j];
+      y[i] = s;
+    }
+    return y;
+  }
+
+  /// mat * mat
+  template <int K>
+  constexpr Matrix<E, R, K> dot(const Matrix<E, C, K> &o) const {
+    Matrix<E, R, K> res;
+    LA_UNROLL
+    for (int i = 0; i < R; ++i) {
+      LA_UNROLL
+      for (int p = 0; p < C; ++p) {
+        E a = v[i * C + p];
+        LA_UNROLL
+        for (int j = 0; j < K; ++j)
+          res(i, j) += a * o(p, j);
+      }
+    }
+    return res;
+  }
+
+  /// T
+  constexpr Matrix<E, C, R> T() const {
+    Matrix<E, C, R> res;
+    LA_UNROLL
+    for (int i = 0; i < R; ++i)
+      LA_UNROLL
+      for (int j = 0; j < C; ++j)
+        res(j, i) = v[i * C + j];
+    return res;
+  }
+
+  /// 行列式, 只对方阵可用
+  constexpr E det() const {
+    static_assert(R == C, "determinant requires a square matrix");
+    return detail::FixedSquare<E, R>::det(*this);
+  }
+
+  /// 逆矩阵; 奇异时返回零矩阵, 并把 *invertible 置为 false.
+  /// 奇异按相对标准判定 (见 detail::fixed_accept), 整体缩放矩阵不改变结论
+  constexpr Matrix inverse(bool *invertible = nullptr) const {
+    static_assert(R == C, "inverse requires a square matrix");
+    return detail::FixedSquare<E, R>::inverse(*this, invertible);
+  }
+
+  friend constexpr Matrix operator+(Matrix a, const Matrix &b) {
+    return a += b;
+  }
+
+  friend constexpr Matrix operator-(Matrix a, const Matrix &b) {
+    return a -= b;
+  }
+
+  friend constexpr Matrix operator*(Matrix a, E k) {
+    return a *= k;
+  }
+
+  friend constexpr Matrix operator*(E k, Matrix a) {
+    return a *= k;
+  }
+
+  friend constexpr Matrix operator/(Matrix a, E k) {
+    return a /= k;
+  }
+
+  friend constexpr Matrix operator-(Matrix a) {
+    return a *= E(-1);
+  }
+
+  friend constexpr const Matrix &operator+(const Matrix &a) {
+    return a;
+  }
+
+  friend constexpr bool operator==(const Matrix &a, const Matrix &b) {
+    for (int i = 0; i < R * C; ++i)
+      if (a.v[i] != b.v[i])
+        return false;
+    return true;
+  }
+
+  friend constexpr bool operator!=(const Matrix &a, const Matrix &b) {
+    return !(a == b);
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const Matrix &mat) {
+    os << "Matrix(" << std::endl;
+    for (int i = 0; i < R; ++i) {
+      os << "[";
+      for (int j = 0; j < C - 1; ++j)
+        os << mat(i, j) << ",";
+      os << mat(i, C - 1) << "]" << std::endl;
+    }
+    os << ")" << std::endl;
+    return os;
+  }
+};
+
+namespace detail {
+
+template <typename E>
+constexpr E fixed_abs(E x) {
+  return x < E(0) ? -x : x;
+}
+
+template <typename E, int N>
+constexpr E fixed_max_abs(const Matrix<E, N, N> &a) {
+  E m = 0;
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j)
+      m = fixed_abs(a(i, j)) > m ? fixed_abs(a(i, j)) : m;
+  return m;
+}
+
+/// 所有维数共用的可逆判定: 条件数的估计 max|A| * max|A^-1| 不超过 1 / (N eps).
+/// 只与相对大小有关, 例如对角元为 1e-3 的 3x3 矩阵 (det 1e-9) 是可逆的.
+/// 结果为 inf/NaN 时同样判为奇异
+template <typename E, int N>
+constexpr bool fixed_accept(const Matrix<E, N, N> &a, const Matrix<E, N, N> &inv) {
+  E limit = E(1) / (E(N) * std::numeric_limits<E>::epsilon());
+  return fixed_max_abs(a) * fixed_max_abs(inv) <= limit;
+}
+
+/// 一般维数的方阵: 带部分选主元的 Gauss-Jordan, 在局部副本上完成
+template <typename E, int N>
+struct FixedSquare {
+  typedef Matrix<E, N, N> M;
+
+  static constexpr E det(M a) {
+    E d = 1;
+    for (int c = 0; c < N; ++c) {
+      int p = c;
+      for (int r = c + 1; r < N; ++r)
+        if (fixed_abs(a(r, c)) > fixed_abs(a(p, c)))
+          p = r;
+      if (a(p, c) == E(0))
+        return E(0);
+      if (p != c) {
+        for (int j = 0; j < N; ++j) {
+          E t = a(c, j);
+          a(c, j) = a(p, j);
+          a(p, j) = t;
+        }
+        d = -d;
+      }
+      d *= a(c, c);
+      for (int r = c + 1; r < N; ++r) {
+        E f = a(r, c) / a(c, c);
+        for (int j = c; j < N; ++j)
+          a(r, j) -= f * a(c, j);
+      }
+    }
+    return d;
+  }
+
+  static constexpr M inverse(M a, bool *invertible) {
+    const M orig = a;
+    M inv = M::identify();
+    for (int c = 0; c < N; ++c) {
+      int p = c;
+      for (int r = c + 1; r < N; ++r)
+        if (fixed_abs(a(r, c)) > fixed_abs(a(p, c)))
+          p = r;
+      if (a(p, c) == E(0)) {
+        if (invertible)
+          *invertible = false;
+        return M();
+      }
+      for (int j = 0; j < N; ++j) {
+        E t = a(c, j);
+        a(c, j) = a(p, j);
+        a(p, j) = t;
+        t = inv(c, j);
+        inv(c, j) = inv(p, j);
+        inv(p, j) = t;
+      }
+      E s = E(1) / a(c, c);
+      for (int j = 0; j < N; ++j) {
+        a(c, j) *= s;
+        inv(c, j) *= s;
+      }
+      for (int r = 0; r < N; ++r) {
+        if (r == c)
+          continue;
+        E f = a(r, c);
+        for (int j = 0; j < N; ++j) {
+          a(r, j) -= f * a(c, j);
+          inv(r, j) -= f * inv(c, j);
+        }
+      }
+    }
+    bool ok = fixed_accept(orig, inv);
+    if (invertible)
+      *invertible = ok;
+    return ok ? inv : M();
+  }
+};
+
+/// inverse = adj / det, 判定与 Gauss-Jordan 路径相同
+template <typename E, int N>
+constexpr Matrix<E, N, N> fixed_finish(const Matrix<E, N, N> &a, const Matrix<E, N, N> &adj, E d,
+                                       bool *invertible) {
+  Matrix<E, N, N> inv;
+  bool ok = d != E(0);
+  if (ok) {
+    inv = adj / d;
+    ok = fixed_accept(a, inv);
+  }
+  if (invertible)
+    *invertible = ok;
+  return ok ? inv : Matrix<E, N, N>();
+}
+
+/// 1x1 到 4x4 用伴随矩阵的闭式公式, 没有循环
+template <typename E>
+struct FixedSquare<E, 1> {
+  typedef Matrix<E, 1, 1> M;
+
+  static constexpr E det(const M &a) {
+    return a(0, 0);
+  }
+
+  static constexpr M inverse(const M &a, bool *invertible) {
+    return fixed_finish(a, M(E(1)), a(0, 0), invertible);
+  }
+};
+
+template <typename E>
+struct FixedSquare<E, 2> {
+  typedef Matrix<E, 2, 2> M;
+
+  static constexpr E det(const M &a) {
+    return a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0);
+  }
+
+  static constexpr M inverse(const M &a, bool *invertible) {
+    return fixed_finish(a, M(a(1, 1), -a(0, 1), -a(1, 0), a(0, 0)), det(a), invertible);
+  }
+};
+
+template <typename E>
+struct FixedSquare<E, 3> {
+  typedef Matrix<E, 3, 3> M;
+
+  static constexpr E det(const M &a) {
+    return a(0, 0) * (a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1)) -
+           a(0, 1) * (a(1, 0) * a(2, 2) - a(1, 2) * a(2, 0)) +
+           a(0, 2) * (a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0));
+  }
+
+  static constexpr M inverse(const M &a, bool *invertible) {
+    M adj(a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1), a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2),
+          a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1),
+          a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2), a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0),
+          a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2),
+          a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0), a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1),
+          a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0));
+    E d = a(0, 0) * adj(0, 0) + a(0, 1) * adj(1, 0) + a(0, 2) * adj(2, 0);
+    return fixed_finish(a, adj, d, invertible);
+  }
+};
+
+template <typename E>
+struct FixedSquare<E, 4> {
+  typedef Matrix<E, 4, 4> M;
+
+  /// 按前两行和后两行的 2x2 子式展开 (Laplace 展开)
+  static constexpr E det(const M &a) {
+    E s0 = a(0, 0) * a(1, 1) - a(1, 0) * a(0, 1);
+    E s1 = a(0, 0) * a(1, 2) - a(1, 0) * a(0, 2);
+    E s2 = a(0, 0) * a(1, 3) - a(1, 0) * a(0, 3);
+    E s3 = a(0, 1) * a(1, 2) - a(1, 1) * a(0, 2);
+    E s4 = a(0, 1) * a(1, 3) - a(1, 1) * a(0, 3);
+    E s5 = a(0, 2) * a(1, 3) - a(1, 2) * a(0, 3);
+    E c5 = a(2, 2) * a(3, 3) - a(3, 2) * a(2, 3);
+    E c4 = a(2, 1) * a(3, 3) - a(3, 1) * a(2, 3);
+    E c3 = a(2, 1) * a(3, 2) - a(3, 1) * a(2, 2);
+    E c2 = a(2, 0) * a(3, 3) - a(3, 0) * a(2, 3);
+    E c1 = a(2, 0) * a(3, 2) - a(3, 0) * a(2, 2);
+    E c0 = a(2, 0) * a(3, 1) - a(3, 0) * a(2, 1);
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+  }
+
+  static constexpr M inverse(const M &a, bool *invertible) {
+    E s0 = a(0, 0) * a(1, 1) - a(1, 0) * a(0, 1);
+    E s1 = a(0, 0) * a(1, 2) - a(1, 0) * a(0, 2);
+    E s2 = a(0, 0) * a(1, 3) - a(1, 0) * a(0, 3);
+    E s3 = a(0, 1) * a(1, 2) - a(1, 1) * a(0, 2);
+    E s4 = a(0, 1) * a(1, 3) - a(1, 1) * a(0, 3);
+    E s5 = a(0, 2) * a(1, 3) - a(1, 2) * a(0, 3);
+    E c5 = a(2, 2) * a(3, 3) - a(3, 2) * a(2, 3);
+    E c4 = a(2, 1) * a(3, 3) - a(3, 1) * a(2, 3);
+    E c3 = a(2, 1) * a(3, 2) - a(3, 1) * a(2, 2);
+    E c2 = a(2, 0) * a(3, 3) - a(3, 0) * a(2, 3);
+    E c1 = a(2, 0) * a(3, 2) - a(3, 0) * a(2, 2);
+    E c0 = a(2, 0) * a(3, 1) - a(3, 0) * a(2, 1);
+    E d = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+
+    M adj(a(1, 1) * c5 - a(1, 2) * c4 + a(1, 3) * c3,
+          -a(0, 1) * c5 + a(0, 2) * c4 - a(0, 3) * c3,
+          a(3, 1) * s5 - a(3, 2) * s4 + a(3, 3) * s3,
+          -a(2, 1) * s5 + a(2, 2) * s4 - a(2, 3) * s3,
+
+          -a(1, 0) * c5 + a(1, 2) * c2 - a(1, 3) * c1,
+          a(0, 0) * c5 - a(0, 2) * c2 + a(0, 3) * c1,
+          -a(3, 0) * s5 + a(3, 2) * s2 - a(3, 3) * s1,
+          a(2, 0) * s5 - a(2, 2) * s2 + a(2, 3) * s1,
+
+          a(1, 0) * c4 - a(1, 1) * c2 + a(1, 3) * c0,
+          -a(0, 0) * c4 + a(0, 1) * c2 - a(0, 3) * c0,
+          a(3, 0) * s4 - a(3, 1) * s2 + a(3, 3) * s0,
+          -a(2, 0) * s4 + a(2, 1) * s2 - a(2, 3) * s0,
+
+          -a(1, 0) * c3 + a(1, 1) * c1 - a(1, 2) * c0,
+          a(0, 0) * c3 - a(0, 1) * c1 + a(0, 2) * c0,
+          -a(3, 0) * s3 + a(3, 1) * s1 - a(3, 2) * s0,
+          a(2, 0) * s3 - a(2, 1) * s1 + a(2, 2) * s0);
+    return fixed_finish(a, adj, d, invertible);
+  }
+};
+}
+
+typedef Vector<float, 2> Vector2f;
+typedef Vector<float, 3> Vector3f;
+typedef Vector<float, 4> Vector4f;
+typedef Vector<double, 2> Vector2d;
+typedef Vector<double, 3> Vector3d;
+typedef Vector<double, 4> Vector4d;
+typedef Matrix<float, 2, 2> Matrix2f;
+typedef Matrix<float, 3, 3> Matrix3f;
+typedef Matrix<float, 4, 4> Matrix4f;
+typedef Matrix<double, 2, 2> Matrix2d;
+typedef Matrix<double, 3, 3> Matrix3d;
+typedef Matrix<double, 4, 4> Matrix4d;
+}
+
+#endif // LA_FIXEDSIZE_H
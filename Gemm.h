@@ -0,0 +1,406 @@
+/**********************************
+ * File:     Gemm.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/25
+ ***********************************/
+
+#ifndef LA_GEMM_H
+#define LA_GEMM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "Memory.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace LinearAlgebra {
+namespace blas {
+
+/// 分块参数: MR x NR 为寄存器块大小, MC x KC 的 A 块驻留 L2,
+/// KC x NR 的 B 条带驻留 L1, KC x NC 的 B 块驻留 L3
+template <typename E>
+struct GemmBlocking {
+  static constexpr int MR = 4;
+  static constexpr int NR = 4;
+  static constexpr int MC = 64;
+  static constexpr int KC = 256;
+  static constexpr int NC = 2048;
+};
+
+/// 寄存器块按目标指令集的向量寄存器个数和宽度选取:
+/// SSE2 有 16 个 128 位寄存器, AVX 有 16 个 256 位寄存器
+#if defined(__AVX__)
+template <>
+struct GemmBlocking<double> {
+  static constexpr int MR = 6;
+  static constexpr int NR = 8;
+  static constexpr int MC = 96;
+  static constexpr int KC = 256;
+  static constexpr int NC = 2048;
+};
+
+template <>
+struct GemmBlocking<float> {
+  static constexpr int MR = 6;
+  static constexpr int NR = 16;
+  static constexpr int MC = 144;
+  static constexpr int KC = 384;
+  static constexpr int NC = 3072;
+};
+#else
+template <>
+struct GemmBlocking<double> {
+  static constexpr int MR = 4;
+  static constexpr int NR = 4;
+  static constexpr int MC = 96;
+  static constexpr int KC = 256;
+  static constexpr int NC = 2048;
+};
+
+template <>
+struct GemmBlocking<float> {
+  static constexpr int MR = 4;
+  static constexpr int NR = 8;
+  static constexpr int MC = 128;
+  static constexpr int KC = 384;
+  static constexpr int NC = 3072;
+};
+#endif
+
+namespace detail {
+
+/// 将 A 的 mc x kc 子块按 MR 行一组打包: 每组内按列连续, 不足 MR 的行补 0
+template <typename E, int MR>
+void pack_a(int mc, int kc, const E *A, int rsa, int csa, E *buf) {
+  for (int i = 0; i < mc; i += MR) {
+    int ib = std::min(MR, mc - i);
+    for (int p = 0; p < kc; ++p) {
+      const E *a = A + (std::ptrdiff_t)i * rsa + (std::ptrdiff_t)p * csa;
+      for (int r = 0; r < ib; ++r)
+        buf[r] = a[(std::ptrdiff_t)r * rsa];
+      for (int r = ib; r < MR; ++r)
+        buf[r] = E(0);
+      buf += MR;
+    }
+  }
+}
+
+/// 将 B 的 kc x nc 子块按 NR 列一组打包: 每组内按行连续, 不足 NR 的列补 0
+template <typename E, int NR>
+void pack_b(int kc, int nc, const E *B, int rsb, int csb, E *buf) {
+  for (int j = 0; j < nc; j += NR) {
+    int jb = std::min(NR, nc - j);
+    for (int p = 0; p < kc; ++p) {
+      const E *b = B + (std::ptrdiff_t)p * rsb + (std::ptrdiff_t)j * csb;
+      for (int c = 0; c < jb; ++c)
+        buf[c] = b[(std::ptrdiff_t)c * csb];
+      for (int c = jb; c < NR; ++c)
+        buf[c] = E(0);
+      buf += NR;
+    }
+  }
+}
+
+/// 寄存器块微内核: C[mr x nr] = alpha * Apanel * Bpanel + beta * C
+/// 累加器是定长局部数组, 编译器会把它完全放进向量寄存器
+template <typename E, int MR, int NR>
+void micro_kernel(int kc, const E *a, const E *b, E alpha, E beta,
+                  E *C, int rsc, int csc, int mr, int nr) {
+
+  E acc[MR][NR] = {};
+
+  for (int p = 0; p < kc; ++p) {
+    for (int i = 0; i < MR; ++i) {
+      E ai = a[i];
+      for (int j = 0; j < NR; ++j)
+        acc[i][j] += ai * b[j];
+    }
+    a += MR;
+    b += NR;
+  }
+
+  for (int i = 0; i < mr; ++i) {
+    E *c = C + (std::ptrdiff_t)i * rsc;
+    if (beta == E(0)) {
+      for (int j = 0; j < nr; ++j)
+        c[(std::ptrdiff_t)j * csc] = alpha * acc[i][j];
+    } else {
+      for (int j = 0; j < nr; ++j)
+        c[(std::ptrdiff_t)j * csc] = alpha * acc[i][j] + beta * c[(std::ptrdiff_t)j * csc];
+    }
+  }
+}
+
+/// 对一个已打包的 mc x kc A 块和 kc x nc B 块完成宏内核计算
+template <typename E>
+void macro_kernel(int mc, int nc, int kc, E alpha, const E *pa, const E *pb,
+                  E beta, E *C, int rsc, int csc) {
+  typedef GemmBlocking<E> Blk;
+  for (int j = 0; j < nc; j += Blk::NR) {
+    int nr = std::min((int)Blk::NR, nc - j);
+    const E *b = pb + (std::size_t)j * kc;
+    for (int i = 0; i < mc; i += Blk::MR) {
+      int mr = std::min((int)Blk::MR, mc - i);
+      micro_kernel<E, Blk::MR, Blk::NR>(kc, pa + (std::size_t)i * kc, b, alpha, beta,
+                                        C + (std::ptrdiff_t)i * rsc + (std::ptrdiff_t)j * csc,
+                                        rsc, csc, mr, nr);
+    }
+  }
+}
+
+/// C = beta * C, beta 为 0 时不读取 C
+template <typename E>
+void scale_c(int m, int n, E beta, E *C, int rsc, int csc) {
+  for (int i = 0; i < m; ++i)
+    for (int j = 0; j < n; ++j) {
+      E &c = C[(std::ptrdiff_t)i * rsc + (std::ptrdiff_t)j * csc];
+      c = beta == E(0) ? E(0) : beta * c;
+    }
+}
+
+/// 小规模问题打包不划算, 直接三重循环
+template <typename E>
+void gemm_small(int m, int n, int k, E alpha, const E *A, int rsa, int csa,
+                const E *B, int rsb, int csb, E beta, E *C, int rsc, int csc) {
+  scale_c(m, n, beta, C, rsc, csc);
+  for (int i = 0; i < m; ++i) {
+    E *c = C + (std::ptrdiff_t)i * rsc;
+    for (int p = 0; p < k; ++p) {
+      E aip = alpha * A[(std::ptrdiff_t)i * rsa + (std::ptrdiff_t)p * csa];
+      const E *b = B + (std::ptrdiff_t)p * rsb;
+      for (int j = 0; j < n; ++j)
+        c[(std::ptrdiff_t)j * csc] += aip * b[(std::ptrdiff_t)j * csb];
+    }
+  }
+}
+}
+
+/// 通用步长的 GEMM: C = alpha * A * B + beta * C
+/// A 为 m x k, 元素 (i, p) 位于 A[i * rsa + p * csa]; B, C 同理
+template <typename E>
+void gemm(int m, int n, int k, E alpha, const E *A, int rsa, int csa,
+          const E *B, int rsb, int csb, E beta, E *C, int rsc, int csc) {
+
+  typedef GemmBlocking<E> Blk;
+
+  if (m <= 0 || n <= 0)
+    return;
+
+  if (k <= 0 || alpha == E(0)) {
+    detail::scale_c(m, n, beta, C, rsc, csc);
+    return;
+  }
+
+  if ((long long)m * n * k <= 32 * 32 * 32) {
+    detail::gemm_small(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, rsc, csc);
+    return;
+  }
+
+  int kcMax = std::min((int)Blk::KC, k);
+  int ncMax = std::min((int)Blk::NC, n);
+  int mcMax = std::min((int)Blk::MC, m);
+  int ncPad = (ncMax + Blk::NR - 1) / Blk::NR * Blk::NR;
+  int mcPad = (mcMax + Blk::MR - 1) / Blk::MR * Blk::MR;
+
+  E *pb = LinearAlgebra::detail::allocate<E>((std::size_t)ncPad * kcMax);
+
+  /// 工作单元是 (MC 行块, NR 条带组) 的二维网格. 行块数不足以喂饱所有线程时,
+  /// 再把每个行块的列方向切开; 各单元共享打包好的 B, 各自打包 A
+  int mBlocks = (m + Blk::MC - 1) / Blk::MC;
+  int threads = (long long)m * n * k >= Parallel::threshold() ? Parallel::num_threads() : 1;
+  int nSplit = std::max(1, (2 * threads + mBlocks - 1) / mBlocks);
+
+  for (int jc = 0; jc < n; jc += Blk::NC) {
+    int nc = std::min((int)Blk::NC, n - jc);
+    int panels = (nc + Blk::NR - 1) / Blk::NR;
+    int parts = std::min(nSplit, panels);
+
+    for (int pc = 0; pc < k; pc += Blk::KC) {
+      int kc = std::min((int)Blk::KC, k - pc);
+      /// 只有第一个 k 块需要乘 beta, 之后都是累加
+      E betaBlk = pc == 0 ? beta : E(1);
+
+      detail::pack_b<E, Blk::NR>(kc, nc, B + (std::ptrdiff_t)pc * rsb + (std::ptrdiff_t)jc * csb,
+                                 rsb, csb, pb);
+
+      auto work = [&](int lo, int hi) {
+        E *pa = LinearAlgebra::detail::allocate<E>((std::size_t)mcPad * kcMax);
+        int packed = -1;
+        for (int u = lo; u < hi; ++u) {
+          int ib = u / parts, part = u % parts;
+          int ic = ib * Blk::MC;
+          int mc = std::min((int)Blk::MC, m - ic);
+          if (packed != ib) {
+            detail::pack_a<E, Blk::MR>(mc, kc, A + (std::ptrdiff_t)ic * rsa + (std::ptrdiff_t)pc * csa,
+                                       rsa, csa, pa);
+            packed = ib;
+          }
+          int p0 = panels * part / parts, p1 = panels * (part + 1) / parts;
+          int j0 = p0 * Blk::NR, j1 = std::min(nc, p1 * Blk::NR);
+          detail::macro_kernel(mc, j1 - j0, kc, alpha, pa, pb + (std::size_t)j0 * kc, betaBlk,
+                               C + (std::ptrdiff_t)ic * rsc + (std::ptrdiff_t)(jc + j0) * csc,
+                               rsc, csc);
+        }
+        LinearAlgebra::detail::deallocate(pa);
+      };
+
+      int units = mBlocks * parts;
+      if (threads > 1 && units > 1)
+        ThreadPool::instance().parallel_for(0, units, 1, work);
+      else
+        work(0, units);
+    }
+  }
+
+  LinearAlgebra::detail::deallocate(pb);
+}
+
+/// 行主序 GEMM: C = alpha * A * B + beta * C, lda/ldb/ldc 为各矩阵的行跨度
+template <typename E>
+void gemm(int m, int n, int k, E alpha, const E *A, int lda, const E *B, int ldb,
+          E beta, E *C, int ldc) {
+  gemm(m, n, k, alpha, A, lda, 1, B, ldb, 1, beta, C, ldc, 1);
+}
+
+/// 是否对行主序存放的操作数取转置
+enum class Transpose { No, Yes };
+
+/// C = alpha * op(A) * op(B) + beta * C, op(A) 为 m x k, op(B) 为 k x n.
+/// A, B 按存放的形状给出行跨度; 取转置只是交换步长, 不搬移数据
+template <typename E>
+void gemm(Transpose ta, Transpose tb, int m, int n, int k, E alpha, const E *A, int lda,
+          const E *B, int ldb, E beta, E *C, int ldc) {
+  bool at = ta == Transpose::Yes, bt = tb == Transpose::Yes;
+  gemm(m, n, k, alpha, A, at ? 1 : lda, at ? lda : 1, B, bt ? 1 : ldb, bt ? ldb : 1,
+       beta, C, ldc, 1);
+}
+
+/// y = alpha * op(A) * x + beta * y, A 为行主序 m x n (行跨度 lda), incx / incy 为步长.
+/// 不转置时每行一次点积; 转置时按行做 axpy, 把列分段交给各线程, A 始终按行顺序读
+template <typename E>
+void gemv(Transpose ta, int m, int n, E alpha, const E *A, int lda, const E *x, int incx,
+          E beta, E *y, int incy) {
+  bool trans = ta == Transpose::Yes;
+  int xn = trans ? m : n, yn = trans ? n : m;
+  if (yn <= 0)
+    return;
+
+  /// 非单位步长时先拷到连续缓冲区, SIMD 内核只处理连续数据
+  std::vector<E> xbuf, ybuf;
+  const E *xc = x;
+  if (incx != 1) {
+    xbuf.resize(xn);
+    for (int i = 0; i < xn; ++i)
+      xbuf[i] = x[(std::ptrdiff_t)i * incx];
+    xc = xbuf.data();
+  }
+  E *yc = y;
+  if (incy != 1) {
+    ybuf.resize(yn);
+    for (int i = 0; i < yn; ++i)
+      ybuf[i] = y[(std::ptrdiff_t)i * incy];
+    yc = ybuf.data();
+  }
+
+  if (!trans) {
+    Parallel::for_range(0, m, std::max(1, 4096 / std::max(1, n)), (long long)m * n,
+                        [&](int lo, int hi) {
+      for (int i = lo; i < hi; ++i) {
+        E d = n > 0 ? simd::dot(A + (std::size_t)i * lda, xc, n) : E(0);
+        yc[i] = alpha * d + (beta == E(0) ? E(0) : beta * yc[i]);
+      }
+    });
+  } else {
+    if (beta == E(0))
+      std::fill(yc, yc + n, E(0));
+    else if (beta != E(1))
+      simd::scale(n, beta, yc, yc);
+    Parallel::for_range(0, n, 256, (long long)m * n, [&](int lo, int hi) {
+      for (int i = 0; i < m; ++i)
+        simd::axpy(hi - lo, E(alpha * xc[i]), A + (std::size_t)i * lda + lo, yc + lo);
+    });
+  }
+
+  if (incy != 1)
+    for (int i = 0; i < yn; ++i)
+      y[(std::ptrdiff_t)i * incy] = yc[i];
+}
+
+namespace detail {
+
+/// 转置的分块边长: 源块和目标块合计约 32KB, 放得进 L1
+template <typename E>
+struct TransposeBlock {
+  static constexpr int NB = sizeof(E) == 4 ? 64 : 32;
+};
+
+/// cache-oblivious 递归: 总是对半切较长的一边 (切点对齐到 8),
+/// 直到块放得进 L1, 再交给寄存器内转置的微内核
+template <typename E>
+void transpose_rec(int m, int n, const E *A, int lda, E *B, int ldb) {
+  const int NB = TransposeBlock<E>::NB;
+  if (m <= NB && n <= NB) {
+    simd::transpose(m, n, A, lda, B, ldb);
+    return;
+  }
+  if (m >= n) {
+    int h = (m / 2 + 7) / 8 * 8;
+    transpose_rec(h, n, A, lda, B, ldb);
+    transpose_rec(m - h, n, A + (std::size_t)h * lda, lda, B + h, ldb);
+  } else {
+    int h = (n / 2 + 7) / 8 * 8;
+    transpose_rec(m, h, A, lda, B, ldb);
+    transpose_rec(m, n - h, A + h, lda, B + (std::size_t)h * ldb, ldb);
+  }
+}
+}
+
+/// B = A^T, A 为 m x n (行跨度 lda), B 为 n x m (行跨度 ldb), 两者不能重叠.
+/// 大矩阵按 A 的行条带分给线程, 每个条带内部递归分块
+template <typename E>
+void transpose(int m, int n, const E *A, int lda, E *B, int ldb) {
+  if (m <= 0 || n <= 0)
+    return;
+  Parallel::for_range(0, (m + 7) / 8, 8, (long long)m * n, [&](int lo, int hi) {
+    int i0 = lo * 8, i1 = std::min(m, hi * 8);
+    detail::transpose_rec(i1 - i0, n, A + (std::size_t)i0 * lda, lda, B + i0, ldb);
+  });
+}
+
+/// 方阵原地转置: 对角块经缓冲区转置回原处, 对称位置的一对块互换并各自转置.
+/// 按块行分给线程, 每对块只由一个线程处理
+template <typename E>
+void transpose_in_place(int n, E *A, int lda) {
+  const int NB = detail::TransposeBlock<E>::NB;
+  int nb = (n + NB - 1) / NB;
+  Parallel::for_range(0, nb, 1, (long long)n * n / 2, [&](int lo, int hi) {
+    E *tmp = LinearAlgebra::detail::allocate<E>((std::size_t)NB * NB);
+    for (int bi = lo; bi < hi; ++bi) {
+      int i0 = bi * NB, bm = std::min(NB, n - i0);
+      E *d = A + (std::size_t)i0 * lda + i0;
+      for (int r = 0; r < bm; ++r)
+        std::copy(d + (std::size_t)r * lda, d + (std::size_t)r * lda + bm, tmp + (std::size_t)r * NB);
+      simd::transpose(bm, bm, tmp, NB, d, lda);
+
+      for (int bj = bi + 1; bj < nb; ++bj) {
+        int j0 = bj * NB, bn = std::min(NB, n - j0);
+        E *x = A + (std::size_t)i0 * lda + j0;
+        E *y = A + (std::size_t)j0 * lda + i0;
+        for (int r = 0; r < bm; ++r)
+          std::copy(x + (std::size_t)r * lda, x + (std::size_t)r * lda + bn, tmp + (std::size_t)r * NB);
+        simd::transpose(bn, bm, y, lda, x, lda);
+        simd::transpose(bm, bn, tmp, NB, y, lda);
+      }
+    }
+    LinearAlgebra::detail::deallocate(tmp);
+  });
+}
+}
+}
+
+#endif // LA_GEMM_H
@@ -0,0 +1,310 @@
+/**********************************
+ * File:     Instrument.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/5
+ ***********************************/
+
+#ifndef LA_INSTRUMENT_H
+#define LA_INSTRUMENT_H
+
+/// 热路径计数: 每个线程统计分配次数与字节数, 拷贝字节数, 以及每个操作的
+/// 调用次数, flops, 访存字节数和累计耗时 (含嵌套调用).
+///
+/// 定义 LA_INSTRUMENT 时启用 (CMake 选项 LA_INSTRUMENT). 未定义时下面的宏
+/// 展开为空语句, 参数不会被求值, 没有任何开销.
+
+#define LA_CONCAT_IMPL(a, b) a##b
+#define LA_CONCAT(a, b) LA_CONCAT_IMPL(a, b)
+
+#if defined(LA_INSTRUMENT)
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace LinearAlgebra {
+namespace instrument {
+
+/// 最多能登记的操作种类, 超出时 op_id 抛出 std::length_error
+constexpr int kMaxOps = 128;
+
+/// 某个操作的统计. 最慢一次调用的形状用于定位延迟尖刺
+struct OpStats {
+  std::string name;
+  std::uint64_t calls = 0;
+  std::uint64_t flops = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t nanos = 0;
+  std::uint64_t maxNanos = 0;
+  long long maxShape[3] = {0, 0, 0};
+};
+
+/// 一个线程 (或所有线程合计) 的计数快照
+struct Counters {
+  /// 线程登记的顺序号, 合计时为 -1
+  int thread = -1;
+  std::uint64_t allocations = 0;
+  std::uint64_t allocatedBytes = 0;
+  std::uint64_t copiedBytes = 0;
+  /// 只包含调用过的操作
+  std::vector<OpStats> ops;
+};
+
+struct Snapshot {
+  Counters total;
+  std::vector<Counters> threads;
+};
+
+namespace detail {
+
+typedef std::atomic<std::uint64_t> Counter;
+
+/// 只有所属线程写入 (relaxed), 其他线程读快照时不加锁;
+/// 同一操作的各字段之间可能不是同一时刻的值
+struct OpSlot {
+  Counter calls{0}, flops{0}, bytes{0}, nanos{0}, maxNanos{0};
+  std::atomic<long long> shape[3];
+
+  OpSlot() {
+    for (auto &s : shape)
+      s.store(0, std::memory_order_relaxed);
+  }
+};
+
+struct ThreadBlock {
+  int index;
+  Counter allocations{0}, allocatedBytes{0}, copiedBytes{0};
+  OpSlot ops[kMaxOps];
+
+  explicit ThreadBlock(int index) : index(index) {
+  }
+};
+
+inline void bump(Counter &c, std::uint64_t v) {
+  c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+/// 所有线程的计数块以及操作名表. 线程退出后它的计数仍然保留
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadBlock>> blocks;
+  const char *names[kMaxOps];
+  std::atomic<int> opCount{0};
+
+  static Registry &instance() {
+    static Registry r;
+    return r;
+  }
+};
+
+inline ThreadBlock &local() {
+  thread_local std::shared_ptr<ThreadBlock> block = []() {
+    Registry &r = Registry::instance();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.blocks.push_back(std::make_shared<ThreadBlock>((int)r.blocks.size()));
+    return r.blocks.back();
+  }();
+  return *block;
+}
+
+/// 按名字登记操作, 同名返回同一编号. 每个调用点只在第一次执行时调用.
+/// 表满时抛出异常, 而不是让新操作与已有操作共用一个槽位
+inline int op_id(const char *name) {
+  Registry &r = Registry::instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  int n = r.opCount.load();
+  for (int i = 0; i < n; ++i)
+    if (std::strcmp(r.names[i], name) == 0)
+      return i;
+  if (n == kMaxOps)
+    throw std::length_error(std::string("instrument: more than ") + std::to_string(kMaxOps) +
+                            " operations, cannot register " + name);
+  r.names[n] = name;
+  r.opCount.store(n + 1);
+  return n;
+}
+
+/// 作用域计时, 析构时记一次调用
+class OpScope {
+private:
+  int id;
+  long long m, n, k;
+  std::uint64_t flops, bytes;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  OpScope(int id, long long m, long long n, long long k, double flops, double bytes)
+      : id(id), m(m), n(n), k(k), flops((std::uint64_t)flops), bytes((std::uint64_t)bytes),
+        start(std::chrono::steady_clock::now()) {
+  }
+
+  ~OpScope() {
+    std::uint64_t ns = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    OpSlot &s = local().ops[id];
+    bump(s.calls, 1);
+    bump(s.flops, flops);
+    bump(s.bytes, bytes);
+    bump(s.nanos, ns);
+    if (ns > s.maxNanos.load(std::memory_order_relaxed)) {
+      s.maxNanos.store(ns, std::memory_order_relaxed);
+      s.shape[0].store(m, std::memory_order_relaxed);
+      s.shape[1].store(n, std::memory_order_relaxed);
+      s.shape[2].store(k, std::memory_order_relaxed);
+    }
+  }
+
+  OpScope(const OpScope &) = delete;
+  OpScope &operator=(const OpScope &) = delete;
+};
+
+inline void add_op(Counters &c, const OpStats &op) {
+  for (OpStats &o : c.ops) {
+    if (o.name == op.name) {
+      o.calls += op.calls;
+      o.flops += op.flops;
+      o.bytes += op.bytes;
+      o.nanos += op.nanos;
+      if (op.maxNanos > o.maxNanos) {
+        o.maxNanos = op.maxNanos;
+        std::copy(op.maxShape, op.maxShape + 3, o.maxShape);
+      }
+      return;
+    }
+  }
+  c.ops.push_back(op);
+}
+}
+
+/// 所有线程的计数, 以及它们的合计
+inline Snapshot snapshot() {
+  detail::Registry &r = detail::Registry::instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  int nops = r.opCount.load();
+
+  Snapshot snap;
+  for (auto &b : r.blocks) {
+    Counters c;
+    c.thread = b->index;
+    c.allocations = b->allocations.load(std::memory_order_relaxed);
+    c.allocatedBytes = b->allocatedBytes.load(std::memory_order_relaxed);
+    c.copiedBytes = b->copiedBytes.load(std::memory_order_relaxed);
+    for (int i = 0; i < nops; ++i) {
+      const detail::OpSlot &s = b->ops[i];
+      OpStats op;
+      op.calls = s.calls.load(std::memory_order_relaxed);
+      if (op.calls == 0)
+        continue;
+      op.name = r.names[i];
+      op.flops = s.flops.load(std::memory_order_relaxed);
+      op.bytes = s.bytes.load(std::memory_order_relaxed);
+      op.nanos = s.nanos.load(std::memory_order_relaxed);
+      op.maxNanos = s.maxNanos.load(std::memory_order_relaxed);
+      for (int d = 0; d < 3; ++d)
+        op.maxShape[d] = s.shape[d].load(std::memory_order_relaxed);
+      c.ops.push_back(op);
+    }
+
+    snap.total.allocations += c.allocations;
+    snap.total.allocatedBytes += c.allocatedBytes;
+    snap.total.copiedBytes += c.copiedBytes;
+    for (const OpStats &op : c.ops)
+      detail::add_op(snap.total, op);
+    snap.threads.push_back(std::move(c));
+  }
+  return snap;
+}
+
+/// 清零所有线程的计数. 与其他线程上正在进行的计数并发时, 那部分可能丢失
+inline void reset() {
+  detail::Registry &r = detail::Registry::instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (auto &b : r.blocks) {
+    b->allocations.store(0, std::memory_order_relaxed);
+    b->allocatedBytes.store(0, std::memory_order_relaxed);
+    b->copiedBytes.store(0, std::memory_order_relaxed);
+    for (detail::OpSlot &s : b->ops) {
+      s.calls.store(0, std::memory_order_relaxed);
+      s.flops.store(0, std::memory_order_relaxed);
+      s.bytes.store(0, std::memory_order_relaxed);
+      s.nanos.store(0, std::memory_order_relaxed);
+      s.maxNanos.store(0, std::memory_order_relaxed);
+      for (auto &d : s.shape)
+        d.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+inline void write_json(std::ostream &os, const Counters &c, const char *indent) {
+  os << indent << "{\"thread\": " << c.thread << ", \"allocations\": " << c.allocations
+     << ", \"allocated_bytes\": " << c.allocatedBytes << ", \"copied_bytes\": " << c.copiedBytes
+     << ", \"ops\": [";
+  for (std::size_t i = 0; i < c.ops.size(); ++i) {
+    const OpStats &o = c.ops[i];
+    os << (i ? ", " : "") << "\n" << indent << "  {\"name\": \"" << o.name << "\", \"calls\": "
+       << o.calls << ", \"flops\": " << o.flops << ", \"bytes\": " << o.bytes
+       << ", \"nanos\": " << o.nanos << ", \"max_nanos\": " << o.maxNanos
+       << ", \"max_shape\": [" << o.maxShape[0] << ", " << o.maxShape[1] << ", "
+       << o.maxShape[2] << "]}";
+  }
+  os << "]}";
+}
+
+/// 快照的 JSON 表示: {"total": {...}, "threads": [{...}, ...]}
+inline void write_json(std::ostream &os, const Snapshot &snap) {
+  os << "{\n  \"total\":\n";
+  write_json(os, snap.total, "    ");
+  os << ",\n  \"threads\": [\n";
+  for (std::size_t i = 0; i < snap.threads.size(); ++i) {
+    write_json(os, snap.threads[i], "    ");
+    os << (i + 1 < snap.threads.size() ? ",\n" : "\n");
+  }
+  os << "  ]\n}\n";
+}
+
+inline std::string to_json(const Snapshot &snap) {
+  std::ostringstream os;
+  write_json(os, snap);
+  return os.str();
+}
+}
+}
+
+/// 统计所在作用域为一次操作 name; m, n, k 为形状, flops 与 bytes 为本次的运算量和访存量
+#define LA_OP_SCOPE(name, m, n, k, flops, bytes)                                              \
+  static const int LA_CONCAT(la_op_id_, __LINE__) =                                          \
+      ::LinearAlgebra::instrument::detail::op_id(name);                                      \
+  ::LinearAlgebra::instrument::detail::OpScope LA_CONCAT(la_op_scope_, __LINE__)(             \
+      LA_CONCAT(la_op_id_, __LINE__), (m), (n), (k), (double)(flops), (double)(bytes))
+
+#define LA_COUNT_ALLOC(bytes)                                                                 \
+  do {                                                                                        \
+    auto &la_block_ = ::LinearAlgebra::instrument::detail::local();                           \
+    ::LinearAlgebra::instrument::detail::bump(la_block_.allocations, 1);                      \
+    ::LinearAlgebra::instrument::detail::bump(la_block_.allocatedBytes, (bytes));             \
+  } while (0)
+
+#define LA_COUNT_COPY(bytes)                                                                  \
+  ::LinearAlgebra::instrument::detail::bump(::LinearAlgebra::instrument::detail::local().copiedBytes, (bytes))
+
+#else
+
+#define LA_OP_SCOPE(name, m, n, k, flops, bytes) ((void)0)
+#define LA_COUNT_ALLOC(bytes) ((void)0)
+#define LA_COUNT_COPY(bytes) ((void)0)
+
+#endif
+
+#endif // LA_INSTRUMENT_H
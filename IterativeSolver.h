@@ -0,0 +1,593 @@
+/**********************************
+ * File:     IterativeSolver.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/31
+ ***********************************/
+
+#ifndef LA_ITERATIVESOLVER_H
+#define LA_ITERATIVESOLVER_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "SparseMatrix.h"
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+/// 线性算子 y = A * x 的抽象, 迭代法只需要它
+template <typename E>
+class LinearOperator {
+public:
+  virtual ~LinearOperator() {
+  }
+
+  virtual int row_num() const = 0;
+  virtual int col_num() const = 0;
+
+  /// y = A * x, x 长度为 col_num(), y 长度为 row_num()
+  virtual void apply(const E *x, E *y) const = 0;
+};
+
+/// 稠密矩阵算子, 只保存引用
+template <typename E>
+class DenseOperator : public LinearOperator<E> {
+private:
+  const Matrix<E> &A;
+
+public:
+  explicit DenseOperator(const Matrix<E> &A) : A(A) {
+  }
+
+  int row_num() const override {
+    return A.row_num();
+  }
+
+  int col_num() const override {
+    return A.col_num();
+  }
+
+  void apply(const E *x, E *y) const override {
+    int col = A.col_num();
+    Parallel::for_range(0, A.row_num(), std::max(1, 4096 / std::max(col, 1)),
+                        (long long)A.row_num() * col, [&](int lo, int hi) {
+      for (int i = lo; i < hi; ++i)
+        y[i] = simd::dot(A.row_ptr(i), x, col);
+    });
+  }
+};
+
+/// 稀疏矩阵算子, 只保存引用
+template <typename E>
+class SparseOperator : public LinearOperator<E> {
+private:
+  const SparseMatrix<E> &A;
+
+public:
+  explicit SparseOperator(const SparseMatrix<E> &A) : A(A) {
+  }
+
+  int row_num() const override {
+    return A.row_num();
+  }
+
+  int col_num() const override {
+    return A.col_num();
+  }
+
+  void apply(const E *x, E *y) const override {
+    A.dot(x, y);
+  }
+};
+
+/// 无矩阵算子: 由回调 fn(x, y) 计算 y = A * x
+template <typename E>
+class FunctionOperator : public LinearOperator<E> {
+public:
+  typedef std::function<void(const E *, E *)> Fn;
+
+private:
+  int row, col;
+  Fn fn;
+
+public:
+  FunctionOperator(int r, int c, Fn fn) : row(r), col(c), fn(std::move(fn)) {
+  }
+
+  int row_num() const override {
+    return row;
+  }
+
+  int col_num() const override {
+    return col;
+  }
+
+  void apply(const E *x, E *y) const override {
+    fn(x, y);
+  }
+};
+
+/// 预条件子 z = M^-1 * r
+template <typename E>
+class Preconditioner {
+public:
+  virtual ~Preconditioner() {
+  }
+
+  virtual void apply(const E *r, E *z) const = 0;
+};
+
+/// Jacobi 预条件: M = diag(A)
+template <typename E>
+class JacobiPreconditioner : public Preconditioner<E> {
+private:
+  std::vector<E> inv;
+
+  void init(const Vector<E> &d) {
+    inv.resize(d.size());
+    for (int i = 0; i < d.size(); ++i) {
+      assert(d[i] != E(0) && "zero on the diagonal");
+      inv[i] = E(1) / d[i];
+    }
+  }
+
+public:
+  explicit JacobiPreconditioner(const Matrix<E> &A) {
+    int n = std::min(A.row_num(), A.col_num());
+    Vector<E> d = Vector<E>::zero(n);
+    for (int i = 0; i < n; ++i)
+      d[i] = A(i, i);
+    init(d);
+  }
+
+  explicit JacobiPreconditioner(const SparseMatrix<E> &A) {
+    init(A.diagonal());
+  }
+
+  void apply(const E *r, E *z) const override {
+    for (int i = 0; i < (int)inv.size(); ++i)
+      z[i] = inv[i] * r[i];
+  }
+};
+
+/// SSOR 预条件: M = (D + wL) D^-1 (D + wU) / (w (2 - w)), 0 < w < 2
+template <typename E>
+class SSORPreconditioner : public Preconditioner<E> {
+private:
+  SparseMatrix<E> A;
+  std::vector<E> diag;
+  E omega;
+
+public:
+  explicit SSORPreconditioner(const SparseMatrix<E> &M, E omega = 1)
+      : A(M.to_csr()), diag(M.row_num()), omega(omega) {
+    assert(A.row_num() == A.col_num());
+    assert(omega > 0 && omega < 2);
+    for (int i = 0; i < A.row_num(); ++i) {
+      diag[i] = A(i, i);
+      assert(diag[i] != E(0) && "zero on the diagonal");
+    }
+  }
+
+  explicit SSORPreconditioner(const Matrix<E> &M, E omega = 1)
+      : SSORPreconditioner(SparseMatrix<E>(M), omega) {
+  }
+
+  void apply(const E *r, E *z) const override {
+    int n = A.row_num();
+    const std::vector<long long> &ptr = A.outer_ptr();
+    const std::vector<int> &idx = A.inner_idx();
+    const std::vector<E> &val = A.values();
+
+    /// (D + wL) y = r, 再乘 D
+    for (int i = 0; i < n; ++i) {
+      E s = r[i];
+      for (long long k = ptr[i]; k < ptr[i + 1] && idx[k] < i; ++k)
+        s -= omega * val[k] * z[idx[k]];
+      z[i] = s / diag[i];
+    }
+    for (int i = 0; i < n; ++i)
+      z[i] *= diag[i];
+
+    /// (D + wU) z = y
+    for (int i = n - 1; i >= 0; --i) {
+      E s = z[i];
+      for (long long k = ptr[i + 1] - 1; k >= ptr[i] && idx[k] > i; --k)
+        s -= omega * val[k] * z[idx[k]];
+      z[i] = s / diag[i];
+    }
+
+    E c = omega * (2 - omega);
+    for (int i = 0; i < n; ++i)
+      z[i] *= c;
+  }
+};
+
+/// ILU(0) 预条件: 在 A 的非零结构上做不完全 LU, 不产生填充
+template <typename E>
+class ILU0Preconditioner : public Preconditioner<E> {
+private:
+  SparseMatrix<E> LU;
+  std::vector<long long> diagPos;
+
+public:
+  explicit ILU0Preconditioner(const SparseMatrix<E> &A) : LU(A.to_csr()), diagPos(A.row_num()) {
+    assert(LU.row_num() == LU.col_num());
+    int n = LU.row_num();
+    const std::vector<long long> &ptr = LU.outer_ptr();
+    const std::vector<int> &idx = LU.inner_idx();
+    std::vector<E> &val = LU.values();
+
+    for (int i = 0; i < n; ++i) {
+      auto first = idx.begin() + ptr[i], last = idx.begin() + ptr[i + 1];
+      auto it = std::lower_bound(first, last, i);
+      assert(it != last && *it == i && "ILU(0) requires a structurally nonzero diagonal");
+      diagPos[i] = it - idx.begin();
+    }
+
+    /// IKJ 形式, pos 记录当前行每一列在 val 里的位置
+    std::vector<long long> pos(n, -1);
+    for (int i = 1; i < n; ++i) {
+      for (long long k = ptr[i]; k < ptr[i + 1]; ++k)
+        pos[idx[k]] = k;
+      for (long long k = ptr[i]; k < diagPos[i]; ++k) {
+        int c = idx[k];
+        E piv = val[diagPos[c]];
+        assert(piv != E(0) && "zero pivot in ILU(0)");
+        val[k] /= piv;
+        for (long long q = diagPos[c] + 1; q < ptr[c + 1]; ++q)
+          if (pos[idx[q]] >= 0)
+            val[pos[idx[q]]] -= val[k] * val[q];
+      }
+      for (long long k = ptr[i]; k < ptr[i + 1]; ++k)
+        pos[idx[k]] = -1;
+    }
+  }
+
+  explicit ILU0Preconditioner(const Matrix<E> &A) : ILU0Preconditioner(SparseMatrix<E>(A)) {
+  }
+
+  void apply(const E *r, E *z) const override {
+    int n = LU.row_num();
+    const std::vector<long long> &ptr = LU.outer_ptr();
+    const std::vector<int> &idx = LU.inner_idx();
+    const std::vector<E> &val = LU.values();
+
+    for (int i = 0; i < n; ++i) {
+      E s = r[i];
+      for (long long k = ptr[i]; k < diagPos[i]; ++k)
+        s -= val[k] * z[idx[k]];
+      z[i] = s;
+    }
+    for (int i = n - 1; i >= 0; --i) {
+      E s = z[i];
+      for (long long k = diagPos[i] + 1; k < ptr[i + 1]; ++k)
+        s -= val[k] * z[idx[k]];
+      z[i] = s / val[diagPos[i]];
+    }
+  }
+};
+
+/// 迭代参数: 最大迭代次数, 相对残差 ||b - Ax|| / ||b|| 的收敛阈值, GMRES 重启长度
+struct SolverOptions {
+  int maxIterations = 1000;
+  double tolerance = 1e-10;
+  int restart = 30;
+};
+
+/// 求解结果
+struct SolverResult {
+  bool converged = false;
+  int iterations = 0;
+  /// 最终的相对残差
+  double residual = 0;
+};
+
+namespace detail {
+
+template <typename E>
+double norm2(int n, const E *x) {
+  return std::sqrt((double)simd::sum_sq(x, n));
+}
+
+/// r = b - A x
+template <typename E>
+void residual(const LinearOperator<E> &A, const E *b, const E *x, E *r, int n) {
+  A.apply(x, r);
+  simd::sub(n, b, r, r);
+}
+
+/// z = M^-1 r, 没有预条件时直接拷贝
+template <typename E>
+void precondition(const Preconditioner<E> *M, const E *r, E *z, int n) {
+  if (M)
+    M->apply(r, z);
+  else
+    std::copy(r, r + n, z);
+}
+}
+
+/// 预条件共轭梯度法, 要求 A 对称正定
+///
+/// 工作向量在第一次 solve 时分配, 之后同样规模的求解不再分配内存.
+template <typename E>
+class ConjugateGradient {
+private:
+  SolverOptions opts;
+  std::vector<E> r, z, p, q;
+
+public:
+  explicit ConjugateGradient(SolverOptions opts = SolverOptions()) : opts(opts) {
+  }
+
+  /// 以 x 为初值求解 A x = b, 结果写回 x
+  SolverResult solve(const LinearOperator<E> &A, const Vector<E> &b, Vector<E> &x,
+                     const Preconditioner<E> *M = nullptr) {
+    LA_OP_SCOPE("ConjugateGradient::solve", b.size(), b.size(), 0, 0, 0);
+    int n = b.size();
+    assert(A.row_num() == n && A.col_num() == n && x.size() == n);
+    r.resize(n), z.resize(n), p.resize(n), q.resize(n);
+
+    SolverResult res;
+    double bnorm = detail::norm2(n, b.data());
+    if (bnorm == 0) {
+      std::fill(x.data(), x.data() + n, E(0));
+      res.converged = true;
+      return res;
+    }
+
+    detail::residual(A, b.data(), x.data(), r.data(), n);
+    res.residual = detail::norm2(n, r.data()) / bnorm;
+    if (res.residual < opts.tolerance) {
+      res.converged = true;
+      return res;
+    }
+
+    detail::precondition(M, r.data(), z.data(), n);
+    p = z;
+    double rz = simd::dot(r.data(), z.data(), n);
+
+    while (res.iterations < opts.maxIterations) {
+      A.apply(p.data(), q.data());
+      double pq = simd::dot(p.data(), q.data(), n);
+      if (pq == 0)
+        break;
+      E alpha = E(rz / pq);
+      simd::axpy(n, alpha, p.data(), x.data());
+      simd::axpy(n, E(-alpha), q.data(), r.data());
+      ++res.iterations;
+
+      res.residual = detail::norm2(n, r.data()) / bnorm;
+      if (res.residual < opts.tolerance) {
+        res.converged = true;
+        break;
+      }
+
+      detail::precondition(M, r.data(), z.data(), n);
+      double rzNew = simd::dot(r.data(), z.data(), n);
+      E beta = E(rzNew / rz);
+      rz = rzNew;
+
+      /// p = z + beta * p
+      simd::scale(n, beta, p.data(), p.data());
+      simd::axpy(n, E(1), z.data(), p.data());
+    }
+    return res;
+  }
+};
+
+/// 右预条件 BiCGSTAB, 适用于一般非对称方阵
+template <typename E>
+class BiCGSTAB {
+private:
+  SolverOptions opts;
+  std::vector<E> r, r0, p, v, ph, s, sh, t;
+
+public:
+  explicit BiCGSTAB(SolverOptions opts = SolverOptions()) : opts(opts) {
+  }
+
+  SolverResult solve(const LinearOperator<E> &A, const Vector<E> &b, Vector<E> &x,
+                     const Preconditioner<E> *M = nullptr) {
+    LA_OP_SCOPE("BiCGSTAB::solve", b.size(), b.size(), 0, 0, 0);
+    int n = b.size();
+    assert(A.row_num() == n && A.col_num() == n && x.size() == n);
+    r.resize(n), r0.resize(n), ph.resize(n), s.resize(n), sh.resize(n), t.resize(n);
+    p.assign(n, E(0));
+    v.assign(n, E(0));
+
+    SolverResult res;
+    double bnorm = detail::norm2(n, b.data());
+    if (bnorm == 0) {
+      std::fill(x.data(), x.data() + n, E(0));
+      res.converged = true;
+      return res;
+    }
+
+    detail::residual(A, b.data(), x.data(), r.data(), n);
+    r0 = r;
+    res.residual = detail::norm2(n, r.data()) / bnorm;
+    if (res.residual < opts.tolerance) {
+      res.converged = true;
+      return res;
+    }
+
+    double rho = 1, alpha = 1, omega = 1;
+    while (res.iterations < opts.maxIterations) {
+      double rhoNew = simd::dot(r0.data(), r.data(), n);
+      if (rhoNew == 0)
+        break;
+      double beta = (rhoNew / rho) * (alpha / omega);
+      rho = rhoNew;
+
+      /// p = r + beta * (p - omega * v)
+      simd::axpy(n, E(-omega), v.data(), p.data());
+      simd::scale(n, E(beta), p.data(), p.data());
+      simd::axpy(n, E(1), r.data(), p.data());
+
+      detail::precondition(M, p.data(), ph.data(), n);
+      A.apply(ph.data(), v.data());
+      double r0v = simd::dot(r0.data(), v.data(), n);
+      if (r0v == 0)
+        break;
+      alpha = rho / r0v;
+
+      /// s = r - alpha * v
+      std::copy(r.begin(), r.end(), s.begin());
+      simd::axpy(n, E(-alpha), v.data(), s.data());
+      ++res.iterations;
+
+      double snorm = detail::norm2(n, s.data()) / bnorm;
+      if (snorm < opts.tolerance) {
+        simd::axpy(n, E(alpha), ph.data(), x.data());
+        res.residual = snorm;
+        res.converged = true;
+        break;
+      }
+
+      detail::precondition(M, s.data(), sh.data(), n);
+      A.apply(sh.data(), t.data());
+      double tt = simd::dot(t.data(), t.data(), n);
+      omega = tt == 0 ? 0 : simd::dot(t.data(), s.data(), n) / tt;
+
+      simd::axpy(n, E(alpha), ph.data(), x.data());
+      simd::axpy(n, E(omega), sh.data(), x.data());
+
+      /// r = s - omega * t
+      std::copy(s.begin(), s.end(), r.begin());
+      simd::axpy(n, E(-omega), t.data(), r.data());
+
+      res.residual = detail::norm2(n, r.data()) / bnorm;
+      if (res.residual < opts.tolerance) {
+        res.converged = true;
+        break;
+      }
+      if (omega == 0)
+        break;
+    }
+    return res;
+  }
+};
+
+/// 右预条件重启 GMRES(m), 用 Givens 旋转维护最小二乘问题
+template <typename E>
+class GMRES {
+private:
+  SolverOptions opts;
+  /// Krylov 基连续存放, 第 i 个向量从 V[i * n] 开始
+  std::vector<E> V;
+  std::vector<double> H, cs, sn, g, y;
+  std::vector<E> w, z, u;
+  int n;
+
+  double &h(int i, int j) {
+    return H[(std::size_t)i * opts.restart + j];
+  }
+
+  E *basis(int i) {
+    return V.data() + (std::size_t)i * n;
+  }
+
+public:
+  explicit GMRES(SolverOptions opts = SolverOptions()) : opts(opts), n(0) {
+    assert(opts.restart > 0);
+  }
+
+  SolverResult solve(const LinearOperator<E> &A, const Vector<E> &b, Vector<E> &x,
+                     const Preconditioner<E> *M = nullptr) {
+    LA_OP_SCOPE("GMRES::solve", b.size(), b.size(), 0, 0, 0);
+    n = b.size();
+    int m = opts.restart;
+    assert(A.row_num() == n && A.col_num() == n && x.size() == n);
+    V.resize((std::size_t)(m + 1) * n);
+    H.resize((std::size_t)(m + 1) * m);
+    cs.resize(m), sn.resize(m), g.resize(m + 1), y.resize(m);
+    w.resize(n), z.resize(n), u.resize(n);
+
+    SolverResult res;
+    double bnorm = detail::norm2(n, b.data());
+    if (bnorm == 0) {
+      std::fill(x.data(), x.data() + n, E(0));
+      res.converged = true;
+      return res;
+    }
+
+    while (true) {
+      detail::residual(A, b.data(), x.data(), w.data(), n);
+      double beta = detail::norm2(n, w.data());
+      res.residual = beta / bnorm;
+      if (res.residual < opts.tolerance) {
+        res.converged = true;
+        break;
+      }
+      if (res.iterations >= opts.maxIterations)
+        break;
+
+      simd::scale(n, E(1 / beta), w.data(), basis(0));
+      std::fill(g.begin(), g.end(), 0.0);
+      g[0] = beta;
+
+      int k = 0;
+      for (; k < m && res.iterations < opts.maxIterations; ++k) {
+        detail::precondition(M, basis(k), z.data(), n);
+        A.apply(z.data(), w.data());
+
+        /// 修正 Gram-Schmidt 正交化
+        for (int i = 0; i <= k; ++i) {
+          h(i, k) = simd::dot(w.data(), basis(i), n);
+          simd::axpy(n, E(-h(i, k)), basis(i), w.data());
+        }
+        h(k + 1, k) = detail::norm2(n, w.data());
+        if (h(k + 1, k) != 0)
+          simd::scale(n, E(1 / h(k + 1, k)), w.data(), basis(k + 1));
+
+        /// 之前的旋转作用到新的一列, 再构造新的旋转消去 h(k + 1, k)
+        for (int i = 0; i < k; ++i) {
+          double a = h(i, k), c = h(i + 1, k);
+          h(i, k) = cs[i] * a + sn[i] * c;
+          h(i + 1, k) = -sn[i] * a + cs[i] * c;
+        }
+        double a = h(k, k), c = h(k + 1, k);
+        double rr = std::sqrt(a * a + c * c);
+        cs[k] = rr == 0 ? 1 : a / rr;
+        sn[k] = rr == 0 ? 0 : c / rr;
+        h(k, k) = rr;
+        h(k + 1, k) = 0;
+        g[k + 1] = -sn[k] * g[k];
+        g[k] = cs[k] * g[k];
+
+        ++res.iterations;
+        res.residual = std::abs(g[k + 1]) / bnorm;
+        if (res.residual < opts.tolerance || rr == 0) {
+          ++k;
+          break;
+        }
+      }
+
+      /// H y = g, 然后 x += M^-1 (V^T y)
+      for (int i = k - 1; i >= 0; --i) {
+        double s = g[i];
+        for (int j = i + 1; j < k; ++j)
+          s -= h(i, j) * y[j];
+        y[i] = h(i, i) == 0 ? 0 : s / h(i, i);
+      }
+      std::fill(u.begin(), u.end(), E(0));
+      for (int i = 0; i < k; ++i)
+        simd::axpy(n, E(y[i]), basis(i), u.data());
+      detail::precondition(M, u.data(), z.data(), n);
+      simd::axpy(n, E(1), z.data(), x.data());
+    }
+    return res;
+  }
+};
+}
+
+#endif // LA_ITERATIVESOLVER_H
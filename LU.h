@@ -0,0 +1,303 @@
+/**********************************
+ * File:     LU.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/29
+ ***********************************/
+
+#ifndef LA_LU_H
+#define LA_LU_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "Gemm.h"
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+/// 带部分选主元的 LU 分解: P * A = L * U
+///
+/// L (单位下三角, 对角线不存) 和 U 紧凑地存放在同一个矩阵里, perm[i] 表示
+/// 分解后的第 i 行来自 A 的第 perm[i] 行. 分解一次 O(n^3), 之后每次求解 O(n^2).
+template <typename E>
+class LU {
+private:
+  Matrix<E> lu;
+  std::vector<int> perm;
+  int sign;
+  bool singular;
+  /// L 中元素绝对值的最大值; 部分选主元保证为 1, 低秩更新后可能增长
+  E lgrowth;
+  /// 主元阈值 kPivotTolerance * max|A_ij|
+  E pivotTol;
+
+  /// 分块大小: 面板宽度, 尾部更新走 GEMM
+  static constexpr int NB = 64;
+
+  E *at(int i, int j) {
+    return lu.row_ptr(i) + j;
+  }
+
+  void swap_rows(int r1, int r2) {
+    if (r1 == r2)
+      return;
+    std::swap_ranges(lu.row_ptr(r1), lu.row_ptr(r1) + lu.col_num(), lu.row_ptr(r2));
+    std::swap(perm[r1], perm[r2]);
+    sign = -sign;
+  }
+
+  /// 对列 [k, k + nb) 做非分块的 LU, 行交换作用在整行上
+  void factor_panel(int k, int nb) {
+    int n = lu.row_num();
+    int end = k + nb;
+    for (int c = k; c < end; ++c) {
+
+      int p = c;
+      E maxVal = std::abs(*at(c, c));
+      for (int r = c + 1; r < n; ++r) {
+        E v = std::abs(*at(r, c));
+        if (v > maxVal) {
+          maxVal = v;
+          p = r;
+        }
+      }
+      swap_rows(c, p);
+
+      E pivot = *at(c, c);
+      if (!(std::abs(pivot) > pivotTol)) {
+        singular = true;
+        continue;
+      }
+
+      for (int r = c + 1; r < n; ++r) {
+        E *row = lu.row_ptr(r);
+        row[c] /= pivot;
+        if (c + 1 < end)
+          simd::axpy(end - c - 1, E(-row[c]), at(c, c + 1), row + c + 1);
+      }
+    }
+  }
+
+  void factor() {
+    int n = lu.row_num();
+    LA_OP_SCOPE("LU::factor", n, n, 0, 2.0 * n * n * n / 3, (double)n * n * sizeof(E));
+    for (int k = 0; k < n; k += NB) {
+      int nb = std::min(NB, n - k);
+      factor_panel(k, nb);
+
+      int rest = n - k - nb;
+      if (rest <= 0)
+        continue;
+
+      /// U12 = L11^-1 * A12
+      for (int i = k + 1; i < k + nb; ++i) {
+        E *row = lu.row_ptr(i);
+        for (int j = k; j < i; ++j)
+          simd::axpy(rest, E(-row[j]), at(j, k + nb), row + k + nb);
+      }
+
+      /// A22 -= L21 * U12
+      int ld = lu.leading_dim();
+      blas::gemm(rest, rest, nb, E(-1), at(k + nb, k), ld, at(k, k + nb), ld,
+                 E(1), at(k + nb, k + nb), ld);
+    }
+  }
+
+public:
+  explicit LU(const Matrix<E> &A) : lu(A), perm(A.row_num()), sign(1), singular(false), lgrowth(1) {
+    assert(A.row_num() == A.col_num() && "LU requires a square matrix");
+    int n = A.row_num();
+    pivotTol = E(kPivotTolerance) * detail::max_abs(n, n, A.data(), A.leading_dim());
+    for (int i = 0; i < (int)perm.size(); ++i)
+      perm[i] = i;
+    factor();
+  }
+
+  /// 秩 k 更新: 把分解改为 A + U V^T 的分解, U 和 V 都是 n x k. O(k n^2), 不重新分解.
+  ///
+  /// Bennett 算法, 沿用原来的行交换 (P (A + U V^T) = L U + (P U) V^T), 逐行处理:
+  /// 第 i 行的 L 部分依次用前面各行留下的 (x_p, gamma_p), U 部分加上 x_i y^T 后
+  /// 得到本行的 gamma_i 并更新 y, 整个更新只按行扫一遍 L\U.
+  /// 不重新选主元, 新主元过小或相消过多时返回 false, 分解保持不变,
+  /// 可以重新分解 A + U V^T 或改用 Woodbury 求解. 更新在副本上进行, 成功后才替换.
+  /// 连续多次更新后 L 的元素会增长, 精度随之下降, 可以用 growth() 决定何时重新分解.
+  /// 下降 A - U V^T 即传入 -U
+  bool update(const Matrix<E> &U, const Matrix<E> &V) {
+    const int R = 4;
+    assert(!singular && "matrix is singular");
+    int n = lu.row_num(), k = U.col_num();
+    assert(U.row_num() == n && V.row_num() == n && V.col_num() == k);
+    LA_OP_SCOPE("LU::update", n, n, k, 2.0 * k * n * n, (double)n * n * sizeof(E));
+
+    /// Y 的第 j 行是第 j 次修正的 y
+    Matrix<E> Y(k, n);
+    blas::transpose(n, k, V.data(), V.leading_dim(), Y.data(), Y.leading_dim());
+    std::vector<E> xs((std::size_t)n * k), gs((std::size_t)n * k), x((std::size_t)R * k);
+    const E tol = std::sqrt(std::numeric_limits<E>::epsilon());
+    Matrix<E> work(lu);
+    E growth = lgrowth;
+
+    auto apply = [&](int p, E &l, E *xr) {
+      const E *xp = xs.data() + (std::size_t)p * k, *gp = gs.data() + (std::size_t)p * k;
+      for (int j = 0; j < k; ++j) {
+        xr[j] -= xp[j] * l;
+        l += gp[j] * xr[j];
+      }
+      growth = std::max(growth, (E)std::abs(l));
+    };
+
+    for (int i0 = 0; i0 < n; i0 += R) {
+      int rows = std::min(R, n - i0);
+      for (int r = 0; r < rows; ++r)
+        std::copy(U.row_ptr(perm[i0 + r]), U.row_ptr(perm[i0 + r]) + k,
+                  x.begin() + (std::size_t)r * k);
+
+      /// 同一组的行在前 i0 列上互不依赖, 交错执行以隐藏依赖链的延迟
+      for (int p = 0; p < i0; ++p)
+        for (int r = 0; r < rows; ++r)
+          apply(p, work.row_ptr(i0 + r)[p], x.data() + (std::size_t)r * k);
+
+      for (int r = 0; r < rows; ++r) {
+        int i = i0 + r;
+        E *row = work.row_ptr(i), *xr = x.data() + (std::size_t)r * k;
+        for (int p = i0; p < i; ++p)
+          apply(p, row[p], xr);
+
+        for (int j = 0; j < k; ++j) {
+          E *y = Y.row_ptr(j);
+          E before = row[i];
+          simd::axpy(n - i, xr[j], y + i, row + i);
+          E d = row[i];
+          if (!(std::abs(d) > pivotTol) ||
+              !(std::abs(d) > tol * (std::abs(before) + std::abs(xr[j] * y[i]))))
+            return false;
+          E g = y[i] / d;
+          simd::axpy(n - i - 1, -g, row + i + 1, y + i + 1);
+          xs[(std::size_t)i * k + j] = xr[j];
+          gs[(std::size_t)i * k + j] = g;
+        }
+      }
+    }
+    lu.swap(work);
+    lgrowth = growth;
+    return true;
+  }
+
+  /// 秩 1 更新 A + u v^T
+  bool update(const Vector<E> &u, const Vector<E> &v) {
+    int n = u.size();
+    return update(Matrix<E>(n, 1, std::vector<E>(u.data(), u.data() + n)),
+                  Matrix<E>(n, 1, std::vector<E>(v.data(), v.data() + n)));
+  }
+
+  /// L 的元素增长: 新分解为 1, 低秩更新后变大. 误差大致随它成比例放大
+  E growth() const {
+    return lgrowth;
+  }
+
+  /// 矩阵是否(数值上)奇异; 奇异时不能求解
+  bool is_singular() const {
+    return singular;
+  }
+
+  int size() const {
+    return lu.row_num();
+  }
+
+  /// 紧凑存储的 L\U
+  const Matrix<E> &packed() const {
+    return lu;
+  }
+
+  const std::vector<int> &permutation() const {
+    return perm;
+  }
+
+  /// 原地求解 A x = b: 调用时 x 存放 b, 返回时存放解
+  void solve_in_place(E *x) const {
+
+    assert(!singular && "matrix is singular");
+
+    int n = lu.row_num();
+    std::vector<E> b(x, x + n);
+    for (int i = 0; i < n; ++i)
+      x[i] = b[perm[i]];
+
+    /// L y = P b
+    for (int i = 1; i < n; ++i)
+      x[i] -= simd::dot(lu.row_ptr(i), x, i);
+
+    /// U x = y
+    for (int i = n - 1; i >= 0; --i) {
+      const E *row = lu.row_ptr(i);
+      x[i] = (x[i] - simd::dot(row + i + 1, x + i + 1, n - i - 1)) / row[i];
+    }
+  }
+
+  /// 求解 A x = b
+  Vector<E> solve(const Vector<E> &b) const {
+    assert(b.size() == lu.row_num());
+    Vector<E> x(b);
+    solve_in_place(x.data());
+    return x;
+  }
+
+  /// 求解 A X = B, B 的每一列是一个右端项
+  Matrix<E> solve(const Matrix<E> &B) const {
+
+    assert(!singular && "matrix is singular");
+    assert(B.row_num() == lu.row_num());
+
+    int n = lu.row_num(), m = B.col_num();
+    Matrix<E> X(n, m);
+    for (int i = 0; i < n; ++i)
+      std::copy(B.row_ptr(perm[i]), B.row_ptr(perm[i]) + m, X.row_ptr(i));
+
+    /// 按行做前代和回代, 每一步都是长度为 m 的 axpy
+    for (int i = 1; i < n; ++i) {
+      const E *l = lu.row_ptr(i);
+      E *xi = X.row_ptr(i);
+      for (int j = 0; j < i; ++j)
+        if (l[j] != E(0))
+          simd::axpy(m, E(-l[j]), X.row_ptr(j), xi);
+    }
+
+    for (int i = n - 1; i >= 0; --i) {
+      const E *u = lu.row_ptr(i);
+      E *xi = X.row_ptr(i);
+      for (int j = i + 1; j < n; ++j)
+        if (u[j] != E(0))
+          simd::axpy(m, E(-u[j]), X.row_ptr(j), xi);
+      simd::scale(m, E(1) / u[i], xi, xi);
+    }
+    return X;
+  }
+
+  /// 行列式
+  E det() const {
+    E d = E(sign);
+    for (int i = 0; i < lu.row_num(); ++i)
+      d *= lu.row_ptr(i)[i];
+    return d;
+  }
+
+  /// 逆矩阵
+  Matrix<E> inverse() const {
+    return solve(Matrix<E>::identify(lu.row_num()));
+  }
+};
+
+/// NB 在 std::min 中按引用使用, C++14 需要类外定义, 否则未优化的构建链接失败
+template <typename E>
+constexpr int LU<E>::NB;
+}
+
+#endif // LA_LU_H
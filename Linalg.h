@@ -20,6 +20,9 @@ public:
   static Matrix<E> inv(Matrix<E> &A, bool *isExist) {
 
     assert(A.row_num() == A.col_num());
+    LA_OP_SCOPE("Linalg::inv", A.row_num(), A.col_num(), 0,
+                2.0 * A.row_num() * A.row_num() * A.row_num(),
+                2.0 * A.row_num() * A.row_num() * sizeof(E));
 
     int n = A.row_num();
     Matrix<E> identifyMat = Matrix<E>::identify(n);
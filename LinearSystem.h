@@ -13,10 +13,14 @@
 
 #include "Vector.h"
 #include "Matrix.h"
+#include "Gemm.h"
+#include "Simd.h"
+#include "ThreadPool.h"
 #include <cassert>
 #include <vector>
 #include <cmath>
 #include <iostream>
+#include <algorithm>
 
 namespace LinearAlgebra {
 template <typename E>
@@ -33,18 +37,12 @@ public:
     row = A.row_num();
     col = A.col_num();
 
-    std::vector<std::vector<E>> res(row, std::vector<E>(col + 1, 0));
-
-    for (int i = 0; i < row; ++i)
-      for (int j = 0; j < col; ++j) {
-        res[i][j] = A[i][j];
-      }
+    Ab = new Matrix<E>(row, col + 1);
 
     for (int i = 0; i < row; ++i) {
-      res[i][col] = b[i];
+      std::copy(A.row_ptr(i), A.row_ptr(i) + col, Ab->row_ptr(i));
+      Ab->row_ptr(i)[col] = b[i];
     }
-
-    Ab = new Matrix<E>(res);
   }
 
   LinearSystem(Matrix<E> &A, Matrix<E> &B) {
@@ -54,17 +52,17 @@ public:
     row = A.row_num();
     col = A.col_num();
 
-    std::vector<std::vector<E>> res(row, std::vector<E>(col + col, 0));
+    Ab = new Matrix<E>(row, col + col);
 
-    for (int i = 0; i < row; ++i)
-      for (int j = 0; j < col; ++j) {
-        res[i][j] = A[i][j];
-        res[i][j + col] = B[i][j];
-      }
-
-    Ab = new Matrix<E>(res);
+    for (int i = 0; i < row; ++i) {
+      std::copy(A.row_ptr(i), A.row_ptr(i) + col, Ab->row_ptr(i));
+      std::copy(B.row_ptr(i), B.row_ptr(i) + col, Ab->row_ptr(i) + col);
+    }
   }
 
+  LinearSystem(const LinearSystem &) = delete;
+  LinearSystem &operator=(const LinearSystem &) = delete;
+
   ~LinearSystem() {
     if (Ab) {
       delete Ab;
@@ -79,7 +77,7 @@ public:
     int k = pivots.size();
     /// 最后的行均为0，如果相应的最后一列不为0，那么说明无解了.
     for (int i = k; i < row; ++i) {
-      if (abs((*Ab)[i][col]) > 1e-8)
+      if (std::abs((*Ab)[i][col]) > 1e-8)
         return false;
     }
     return true;
@@ -107,7 +105,7 @@ public:
     for (int i = 0; i < row; ++i)
       res[i] = (*Ab)[i][col];
 
-    return Vector<E>(res);
+    return Vector<E>(std::move(res));
   }
 
   friend std::ostream &operator<<(std::ostream &os, const LinearSystem<E> &ls) {
@@ -129,12 +127,19 @@ public:
   }
 
 private:
+  /// 分块消元的面板宽度
+  static constexpr int NB = 48;
+
+  E *at(int r, int c) {
+    return Ab->row_ptr(r) + c;
+  }
+
   int find_max_row(int r, int tc, int row) {
-    int pivot = abs((*Ab)[r][tc]);
+    E pivot = std::abs((*Ab)(r, tc));
     int max_row = r;
     for (int i = r + 1; i < row; ++i) {
-      if (abs((*Ab)[i][tc]) > pivot) {
-        pivot = abs((*Ab)[i][tc]);
+      if (std::abs((*Ab)(i, tc)) > pivot) {
+        pivot = std::abs((*Ab)(i, tc));
         max_row = i;
       }
     }
@@ -142,60 +147,146 @@ private:
   }
 
   void exchange_row(int r1, int r2) {
-    for (int i = 0; i < Ab->col_num(); ++i) {
-      E t = (*Ab)[r1][i];
-      (*Ab)[r1][i] = (*Ab)[r2][i];
-      (*Ab)[r2][i] = t;
+    if (r1 == r2)
+      return;
+    std::swap_ranges(Ab->row_ptr(r1), Ab->row_ptr(r1) + Ab->col_num(), Ab->row_ptr(r2));
+  }
+
+  /// 把绝对值小于 1e-8 的元素置 0
+  void clamp_tiny() {
+    int width = Ab->col_num();
+    for (int r = 0; r < row; ++r) {
+      E *a = Ab->row_ptr(r);
+      for (int j = 0; j < width; ++j)
+        if (std::abs(a[j]) < 1e-8)
+          a[j] = 0;
     }
   }
 
+  /// 分块的右视消元 (right-looking):
+  /// 先在宽度为 NB 的列面板内选主元并消元, 乘数暂存在被消去的位置;
+  /// 面板右侧的列只在面板结束后统一更新: 主元行做一次三角求解,
+  /// 其余行的更新 A22 -= L21 * U12 是一次 GEMM, 并且只涉及尚未消元的子矩阵
   void forward() {
+    LA_OP_SCOPE("LinearSystem::forward", row, Ab->col_num(), 0,
+                (double)row * row * Ab->col_num(), (double)row * Ab->col_num() * sizeof(E));
 
-    int i = 0, k = 0;
-    while (i < row && k < col){
+    int width = Ab->col_num();
+    int i = 0;
 
-      int max_row = find_max_row(i, k, row);
-      exchange_row(i, max_row);
+    for (int k0 = 0; i < row && k0 < col; k0 += NB) {
 
-      E pivot = (*Ab)[i][k];
+      int k1 = std::min(k0 + NB, col);
+      int i0 = i;
+      std::vector<int> pcs;
 
-      if (abs(pivot) < 1e-8)
-        k += 1;
-      else {
-          /// 将主元归一
-          for (int j = 0; j < Ab->col_num(); ++j) {
-            (*Ab)[i][j] = (*Ab)[i][j] / pivot;
-            if (abs((*Ab)[i][j]) < 1e-8)
-              (*Ab)[i][j] = 0;
-          }
+      for (int k = k0; k < k1 && i < row; ++k) {
+
+        int max_row = find_max_row(i, k, row);
+        exchange_row(i, max_row);
 
-          for (int m = i + 1; m < row; ++m) {
-            E times = (*Ab)[m][k];
-            for (int n = 0; n < Ab->col_num(); ++n) {
-              (*Ab)[m][n] = (*Ab)[m][n] - times * (*Ab)[i][n];
-              if (abs((*Ab)[m][n]) < 1e-8)
-                (*Ab)[m][n] = 0;
+        E pivot = (*Ab)(i, k);
+        if (std::abs(pivot) < 1e-8)
+          continue;
+
+        const E *u = at(i, k + 1);
+        for (int m = i + 1; m < row; ++m) {
+          E *a = Ab->row_ptr(m);
+          a[k] /= pivot;
+          if (a[k] != E(0) && k + 1 < k1)
+            simd::axpy(k1 - k - 1, E(-a[k]), u, a + k + 1);
+        }
+        pcs.push_back(k);
+        pivots.push_back(k);
+        i += 1;
+      }
+
+      int p = (int)pcs.size();
+      int rest = width - k1;
+      if (p > 0 && rest > 0) {
+
+        /// U12 = L11^-1 * A12, 按列切块并行
+        Parallel::for_range(0, rest, 256, (long long)p * p * rest, [&](int lo, int hi) {
+          for (int t = 1; t < p; ++t) {
+            E *a = at(i0 + t, k1);
+            for (int s = 0; s < t; ++s) {
+              E l = (*Ab)(i0 + t, pcs[s]);
+              if (l != E(0))
+                simd::axpy(hi - lo, E(-l), at(i0 + s, k1) + lo, a + lo);
             }
           }
-          pivots.push_back(k);
-          i += 1;
+        });
+
+        /// A22 -= L21 * U12
+        int below = row - i;
+        if (below > 0) {
+          Matrix<E> L21(below, p);
+          for (int r = 0; r < below; ++r)
+            for (int t = 0; t < p; ++t)
+              L21(r, t) = (*Ab)(i + r, pcs[t]);
+          blas::gemm(below, rest, p, E(-1), L21.data(), L21.leading_dim(),
+                     at(i0, k1), Ab->leading_dim(), E(1), at(i, k1), Ab->leading_dim());
         }
+      }
+
+      /// 主元下方的乘数已经用完, 置 0
+      for (int t = 0; t < p; ++t)
+        for (int r = i0 + t + 1; r < row; ++r)
+          (*Ab)(r, pcs[t]) = 0;
+    }
+
+    /// 将主元归一
+    for (int t = 0; t < (int)pivots.size(); ++t) {
+      E *a = Ab->row_ptr(t);
+      int k = pivots[t];
+      simd::scale(width - k, E(1) / a[k], a + k, a + k);
+      a[k] = 1;
     }
+    clamp_tiny();
   }
+
+  /// 分块回代: 自下而上每次处理 NB 个主元行. 块内逐行消元,
+  /// 块上方所有行的更新合并成一次 GEMM, 只涉及块内第一个主元列右侧的子矩阵
   void backward() {
+    LA_OP_SCOPE("LinearSystem::backward", row, Ab->col_num(), 0,
+                (double)pivots.size() * pivots.size() * Ab->col_num(),
+                (double)row * Ab->col_num() * sizeof(E));
 
+    int width = Ab->col_num();
     int n = (int)pivots.size();
-    for (int i = n - 1; i > 0; i--) {
-      int m = pivots[i];
-      for (int j = i - 1; j >= 0; j--) {
-        E times = (*Ab)[j][m];
-        for (int k = 0; k < Ab->col_num(); ++k) {
-          (*Ab)[j][k] = (*Ab)[j][k] - times * (*Ab)[i][k];
-          if (abs((*Ab)[j][k]) < 1e-8)
-            (*Ab)[j][k] = 0;
+
+    for (int b1 = n; b1 > 0; b1 -= NB) {
+
+      int b0 = std::max(0, b1 - NB);
+
+      for (int i = b1 - 1; i > b0; --i) {
+        int m = pivots[i];
+        for (int j = i - 1; j >= b0; --j) {
+          E times = (*Ab)(j, m);
+          if (times != E(0))
+            simd::axpy(width - m, E(-times), at(i, m), at(j, m));
+          (*Ab)(j, m) = 0;
         }
       }
+
+      if (b0 == 0)
+        continue;
+
+      int bs = b1 - b0;
+      int c0 = pivots[b0];
+      Matrix<E> M(b0, bs);
+      for (int j = 0; j < b0; ++j)
+        for (int t = 0; t < bs; ++t)
+          M(j, t) = (*Ab)(j, pivots[b0 + t]);
+
+      blas::gemm(b0, width - c0, bs, E(-1), M.data(), M.leading_dim(),
+                 at(b0, c0), Ab->leading_dim(), E(1), at(0, c0), Ab->leading_dim());
+
+      for (int j = 0; j < b0; ++j)
+        for (int t = 0; t < bs; ++t)
+          (*Ab)(j, pivots[b0 + t]) = 0;
     }
+    clamp_tiny();
   }
 };
 }
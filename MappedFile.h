@@ -0,0 +1,192 @@
+/**********************************
+ * File:     MappedFile.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/2
+ ***********************************/
+
+#ifndef LA_MAPPEDFILE_H
+#define LA_MAPPEDFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "Memory.h"
+
+#if defined(_WIN32)
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LinearAlgebra {
+
+/// 文件读写失败或格式不符
+struct IOError : public std::runtime_error {
+  explicit IOError(const std::string &msg) : std::runtime_error(msg) {
+  }
+};
+
+/// 二进制格式: 64 字节的文件头之后是按行主序排列的数据, 每行 ld 个元素 (含填充).
+/// 数据从 offset 处开始, offset 是 64 的倍数, 映射后每行行首都按 cache line 对齐
+namespace io {
+
+constexpr char kMagic[4] = {'L', 'A', 'M', 'X'};
+constexpr std::uint32_t kVersion = 1;
+
+enum class Kind : std::uint32_t { Vector = 1, Matrix = 2 };
+
+struct FileHeader {
+  char magic[4];
+  std::uint32_t version;
+  /// 元素类型, 见 DType
+  std::uint32_t dtype;
+  Kind kind;
+  std::uint64_t rows;
+  std::uint64_t cols;
+  /// 行跨度 (元素个数)
+  std::uint64_t ld;
+  /// 数据相对文件开头的字节偏移
+  std::uint64_t offset;
+  /// 数据的对齐字节数
+  std::uint32_t alignment;
+  std::uint8_t reserved[12];
+};
+
+static_assert(sizeof(FileHeader) == 64, "file header must be 64 bytes");
+
+/// 元素类型编码
+template <typename E> struct DType;
+template <> struct DType<float> { static constexpr std::uint32_t code = 1; };
+template <> struct DType<double> { static constexpr std::uint32_t code = 2; };
+template <> struct DType<std::int32_t> { static constexpr std::uint32_t code = 3; };
+template <> struct DType<std::int64_t> { static constexpr std::uint32_t code = 4; };
+
+template <typename E>
+FileHeader make_header(Kind kind, std::uint64_t rows, std::uint64_t cols, std::uint64_t ld) {
+  FileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kMagic, 4);
+  h.version = kVersion;
+  h.dtype = DType<E>::code;
+  h.kind = kind;
+  h.rows = rows;
+  h.cols = cols;
+  h.ld = ld;
+  h.offset = sizeof(FileHeader);
+  h.alignment = (std::uint32_t)detail::kAlignment;
+  return h;
+}
+
+/// 私有 (写时复制) 地映射整个文件: 没写过的页直接用页缓存, 多个进程映射同一文件时
+/// 共享物理页; 写入只复制被写的那一页到本进程, 文件本身不会改变
+class MappedFile {
+private:
+  void *base;
+  std::size_t len;
+#if defined(_WIN32)
+  std::vector<char> buffer;
+#endif
+
+  MappedFile() : base(nullptr), len(0) {
+  }
+
+public:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  static std::shared_ptr<MappedFile> open(const std::string &path) {
+    std::shared_ptr<MappedFile> f(new MappedFile());
+#if defined(_WIN32)
+    /// 没有 mmap 时退化为整体读入
+    std::FILE *fp = std::fopen(path.c_str(), "rb");
+    if (!fp)
+      throw IOError("cannot open " + path);
+    std::fseek(fp, 0, SEEK_END);
+    long size = std::ftell(fp);
+    std::fseek(fp, 0, SEEK_SET);
+    f->buffer.resize(size + detail::kAlignment);
+    char *p = static_cast<char *>(detail::align_up(f->buffer.data(), 0));
+    bool ok = std::fread(p, 1, size, fp) == (std::size_t)size;
+    std::fclose(fp);
+    if (!ok)
+      throw IOError("cannot read " + path);
+    f->base = p;
+    f->len = size;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw IOError("cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw IOError("cannot stat " + path);
+    }
+    f->len = (std::size_t)st.st_size;
+    if (f->len > 0) {
+      void *p = ::mmap(nullptr, f->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw IOError("cannot mmap " + path);
+      }
+      f->base = p;
+    }
+    /// 映射建立后就可以关闭描述符
+    ::close(fd);
+#endif
+    return f;
+  }
+
+  ~MappedFile() {
+#if !defined(_WIN32)
+    if (base)
+      ::munmap(base, len);
+#endif
+  }
+
+  const char *data() const {
+    return static_cast<const char *>(base);
+  }
+
+  /// 可写的数据指针, 写入触发写时复制
+  char *data() {
+    return static_cast<char *>(base);
+  }
+
+  std::size_t size() const {
+    return len;
+  }
+
+  /// 检查文件头与期望的元素类型和种类一致, 且数据完整
+  template <typename E>
+  const FileHeader &header(Kind kind, const std::string &path) const {
+    if (len < sizeof(FileHeader))
+      throw IOError(path + ": file too small");
+    const FileHeader &h = *reinterpret_cast<const FileHeader *>(base);
+    if (std::memcmp(h.magic, kMagic, 4) != 0)
+      throw IOError(path + ": bad magic");
+    if (h.version > kVersion)
+      throw IOError(path + ": unsupported version");
+    if (h.dtype != DType<E>::code)
+      throw IOError(path + ": element type mismatch");
+    if (h.kind != kind)
+      throw IOError(path + ": not a " + (kind == Kind::Matrix ? "matrix" : "vector"));
+    if (h.ld < h.cols || h.offset % sizeof(E) != 0 ||
+        h.offset + h.rows * h.ld * sizeof(E) > len)
+      throw IOError(path + ": truncated or inconsistent shape");
+    return h;
+  }
+};
+}
+}
+
+#endif // LA_MAPPEDFILE_H
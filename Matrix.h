@@ -15,185 +15,488 @@
 #include <cassert>
 #include <iostream>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
 #include "Vector.h"
+#include "Memory.h"
+#include "MappedFile.h"
+#include "Gemm.h"
+#include "ThreadPool.h"
+#include "Expression.h"
+#include "View.h"
 #include <tuple>
+#include <memory>
+#include <utility>
+#include <string>
 
 namespace LinearAlgebra {
+
+/// 选主元消元 (LU, 分块外存 LU, 批量求解) 共用的奇异判定: 选主元后
+/// |主元| 不大于该值乘以 max|A_ij| 即视为奇异. 与矩阵的整体缩放无关,
+/// 各条路径对同一矩阵给出相同结论; 零矩阵和含 NaN 的主元都判为奇异
+constexpr double kPivotTolerance = 1e-8;
+
+namespace detail {
+
+/// rows x cols 的行主序块 (行距 ld) 中元素绝对值的最大值
 template <typename E>
-class Matrix {
+E max_abs(int rows, int cols, const E *a, int ld) {
+  E m = 0;
+  for (int i = 0; i < rows; ++i)
+    for (int j = 0; j < cols; ++j)
+      m = std::max(m, (E)std::abs(a[(std::size_t)i * ld + j]));
+  return m;
+}
+
+} // namespace detail
+
+/// 矩阵某一行的轻量视图, 不拥有数据; E 可以是 const 类型
+template <typename E>
+class RowView {
 private:
-  Vector<E> *rowArr;
+  E *ptr;
+  int len;
+public:
+  RowView(E *ptr, int len) : ptr(ptr), len(len) {
+  }
+
+  /// 非 const 行视图可以隐式转换为 const 行视图
+  operator RowView<const E>() const {
+    return RowView<const E>(ptr, len);
+  }
+
+  /// getItem
+  E &operator[](int index) const {
+    assert(index >= 0 && index < len && "out of index");
+    return ptr[index];
+  }
+
+  int size() const {
+    return len;
+  }
+
+  E *data() const {
+    return ptr;
+  }
+
+  E *begin() const {
+    return ptr;
+  }
+
+  E *end() const {
+    return ptr + len;
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const RowView &v) {
+    os << "(";
+    for (int i = 0; i < v.len - 1; ++i)
+      os << v.ptr[i] << ",";
+    if (v.len > 0)
+      os << v.ptr[v.len - 1];
+    os << ")";
+    return os;
+  }
+};
+
+/// 行主序矩阵, 所有元素存放在一块连续的对齐内存中,
+/// 第 i 行从 value + i * ld 开始, ld >= col 使每行行首按 cache line 对齐
+template <typename E>
+class Matrix<E, Dynamic, Dynamic> : public MatExpr<Matrix<E>> {
+public:
+  typedef E value_type;
+
+private:
+  E *value;
   int row;
+  int col;
+  int ld;
+  /// 非空时 value 指向 owner 持有的外部内存(例如接管的 std::vector), 析构时不释放 value
+  std::shared_ptr<const void> owner;
+
+  void alloc(int r, int c) {
+    row = r;
+    col = c;
+    ld = detail::aligned_ld<E>(c);
+    value = detail::allocate<E>((std::size_t)row * ld);
+  }
+
+  void release() {
+    if (!owner)
+      detail::deallocate(value);
+    owner.reset();
+    value = nullptr;
+    row = col = ld = 0;
+  }
+
+  /// 指向 owner 持有的外部内存, 不拷贝
+  Matrix(E *data, int r, int c, int ld, std::shared_ptr<const void> holder)
+      : value(data), row(r), col(c), ld(ld), owner(std::move(holder)) {
+  }
+
+  /// 逐行拷贝, 两边的 leading dimension 可以不同
+  void copy_rows(const Matrix &other) {
+    LA_COUNT_COPY((std::size_t)row * col * sizeof(E));
+    for (int i = 0; i < row; ++i)
+      std::copy(other.row_ptr(i), other.row_ptr(i) + col, row_ptr(i));
+  }
+
 public:
 
   Matrix(std::vector<std::vector<E>> &vec2d) {
 
     assert(vec2d.size() > 0);
-    row = vec2d.size();
-    rowArr = new Vector<E>[row];
-    for (int i = 0; i < row; ++i)
-        rowArr[i] = new Vector<E>(vec2d[i]);
+    alloc(vec2d.size(), vec2d[0].size());
+    for (int i = 0; i < row; ++i) {
+      assert((int)vec2d[i].size() == col && "all rows must have the same length");
+      std::copy(vec2d[i].begin(), vec2d[i].end(), value + (std::size_t)i * ld);
+      std::fill(value + (std::size_t)i * ld + col, value + (std::size_t)(i + 1) * ld, E(0));
+    }
+  }
+
+  /// r 行 c 列的零矩阵
+  Matrix(int r, int c) {
+    assert(r > 0 && c > 0);
+    alloc(r, c);
+    std::fill(value, value + (std::size_t)row * ld, E(0));
+  }
+
+  /// 接管按行主序排列的 r * c 个元素, 不拷贝数据 (此时 ld == c)
+  Matrix(int r, int c, std::vector<E> &&data) : row(r), col(c), ld(c) {
+    assert(r > 0 && c > 0 && (std::size_t)r * c == data.size() && "size of data mismatch");
+    std::shared_ptr<std::vector<E>> holder = std::make_shared<std::vector<E>>(std::move(data));
+    value = holder->data();
+    owner = holder;
+  }
+
+  /// 从矩阵表达式构造, 在一个融合循环里求值
+  template <typename D>
+  Matrix(const MatExpr<D> &e) {
+    alloc(e.self().row_num(), e.self().col_num());
+    expr::assign(value, ld, e.self());
   }
 
   ~Matrix() {
-    if (rowArr) {
-      delete [] rowArr;
-    }
+    release();
   }
 
   /// copy construct
-  Matrix(const Matrix &other) : row(other.row_num()), rowArr(new Vector<E>[other.row_num()]) {
+  Matrix(const Matrix &other) {
+    alloc(other.row, other.col);
+    copy_rows(other);
+  }
+
+  /// move construct, 只转移缓冲区
+  Matrix(Matrix &&other) noexcept
+      : value(other.value), row(other.row), col(other.col), ld(other.ld),
+        owner(std::move(other.owner)) {
+    other.value = nullptr;
+    other.row = other.col = other.ld = 0;
+  }
+
+  /// copy assign
+  Matrix &operator=(const Matrix &other) {
+
+    if (this == &other)
+      return *this;
+
+    if (row != other.row || col != other.col || owner) {
+      Matrix temp(other);
+      swap(temp);
+    } else {
+      copy_rows(other);
+    }
+    return *this;
+  }
+
+  /// move assign
+  Matrix &operator=(Matrix &&other) noexcept {
+    if (this != &other) {
+      release();
+      value = other.value;
+      row = other.row;
+      col = other.col;
+      ld = other.ld;
+      owner = std::move(other.owner);
+      other.value = nullptr;
+      other.row = other.col = other.ld = 0;
+    }
+    return *this;
+  }
+
+  /// 表达式赋值; 表达式是逐元素的, 所以即使引用了自身也可以原地写入
+  template <typename D>
+  Matrix &operator=(const MatExpr<D> &e) {
+
+    const D &x = e.self();
+    if (row != x.row_num() || col != x.col_num() || owner ||
+        expr::Alias<D>::check(x, value, ld, row, col)) {
+      Matrix temp(x);
+      swap(temp);
+    } else {
+      expr::assign(value, ld, x);
+    }
+    return *this;
+  }
+
+  void swap(Matrix &other) noexcept {
+    std::swap(value, other.value);
+    std::swap(row, other.row);
+    std::swap(col, other.col);
+    std::swap(ld, other.ld);
+    owner.swap(other.owner);
+  }
 
+  /// self += other
+  template <typename D>
+  Matrix &operator+=(const MatExpr<D> &e) {
+    const D &x = e.self();
+    assert(row == x.row_num() && col == x.col_num() && "Shape of matrices must be same.");
+    if (expr::Alias<D>::check(x, value, ld, row, col))
+      expr::add_assign(value, ld, Matrix(x));
+    else
+      expr::add_assign(value, ld, x);
+    return *this;
+  }
+
+  /// self -= other
+  template <typename D>
+  Matrix &operator-=(const MatExpr<D> &e) {
+    const D &x = e.self();
+    assert(row == x.row_num() && col == x.col_num() && "Shape of matrices must be same.");
+    if (expr::Alias<D>::check(x, value, ld, row, col))
+      expr::sub_assign(value, ld, Matrix(x));
+    else
+      expr::sub_assign(value, ld, x);
+    return *this;
+  }
+
+  /// self *= k
+  Matrix &operator*=(const E k) {
     for (int i = 0; i < row; ++i)
-      rowArr[i] = other[i];
+      simd::scale(col, k, row_ptr(i), row_ptr(i));
+    return *this;
+  }
+
+  /// self /= k
+  Matrix &operator/=(const E k) {
+    assert(k != 0);
+    for (int i = 0; i < row; ++i) {
+      E *a = row_ptr(i);
+      for (int j = 0; j < col; ++j)
+        a[j] /= k;
+    }
+    return *this;
+  }
+
+  /// 映射 io::save 或 MatrixWriter 写出的矩阵文件, 不拷贝也不占额外的常驻内存,
+  /// 同一主机上映射同一文件的进程共享物理页. 映射是写时复制的: 可以像普通矩阵一样
+  /// 原地修改, 被写到的页才复制到本进程, 文件和其他进程看到的数据都不变
+  static Matrix map(const std::string &path) {
+    std::shared_ptr<io::MappedFile> f = io::MappedFile::open(path);
+    const io::FileHeader &h = f->header<E>(io::Kind::Matrix, path);
+    E *data = reinterpret_cast<E *>(f->data() + h.offset);
+    return Matrix(data, (int)h.rows, (int)h.cols, (int)h.ld, f);
   }
 
   /// zero matrix
   static Matrix zero(int r, int c) {
-
-    std::vector<std::vector<E>> res(r, std::vector<E>(c, 0));
-    return Matrix(res);
+    return Matrix(r, c);
   }
 
   /// 单位矩阵, 对角线为1
   static Matrix identify(int n) {
 
-    std::vector<std::vector<E>> res(n, std::vector<E>(n, 0));
+    Matrix res(n, n);
     for (int i = 0; i < n; ++i)
-      res[i][i] = 1;
-    return Matrix(res);
+      res.value[(std::size_t)i * res.ld + i] = 1;
+    return res;
   }
 
   /// mat * vector
-  Vector<E> dot(const Vector<E> &other) {
+  Vector<E> dot(const Vector<E> &other) const {
 
     assert(col_num() == other.size());
-
-    std::vector<E> res(row);
-
-    for (int i = 0; i < row; ++i) {
-      res[i] = rowArr[i].dot(other);
-    }
-    return Vector<E>(res);
+    LA_OP_SCOPE("Matrix::dot(Vector)", row, col, 1, 2.0 * row * col,
+                ((double)row * col + row + col) * sizeof(E));
+
+    Vector<E> res = Vector<E>::zero(row);
+    const E *x = other.data();
+    E *y = res.data();
+
+    /// 按行块分给线程池, 每块至少约 4096 次乘加
+    Parallel::for_range(0, row, std::max(1, 4096 / col), (long long)row * col,
+                        [&](int lo, int hi) {
+      for (int i = lo; i < hi; ++i)
+        y[i] = simd::dot(row_ptr(i), x, col);
+    });
+    return res;
   }
 
   /// mat * mat
-  Matrix dot(const Matrix &other) {
+  Matrix dot(const Matrix &other) const {
 
     assert(col_num() == other.row_num());
+    LA_OP_SCOPE("Matrix::dot(Matrix)", row, other.col, col, 2.0 * row * other.col * col,
+                ((double)row * col + (double)col * other.col + (double)row * other.col) * sizeof(E));
 
-    std::vector<std::vector<E>> res(row, std::vector<E>(other.col_num(), 0));
+    Matrix res(row, other.col);
+    blas::gemm(row, other.col, col, E(1), value, ld, other.value, other.ld,
+               E(0), res.value, res.ld);
+    return res;
+  }
 
-    for (int i = 0; i < row; ++i)
-      for (int j = 0; j < other.col_num(); ++j)
-        res[i][j] = rowArr[i].dot(other.col_vector(j));
+  /// mat * view, 例如 A.dot(B.t_view()), 不生成转置
+  template <typename T>
+  Matrix dot(const MatrixView<T> &other) const {
+    LA_OP_SCOPE("Matrix::dot(MatrixView)", row, other.col_num(), col,
+                2.0 * row * other.col_num() * col,
+                ((double)row * col + (double)col * other.col_num() + (double)row * other.col_num()) * sizeof(E));
+    return view().dot(other);
+  }
 
-    return Matrix(res);
+  /// mat * 跨步向量, 例如 A.dot(B.col_view(j))
+  template <typename T>
+  Vector<E> dot(const VectorView<T> &x) const {
+    LA_OP_SCOPE("Matrix::dot(VectorView)", row, col, 1, 2.0 * row * col,
+                ((double)row * col + row + col) * sizeof(E));
+    return view().dot(x);
   }
 
-  /// T
-  Matrix T() {
+  /// 转置后的矩阵 (分块 SIMD 转置). 只参与运算时用 t_view() 免去拷贝
+  Matrix T() const & {
+    LA_OP_SCOPE("Matrix::T", row, col, 0, 0, 2.0 * row * col * sizeof(E));
+    Matrix res(col, row);
+    blas::transpose(row, col, value, ld, res.value, res.ld);
+    return res;
+  }
 
-    int rowSize = row_num(), colSize = col_num();
-    std::vector<std::vector<E>> res(colSize, std::vector<E>(rowSize, 0));
+  /// 右值直接在自己的存储上转置, 方阵复用自己的缓冲区
+  Matrix T() && {
+    transpose_in_place();
+    return std::move(*this);
+  }
 
-    for (int i = 0; i < colSize; ++i) {
-      for (int j = 0; j < rowSize; ++j) {
-        res[i][j] = rowArr[j][i];
-      }
+  /// 原地转置. 方阵且缓冲区归自己所有时不分配, 否则换一块新缓冲区
+  void transpose_in_place() {
+    LA_OP_SCOPE("Matrix::T", row, col, 0, 0, 2.0 * row * col * sizeof(E));
+    if (row == col && !owner) {
+      blas::transpose_in_place(row, value, ld);
+    } else {
+      Matrix temp(col, row);
+      blas::transpose(row, col, value, ld, temp.value, temp.ld);
+      swap(temp);
     }
-    return Matrix(res);
   }
 
-  /// 返回矩阵的第index个行向量
-  Vector<E> row_vector(int index) const {
-    return rowArr[index];
+  /// 整个矩阵的视图
+  MatrixView<E> view() {
+    return MatrixView<E>(value, row, col, ld, 1);
   }
 
-  /// 返回矩阵的第index个列向量
-  Vector<E> col_vector(int index) const{
-    std::vector<E> cols(row);
-    for (int i = 0; i < row; ++i)
-      cols[i] = rowArr[i][index];
-    return Vector<E>(cols);
+  MatrixView<const E> view() const {
+    return MatrixView<const E>(value, row, col, ld, 1);
   }
 
-  /// getItem
-  Vector<E> &operator[](int index) {
-    return rowArr[index];
+  /// 转置视图, 不拷贝. 赋值给 Matrix 或参与运算时才按需读取
+  MatrixView<E> t_view() {
+    return MatrixView<E>(value, col, row, 1, ld);
   }
 
-  /// getItem const
-  const Vector<E> &operator[](int index) const {
-    return rowArr[index];
+  MatrixView<const E> t_view() const {
+    return MatrixView<const E>(value, col, row, 1, ld);
   }
 
-  /// 返回两个矩阵的加法
-  Matrix operator+(const Matrix& other) {
-
-    assert(row == other.row && col_num() && other.col_num());
+  /// 从 (i, j) 开始的 r x c 子块视图
+  MatrixView<E> block(int i, int j, int r, int c) {
+    return view().block(i, j, r, c);
+  }
 
-    std::vector<std::vector<E>> res(row, std::vector<E>(col_num(), 0));
+  MatrixView<const E> block(int i, int j, int r, int c) const {
+    return view().block(i, j, r, c);
+  }
 
-    int colSize = col_num();
-    for (int i = 0; i < row; ++i)
-      for (int j = 0; j < colSize; ++j)
-        res[i][j] = rowArr[i][j] + other[i][j];
+  /// 第 index 行的视图, 不拷贝
+  VectorView<E> row_view(int index) {
+    return view().row_view(index);
+  }
 
-    return Matrix(res);
+  VectorView<const E> row_view(int index) const {
+    return view().row_view(index);
   }
 
-  /// 返回两个矩阵的减法
-  Matrix operator-(const Matrix& other) {
+  /// 第 index 列的视图 (步长为 leading_dim()), 不分配
+  VectorView<E> col_view(int index) {
+    return view().col_view(index);
+  }
 
-    assert(row == other.row && col_num() && other.col_num());
+  VectorView<const E> col_view(int index) const {
+    return view().col_view(index);
+  }
 
-    std::vector<std::vector<E>> res(row, std::vector<E>(col_num(), 0));
+  /// 返回矩阵的第index个行向量
+  Vector<E> row_vector(int index) const {
+    assert(index >= 0 && index < row && "out of index");
+    return Vector<E>(row_ptr(index), col);
+  }
 
-    int colSize = col_num();
+  /// 返回矩阵的第index个列向量
+  Vector<E> col_vector(int index) const{
+    assert(index >= 0 && index < col && "out of index");
+    LA_OP_SCOPE("Matrix::col_vector", row, col, 0, 0, 2.0 * row * sizeof(E));
+    Vector<E> res = Vector<E>::zero(row);
+    E *cols = res.data();
     for (int i = 0; i < row; ++i)
-      for (int j = 0; j < colSize; ++j)
-        res[i][j] = rowArr[i][j] - other[i][j];
-
-    return Matrix(res);
+      cols[i] = value[(std::size_t)i * ld + index];
+    return res;
   }
 
-  /// 返回数量除法结果
-  Matrix operator/(const E k) {
-
-    assert(abs(k - 0) > 1e-8);
+  /// getItem
+  RowView<E> operator[](int index) {
+    assert(index >= 0 && index < row && "out of index");
+    return RowView<E>(row_ptr(index), col);
+  }
 
-    std::vector<std::vector<E>> res(row, std::vector<E>(col_num(), 0));
+  /// getItem const
+  RowView<const E> operator[](int index) const {
+    assert(index >= 0 && index < row && "out of index");
+    return RowView<const E>(row_ptr(index), col);
+  }
 
-    int colSize = col_num();
-    for (int i = 0; i < row; ++i)
-      for (int j = 0; j < colSize; ++j)
-        res[i][j] = rowArr[i][j] / k;
+  /// 元素 (i, j), 不做越界检查, 供表达式求值使用
+  E &operator()(int i, int j) {
+    return value[(std::size_t)i * ld + j];
+  }
 
-    return Matrix(res);
+  const E &operator()(int i, int j) const {
+    return value[(std::size_t)i * ld + j];
   }
 
-  /// neg
-  const Matrix operator-() const{
+  /// 第index行的起始地址
+  E *row_ptr(int index) {
+    return value + (std::size_t)index * ld;
+  }
 
-    std::vector<std::vector<E>> res(row, std::vector<E>(col_num(), 0));
+  const E *row_ptr(int index) const {
+    return value + (std::size_t)index * ld;
+  }
 
-    int colSize = col_num();
-    for (int i = 0; i < row; ++i)
-      for (int j = 0; j < colSize; ++j)
-        res[i][j] = rowArr[i][j] * -1;
+  /// 底层连续存储, 元素(i, j)位于 data()[i * leading_dim() + j]
+  E *data() {
+    return value;
+  }
 
-    return Matrix(res);
+  const E *data() const {
+    return value;
   }
 
-  /// pos
-  const Matrix operator+() const{
-    return *this;
+  /// 相邻两行起始位置之间的元素个数
+  int leading_dim() const {
+    return ld;
   }
 
   /// 返回矩阵元素的个数
   int size() const {
-    return row * rowArr[0].size();
+    return row * col;
   }
 
   /// 返回矩阵的行数
@@ -203,29 +506,12 @@ public:
 
   /// 返回矩阵的列数
   int col_num() const {
-    return rowArr[0].size();
+    return col;
   }
 
   /// 返回矩阵的形状: (行数，列数)
-  const std::tuple<int, int> shape() {
-    return std::tuple<int, int>(row, rowArr[0].size());
-  }
-
-  /// 返回矩阵的数量乘法 self * k
-  friend Matrix operator*(const Matrix& self, const E k) {
-
-    int rowSize = self.row_num(), colSize = self.col_num();
-    std::vector<std::vector<E>> res(rowSize, std::vector<E>(colSize, 0));
-    for (int i = 0; i < rowSize; ++i)
-      for (int j = 0; j < colSize; ++j)
-        res[i][j] = self[i][j] * k;
-
-    return Matrix(res);
-  }
-
-  /// 返回矩阵的数量乘法 k * self
-  friend Matrix operator*(const E k, const Matrix& self) {
-    return self * k;
+  const std::tuple<int, int> shape() const {
+    return std::tuple<int, int>(row, col);
   }
 
   /// 打印矩阵
@@ -233,16 +519,28 @@ public:
     os << "Matrix(" << std::endl;
     for (int i = 0; i < mat.row; ++i) {
       os << "[";
-      int col = mat.rowArr[i].size();
-      for (int j = 0; j < col - 1; ++j) {
-        os << mat.rowArr[i][j] << ",";
+      const E *a = mat.row_ptr(i);
+      for (int j = 0; j < mat.col - 1; ++j) {
+        os << a[j] << ",";
       }
-      os << mat.rowArr[i][col - 1] << "]" << std::endl;
+      os << a[mat.col - 1] << "]" << std::endl;
     }
     os << ")" << std::endl;
     return os;
   }
 };
+
+/// 原地矩阵乘加: C = alpha * A * B + beta * C
+template <typename E>
+void gemm(typename Matrix<E>::value_type alpha, const Matrix<E> &A, const Matrix<E> &B,
+          typename Matrix<E>::value_type beta, Matrix<E> &C) {
+
+  assert(A.col_num() == B.row_num() && "inner dimensions of A and B must agree");
+  assert(C.row_num() == A.row_num() && C.col_num() == B.col_num() && "shape of C mismatch");
+
+  blas::gemm(A.row_num(), B.col_num(), A.col_num(), alpha, A.data(), A.leading_dim(),
+             B.data(), B.leading_dim(), beta, C.data(), C.leading_dim());
+}
 }
 
 #endif // LA_MATRIX_H
@@ -0,0 +1,134 @@
+/**********************************
+ * File:     MatrixIO.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/2
+ ***********************************/
+
+#ifndef LA_MATRIXIO_H
+#define LA_MATRIXIO_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "MappedFile.h"
+
+namespace LinearAlgebra {
+namespace io {
+
+/// 流式写出矩阵文件: 先写文件头, 再逐行追加, 不需要整个矩阵都在内存里.
+/// 每行补零到 ld, 使 Matrix<E>::map 映射后的行首按 cache line 对齐
+template <typename E>
+class MatrixWriter {
+private:
+  std::FILE *fp;
+  std::string path;
+  int row, col, ld;
+  int written;
+  std::vector<E> pad;
+
+  void put(const void *data, std::size_t bytes) {
+    if (bytes && std::fwrite(data, 1, bytes, fp) != bytes)
+      throw IOError("cannot write " + path);
+  }
+
+public:
+  MatrixWriter(const std::string &path, int rows, int cols)
+      : fp(nullptr), path(path), row(rows), col(cols), ld(detail::aligned_ld<E>(cols)),
+        written(0), pad(ld - cols, E(0)) {
+    assert(rows > 0 && cols > 0);
+    fp = std::fopen(path.c_str(), "wb");
+    if (!fp)
+      throw IOError("cannot open " + path);
+    /// 大缓冲区, 减少系统调用
+    std::setvbuf(fp, nullptr, _IOFBF, 1 << 20);
+    FileHeader h = make_header<E>(Kind::Matrix, rows, cols, ld);
+    put(&h, sizeof(h));
+  }
+
+  ~MatrixWriter() {
+    if (fp)
+      std::fclose(fp);
+  }
+
+  MatrixWriter(const MatrixWriter &) = delete;
+  MatrixWriter &operator=(const MatrixWriter &) = delete;
+
+  /// 追加一行, data 有 cols 个元素
+  void write_row(const E *data) {
+    assert(written < row && "all rows have been written");
+    put(data, sizeof(E) * col);
+    put(pad.data(), sizeof(E) * pad.size());
+    ++written;
+  }
+
+  /// 追加连续的 n 行, 第 i 行从 data + i * stride 开始
+  void write_rows(const E *data, int n, int stride) {
+    for (int i = 0; i < n; ++i)
+      write_row(data + (std::size_t)i * stride);
+  }
+
+  int rows_written() const {
+    return written;
+  }
+
+  /// 结束写入; 行数不足时抛出 IOError
+  void close() {
+    if (!fp)
+      return;
+    int rc = std::fclose(fp);
+    fp = nullptr;
+    if (rc != 0)
+      throw IOError("cannot write " + path);
+    if (written != row)
+      throw IOError(path + ": expected " + std::to_string(row) + " rows, got " +
+                    std::to_string(written));
+  }
+};
+
+/// 把矩阵写成二进制文件
+template <typename E>
+void save(const std::string &path, const Matrix<E> &A) {
+  MatrixWriter<E> w(path, A.row_num(), A.col_num());
+  w.write_rows(A.data(), A.row_num(), A.leading_dim());
+  w.close();
+}
+
+/// 把向量写成二进制文件
+template <typename E>
+void save(const std::string &path, const Vector<E> &v) {
+  std::FILE *fp = std::fopen(path.c_str(), "wb");
+  if (!fp)
+    throw IOError("cannot open " + path);
+  FileHeader h = make_header<E>(Kind::Vector, v.size(), 1, 1);
+  bool ok = std::fwrite(&h, sizeof(h), 1, fp) == 1 &&
+            std::fwrite(v.data(), sizeof(E), v.size(), fp) == (std::size_t)v.size();
+  ok = std::fclose(fp) == 0 && ok;
+  if (!ok)
+    throw IOError("cannot write " + path);
+}
+
+/// 读入一个完全驻留内存的矩阵副本, 之后与文件无关 (文件被改写或截断也不受影响)
+template <typename E>
+Matrix<E> load_matrix(const std::string &path) {
+  const Matrix<E> mapped = Matrix<E>::map(path);
+  return Matrix<E>(mapped);
+}
+
+/// 读入一个完全驻留内存的向量副本, 之后与文件无关
+template <typename E>
+Vector<E> load_vector(const std::string &path) {
+  const Vector<E> mapped = Vector<E>::map(path);
+  return Vector<E>(mapped);
+}
+}
+}
+
+#endif // LA_MATRIXIO_H
@@ -0,0 +1,225 @@
+/**********************************
+ * File:     Memory.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/24
+ ***********************************/
+
+#ifndef LA_MEMORY_H
+#define LA_MEMORY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "Instrument.h"
+
+namespace LinearAlgebra {
+namespace detail {
+
+/// 所有数据缓冲区按 64 字节(一个 cache line, 也是 AVX-512 寄存器宽度)对齐
+constexpr std::size_t kAlignment = 64;
+
+/// 对齐地址之前的头部: [-1] 为堆上的原始指针或 arena 回退位置,
+/// [-2] 为所属 arena (堆分配为 nullptr), [-3] 为 arena 里上一次分配的地址
+constexpr std::size_t kHeader = 3 * sizeof(void *);
+
+inline void *align_up(void *p, std::size_t header) {
+  std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(p) + header;
+  addr = (addr + kAlignment - 1) & ~(std::uintptr_t)(kAlignment - 1);
+  return reinterpret_cast<void *>(addr);
+}
+
+inline void **header(void *aligned) {
+  return reinterpret_cast<void **>(aligned);
+}
+}
+
+/// 按块分配的 bump 内存池, 通过 ArenaScope 使用
+///
+/// 分配只移动指针; 释放最近一次分配时指针回退 (LIFO), 其他释放只计数.
+/// 作用域结束时如果还有缓冲区存活 (例如结果被移出作用域), arena 延后到
+/// 最后一个缓冲区释放时才归还内存, 所以逃逸的对象始终有效.
+class Arena {
+private:
+  std::vector<void *> blocks;
+  char *top;
+  char *end;
+  char *blockBegin;
+  void *last;
+  std::size_t blockBytes;
+  std::size_t reserved;
+  /// 存活的缓冲区个数, 再加上 ArenaScope 持有的 1
+  std::atomic<long> refs;
+  bool retired;
+
+  explicit Arena(std::size_t blockBytes)
+      : top(nullptr), end(nullptr), blockBegin(nullptr), last(nullptr),
+        blockBytes(blockBytes), reserved(0), refs(1), retired(false) {
+  }
+
+  void unref() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete this;
+  }
+
+  ~Arena() {
+    for (void *b : blocks)
+      std::free(b);
+  }
+
+  void grow(std::size_t bytes) {
+    std::size_t size = std::max(blockBytes, bytes + detail::kAlignment + detail::kHeader);
+    void *b = std::malloc(size);
+    if (!b)
+      throw std::bad_alloc();
+    blocks.push_back(b);
+    reserved += size;
+    blockBegin = top = static_cast<char *>(b);
+    end = top + size;
+    last = nullptr;
+    /// 下一块翻倍, 减少大计算中的块数
+    blockBytes *= 2;
+  }
+
+  friend class ArenaScope;
+
+public:
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  /// 当前线程正在使用的 arena, 没有时为 nullptr
+  static Arena *&current() {
+    thread_local Arena *arena = nullptr;
+    return arena;
+  }
+
+  void *allocate(std::size_t bytes) {
+    if (!top || static_cast<char *>(detail::align_up(top, detail::kHeader)) + bytes > end)
+      grow(bytes);
+    char *aligned = static_cast<char *>(detail::align_up(top, detail::kHeader));
+    void **h = detail::header(aligned);
+    h[-1] = top;
+    h[-2] = this;
+    h[-3] = last;
+    top = aligned + bytes;
+    last = aligned;
+    refs.fetch_add(1, std::memory_order_relaxed);
+    return aligned;
+  }
+
+  void release(void *ptr) {
+    /// 只在拥有者线程上回退, 其他线程只减少计数. 先比较 current():
+    /// retired 只由拥有者线程写, 其他线程读它会构成数据竞争
+    if (current() == this && !retired && ptr == last) {
+      void **h = detail::header(ptr);
+      char *prevTop = static_cast<char *>(h[-1]);
+      if (prevTop >= blockBegin && prevTop <= end) {
+        top = prevTop;
+        last = h[-3];
+      }
+    }
+    unref();
+  }
+
+  /// 已向系统申请的字节数
+  std::size_t bytes_reserved() const {
+    return reserved;
+  }
+
+  /// 尚未释放的缓冲区个数
+  long live_allocations() const {
+    return refs.load() - (retired ? 0 : 1);
+  }
+};
+
+/// 在当前线程上启用一个 arena: 作用域内 Vector/Matrix 等的缓冲区都从 arena 分配,
+/// 作用域结束时一次性归还. 可以嵌套, 内层作用域结束后恢复外层 arena.
+/// 只影响本线程, 线程池里的工作线程仍使用堆
+class ArenaScope {
+private:
+  Arena *arena;
+  Arena *prev;
+
+public:
+  explicit ArenaScope(std::size_t blockBytes = 1 << 20)
+      : arena(new Arena(blockBytes)), prev(Arena::current()) {
+    Arena::current() = arena;
+  }
+
+  ~ArenaScope() {
+    Arena::current() = prev;
+    arena->retired = true;
+    arena->unref();
+  }
+
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+
+  Arena &get() {
+    return *arena;
+  }
+};
+
+namespace detail {
+
+/// 分配 bytes 字节的对齐堆内存
+inline void *aligned_malloc(std::size_t bytes) {
+
+  void *raw = std::malloc(bytes + kAlignment + kHeader);
+  if (!raw)
+    throw std::bad_alloc();
+
+  void *aligned = align_up(raw, kHeader);
+  header(aligned)[-1] = raw;
+  header(aligned)[-2] = nullptr;
+  return aligned;
+}
+
+/// 释放 aligned_malloc 或 arena 分配的内存
+inline void aligned_free(void *ptr) {
+  if (!ptr)
+    return;
+  Arena *owner = static_cast<Arena *>(header(ptr)[-2]);
+  if (owner)
+    owner->release(ptr);
+  else
+    std::free(header(ptr)[-1]);
+}
+
+/// 分配 n 个元素的对齐缓冲区(未初始化); 当前线程有 arena 时从 arena 分配
+template <typename E>
+E *allocate(std::size_t n) {
+  static_assert(std::is_trivially_copyable<E>::value &&
+                std::is_trivially_destructible<E>::value,
+                "element type must be trivially copyable");
+  std::size_t bytes = (n ? n : 1) * sizeof(E);
+  LA_COUNT_ALLOC(bytes);
+  Arena *arena = Arena::current();
+  return static_cast<E *>(arena ? arena->allocate(bytes) : aligned_malloc(bytes));
+}
+
+template <typename E>
+void deallocate(E *ptr) {
+  aligned_free(const_cast<typename std::remove_const<E>::type *>(ptr));
+}
+
+/// 行首按 kAlignment 对齐所需的 leading dimension
+template <typename E>
+int aligned_ld(int col) {
+  if (kAlignment % sizeof(E) != 0)
+    return col;
+  int step = (int)(kAlignment / sizeof(E));
+  return (col + step - 1) / step * step;
+}
+}
+}
+
+#endif // LA_MEMORY_H
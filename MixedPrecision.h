@@ -0,0 +1,196 @@
+/**********************************
+ * File:     MixedPrecision.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/6
+ ***********************************/
+
+#ifndef LA_MIXEDPRECISION_H
+#define LA_MIXEDPRECISION_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "LU.h"
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+struct RefinementOptions {
+  /// 迭代精化的最多步数
+  int maxIterations = 30;
+  /// 残差每步至少要缩小到上一步的这个比例, 连续两步做不到视为停滞
+  double stallRatio = 0.5;
+};
+
+struct RefinementResult {
+  /// 是否达到高精度的收敛判据 (回退到高精度分解时也为 true)
+  bool converged = false;
+  /// 是否回退到了高精度 LU
+  bool fellBack = false;
+  int iterations = 0;
+  /// 最终的向后误差 ||b - A x||_inf / (||A||_inf ||x||_inf)
+  double backwardError = 0;
+};
+
+/// 混合精度 LU 求解: 用低精度 Low 分解 (SIMD 宽度加倍, 带宽减半), 再用高精度
+/// High 计算残差做迭代精化, 得到 High 精度的解.
+///
+/// 收敛判据与 LAPACK 的 dsgesv 相同: ||r|| <= ||x|| ||A|| eps sqrt(n).
+/// 低精度分解失败 (奇异或元素溢出) 或精化停滞时, 自动改用 High 精度的 LU.
+/// 只保存 A 的引用, 求解期间 A 必须有效且不变.
+template <typename High = double, typename Low = float>
+class MixedPrecisionLU {
+private:
+  const Matrix<High> &A;
+  RefinementOptions opts;
+  std::unique_ptr<LU<Low>> low;
+  std::unique_ptr<LU<High>> high;
+  High anorm;
+
+  /// 低精度无法表示时返回 false
+  static bool demote(const Matrix<High> &src, Matrix<Low> &dst) {
+    High limit = (High)std::numeric_limits<Low>::max();
+    for (int i = 0; i < src.row_num(); ++i) {
+      const High *s = src.row_ptr(i);
+      Low *d = dst.row_ptr(i);
+      for (int j = 0; j < src.col_num(); ++j) {
+        if (!(std::abs(s[j]) <= limit))
+          return false;
+        d[j] = (Low)s[j];
+      }
+    }
+    return true;
+  }
+
+  static High norm_inf(const High *x, int n) {
+    High m = 0;
+    for (int i = 0; i < n; ++i)
+      m = std::max(m, std::abs(x[i]));
+    return m;
+  }
+
+  void fall_back() {
+    if (!high)
+      high.reset(new LU<High>(A));
+  }
+
+  /// 用低精度分解求 A d = r, r 先舍入到 Low
+  void low_solve(const High *r, High *d, std::vector<Low> &w) const {
+    int n = A.row_num();
+    for (int i = 0; i < n; ++i)
+      w[i] = (Low)r[i];
+    low->solve_in_place(w.data());
+    for (int i = 0; i < n; ++i)
+      d[i] = (High)w[i];
+  }
+
+public:
+  explicit MixedPrecisionLU(const Matrix<High> &A, RefinementOptions opts = RefinementOptions())
+      : A(A), opts(opts), anorm(0) {
+    assert(A.row_num() == A.col_num() && "LU requires a square matrix");
+    int n = A.row_num();
+    for (int i = 0; i < n; ++i) {
+      const High *a = A.row_ptr(i);
+      High s = 0;
+      for (int j = 0; j < n; ++j)
+        s += std::abs(a[j]);
+      anorm = std::max(anorm, s);
+    }
+
+    Matrix<Low> a(n, n);
+    if (demote(A, a)) {
+      low.reset(new LU<Low>(a));
+      if (low->is_singular())
+        low.reset();
+    }
+    if (!low)
+      fall_back();
+  }
+
+  int size() const {
+    return A.row_num();
+  }
+
+  /// 是否已经改用高精度分解
+  bool uses_fallback() const {
+    return high != nullptr;
+  }
+
+  /// 矩阵在高精度下也奇异时无法求解
+  bool is_singular() const {
+    return high && high->is_singular();
+  }
+
+  /// 求解 A x = b
+  Vector<High> solve(const Vector<High> &b, RefinementResult *info = nullptr) {
+    int n = A.row_num();
+    assert(b.size() == n);
+    LA_OP_SCOPE("MixedPrecisionLU::solve", n, n, 0, 0, (double)n * n * sizeof(High));
+
+    RefinementResult res;
+    const High eps = std::numeric_limits<High>::epsilon();
+    const High cte = anorm * eps * std::sqrt((High)n);
+    Vector<High> x(b);
+
+    if (!high) {
+      std::vector<Low> w(n);
+      std::vector<High> d(n);
+      low_solve(b.data(), x.data(), w);
+
+      High prev = std::numeric_limits<High>::infinity();
+      int stalls = 0;
+      for (int it = 0; it <= opts.maxIterations; ++it) {
+        /// r = b - A x, 全程高精度
+        Vector<High> r = A.dot(x);
+        simd::sub(n, b.data(), r.data(), r.data());
+        High rnorm = norm_inf(r.data(), n), xnorm = norm_inf(x.data(), n);
+        res.iterations = it;
+        res.backwardError = anorm * xnorm > 0 ? rnorm / (anorm * xnorm) : rnorm;
+
+        if (!(rnorm == rnorm) || !(xnorm == xnorm))
+          break;
+        if (rnorm <= xnorm * cte) {
+          res.converged = true;
+          break;
+        }
+        stalls = rnorm > opts.stallRatio * prev ? stalls + 1 : 0;
+        if (stalls >= 2)
+          break;
+        prev = rnorm;
+
+        low_solve(r.data(), d.data(), w);
+        simd::axpy(n, High(1), d.data(), x.data());
+      }
+    }
+
+    if (!res.converged) {
+      fall_back();
+      res.fellBack = true;
+      if (!high->is_singular()) {
+        x = b;
+        high->solve_in_place(x.data());
+        Vector<High> r = A.dot(x);
+        simd::sub(n, b.data(), r.data(), r.data());
+        High xnorm = norm_inf(x.data(), n);
+        res.backwardError = norm_inf(r.data(), n) / (anorm * xnorm > 0 ? anorm * xnorm : High(1));
+        res.converged = true;
+      }
+    }
+
+    if (info)
+      *info = res;
+    return x;
+  }
+};
+}
+
+#endif // LA_MIXEDPRECISION_H
@@ -0,0 +1,721 @@
+/**********************************
+ * File:     OutOfCore.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/3
+ ***********************************/
+
+#ifndef LA_OUTOFCORE_H
+#define LA_OUTOFCORE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "MatrixIO.h"
+#include "Gemm.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace LinearAlgebra {
+
+namespace detail {
+
+/// 后台 I/O 线程. 只有一个线程, 按提交顺序执行, 所以对同一个文件的
+/// 写和随后的读不会乱序; 计算线程在此期间继续工作
+class IOQueue {
+private:
+  std::thread worker;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping;
+
+  void loop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+        if (tasks.empty())
+          return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  IOQueue() : stopping(false) {
+    worker = std::thread([this]() { loop(); });
+  }
+
+  ~IOQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_all();
+    worker.join();
+  }
+
+  static IOQueue &instance() {
+    static IOQueue queue;
+    return queue;
+  }
+
+  template <typename R>
+  std::shared_future<R> submit(std::function<R()> fn) {
+    std::shared_ptr<std::packaged_task<R()>> task =
+        std::make_shared<std::packaged_task<R()>>(std::move(fn));
+    std::shared_future<R> fut = task->get_future().share();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back([task]() { (*task)(); });
+    }
+    cv.notify_one();
+    return fut;
+  }
+};
+
+inline void make_dir(const std::string &dir) {
+#if defined(_WIN32)
+  _mkdir(dir.c_str());
+#else
+  ::mkdir(dir.c_str(), 0755);
+#endif
+}
+
+inline bool file_exists(const std::string &path) {
+  std::FILE *fp = std::fopen(path.c_str(), "rb");
+  if (fp)
+    std::fclose(fp);
+  return fp != nullptr;
+}
+}
+
+/// 外存计算的参数
+struct OutOfCoreOptions {
+  /// 所有常驻 tile 的内存上限 (字节)
+  std::size_t memoryBudget = (std::size_t)1 << 30;
+};
+
+/// 按 tile 存放在磁盘目录里的矩阵, 每个 tile 是一个 MatrixIO 格式的文件
+///
+/// tile 按需从磁盘读入, 放在一个按 LRU 淘汰的缓存里; 缓存总量超过预算时,
+/// 淘汰最久未用的 tile, 修改过的 tile 先在后台写回. prefetch 在 I/O 线程上
+/// 提前读入, 与计算重叠. 不存在的 tile 文件视为全零. 不是线程安全的.
+template <typename E>
+class TiledMatrix {
+public:
+  typedef std::shared_ptr<Matrix<E>> Tile;
+
+private:
+  struct Entry {
+    std::shared_future<Tile> data;
+    bool dirty;
+    std::list<long long>::iterator pos;
+  };
+
+  struct Pending {
+    std::shared_future<bool> done;
+    Tile data;
+  };
+
+  std::string dir;
+  int row, col, ts;
+  std::size_t budget;
+  std::size_t bytes;
+  std::map<long long, Entry> cache;
+  /// 同一个 tile 可能有几次写回在路上, 相同键按提交顺序排列
+  std::multimap<long long, Pending> writing;
+  /// 最近使用的在队尾
+  std::list<long long> lru;
+
+  long long key(int bi, int bj) const {
+    return (long long)bi * tile_cols() + bj;
+  }
+
+  std::size_t tile_bytes(int bi, int bj) const {
+    return (std::size_t)rows_in(bi) * cols_in(bj) * sizeof(E);
+  }
+
+  std::string tile_path(int bi, int bj) const {
+    return dir + "/tile_" + std::to_string(bi) + "_" + std::to_string(bj) + ".lamx";
+  }
+
+  void write_meta() const {
+    std::ofstream out(dir + "/meta.txt");
+    out << "LAOOC 1 " << io::DType<E>::code << " " << row << " " << col << " " << ts << "\n";
+    if (!out)
+      throw IOError("cannot write " + dir + "/meta.txt");
+  }
+
+  void touch(Entry &e, long long k) {
+    lru.erase(e.pos);
+    e.pos = lru.insert(lru.end(), k);
+  }
+
+  static std::size_t pending_bytes(const Pending &p) {
+    return (std::size_t)p.data->row_num() * p.data->col_num() * sizeof(E);
+  }
+
+  /// 等待一次写回, 成功时返回空
+  static std::exception_ptr write_error(const std::shared_future<bool> &done) {
+    try {
+      done.get();
+    } catch (...) {
+      return std::current_exception();
+    }
+    return nullptr;
+  }
+
+  /// 回收已成功完成的写回, 失败的留给 flush 报告
+  void reap() {
+    for (auto it = writing.begin(); it != writing.end();) {
+      if (it->second.done.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+          !write_error(it->second.done)) {
+        bytes -= pending_bytes(it->second);
+        it = writing.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  /// 等待 tile k 所有在路上的写回, 返回最后一次写出的数据 (没有则为空).
+  /// 最后一次写回失败时 *failed 为 true, 数据仍然只在内存里
+  Tile take_pending(long long k, bool *failed) {
+    Tile latest;
+    *failed = false;
+    auto range = writing.equal_range(k);
+    for (auto it = range.first; it != range.second; ++it) {
+      *failed = (bool)write_error(it->second.done);
+      bytes -= pending_bytes(it->second);
+      latest = it->second.data;
+    }
+    writing.erase(range.first, range.second);
+    return latest;
+  }
+
+  std::shared_future<bool> write_async(int bi, int bj, Tile t) {
+    std::string path = tile_path(bi, bj);
+    return detail::IOQueue::instance().submit<bool>([path, t]() {
+      io::save(path, *t);
+      return true;
+    });
+  }
+
+  /// 超出预算时从 LRU 队首淘汰没有在用的 tile. tile keep 是正在取的, 不淘汰;
+  /// 其余 tile 都在用时宁可超出预算
+  void evict(long long keep = -1) {
+    reap();
+    for (auto it = lru.begin(); it != lru.end() && bytes > budget;) {
+      long long k = *it;
+      Entry &e = cache[k];
+      if (k == keep || e.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+          e.data.get().use_count() > 1) {
+        ++it;
+        continue;
+      }
+      int bi = (int)(k / tile_cols()), bj = (int)(k % tile_cols());
+      Tile t = e.data.get();
+      if (e.dirty) {
+        /// 写回完成前内存仍然计入预算
+        writing.emplace(k, Pending{write_async(bi, bj, t), t});
+      } else {
+        bytes -= tile_bytes(bi, bj);
+      }
+      it = lru.erase(it);
+      cache.erase(k);
+    }
+  }
+
+  Entry &insert(long long k, std::shared_future<Tile> data, bool dirty, std::size_t size) {
+    Entry &e = cache[k];
+    e.data = data;
+    e.dirty = dirty;
+    e.pos = lru.insert(lru.end(), k);
+    bytes += size;
+    return e;
+  }
+
+public:
+  /// 打开目录里已有的矩阵
+  explicit TiledMatrix(const std::string &dir, OutOfCoreOptions opts = OutOfCoreOptions())
+      : dir(dir), row(0), col(0), ts(0), budget(opts.memoryBudget), bytes(0) {
+    std::ifstream in(dir + "/meta.txt");
+    std::string magic;
+    int version = 0;
+    unsigned dtype = 0;
+    in >> magic >> version >> dtype >> row >> col >> ts;
+    if (!in || magic != "LAOOC")
+      throw IOError(dir + ": not a tiled matrix");
+    if (dtype != io::DType<E>::code)
+      throw IOError(dir + ": element type mismatch");
+  }
+
+  /// 在目录 dir 里新建 rows x cols 的零矩阵, tile 为 tile x tile
+  TiledMatrix(const std::string &dir, int rows, int cols, int tile,
+              OutOfCoreOptions opts = OutOfCoreOptions())
+      : dir(dir), row(rows), col(cols), ts(tile), budget(opts.memoryBudget), bytes(0) {
+    assert(rows > 0 && cols > 0 && tile > 0);
+    detail::make_dir(dir);
+    for (int bi = 0; bi < tile_rows(); ++bi)
+      for (int bj = 0; bj < tile_cols(); ++bj)
+        std::remove(tile_path(bi, bj).c_str());
+    write_meta();
+  }
+
+  ~TiledMatrix() {
+    try {
+      flush();
+    } catch (...) {
+    }
+  }
+
+  TiledMatrix(const TiledMatrix &) = delete;
+  TiledMatrix &operator=(const TiledMatrix &) = delete;
+
+  int row_num() const {
+    return row;
+  }
+
+  int col_num() const {
+    return col;
+  }
+
+  int tile_size() const {
+    return ts;
+  }
+
+  /// tile 的行数和列数
+  int tile_rows() const {
+    return (row + ts - 1) / ts;
+  }
+
+  int tile_cols() const {
+    return (col + ts - 1) / ts;
+  }
+
+  /// 第 bi 行 tile 的实际行数 (最后一行可能不满)
+  int rows_in(int bi) const {
+    return std::min(ts, row - bi * ts);
+  }
+
+  int cols_in(int bj) const {
+    return std::min(ts, col - bj * ts);
+  }
+
+  void set_budget(std::size_t b) {
+    budget = b;
+    evict();
+  }
+
+  std::size_t budget_bytes() const {
+    return budget;
+  }
+
+  /// 当前常驻 (含正在写回) 的字节数
+  std::size_t resident_bytes() const {
+    return bytes;
+  }
+
+  /// 在后台读入 tile (bi, bj), 不等待
+  void prefetch(int bi, int bj) {
+    long long k = key(bi, bj);
+    auto it = cache.find(k);
+    if (it != cache.end()) {
+      touch(it->second, k);
+      return;
+    }
+
+    if (writing.count(k)) {
+      /// 正在写回: 内存里的数据就是最新的, 等写完后直接复用; 写失败了就仍是脏的
+      bool failed;
+      std::promise<Tile> p;
+      p.set_value(take_pending(k, &failed));
+      insert(k, p.get_future().share(), failed, tile_bytes(bi, bj));
+      evict(k);
+      return;
+    }
+
+    std::string path = tile_path(bi, bj);
+    int r = rows_in(bi), c = cols_in(bj);
+    std::shared_future<Tile> fut = detail::IOQueue::instance().submit<Tile>([path, r, c]() {
+      if (!detail::file_exists(path))
+        return std::make_shared<Matrix<E>>(r, c);
+      return std::make_shared<Matrix<E>>(io::load_matrix<E>(path));
+    });
+    insert(k, fut, false, tile_bytes(bi, bj));
+    evict(k);
+  }
+
+  /// 取得 tile (bi, bj), 必要时等待读入. 返回的指针存活期间该 tile 不会被淘汰
+  Tile tile(int bi, int bj) {
+    prefetch(bi, bj);
+    auto it = cache.find(key(bi, bj));
+    assert(it != cache.end());
+    return it->second.data.get();
+  }
+
+  /// 取得一个全零的 tile, 不读磁盘 (用于将被完全覆盖的输出)
+  Tile zero_tile(int bi, int bj) {
+    long long k = key(bi, bj);
+    auto it = cache.find(k);
+    bool failed;
+    take_pending(k, &failed);
+    Tile t = std::make_shared<Matrix<E>>(rows_in(bi), cols_in(bj));
+    std::promise<Tile> p;
+    p.set_value(t);
+    if (it != cache.end()) {
+      it->second.data = p.get_future().share();
+      it->second.dirty = true;
+      touch(it->second, k);
+    } else {
+      insert(k, p.get_future().share(), true, tile_bytes(bi, bj));
+    }
+    evict(k);
+    return t;
+  }
+
+  /// 标记 tile 已修改, 淘汰或 flush 时写回
+  void mark_dirty(int bi, int bj) {
+    auto it = cache.find(key(bi, bj));
+    assert(it != cache.end() && "tile is not resident");
+    it->second.dirty = true;
+  }
+
+  /// 立即在后台写回 tile 的快照, 之后它仍然常驻 (干净的 tile 可以随时淘汰).
+  /// 写的是副本, 调用者可以接着修改这个 tile
+  void write_behind(int bi, int bj) {
+    long long k = key(bi, bj);
+    auto it = cache.find(k);
+    if (it == cache.end() || !it->second.dirty)
+      return;
+    Tile snapshot = std::make_shared<Matrix<E>>(*it->second.data.get());
+    writing.emplace(k, Pending{write_async(bi, bj, snapshot), snapshot});
+    bytes += tile_bytes(bi, bj);
+    it->second.dirty = false;
+    evict();
+  }
+
+  /// 写回所有修改过的 tile 并等待完成, 之前任何一次写回失败都在这里抛出
+  void flush() {
+    for (auto &kv : cache) {
+      if (kv.second.dirty) {
+        int bi = (int)(kv.first / tile_cols()), bj = (int)(kv.first % tile_cols());
+        Tile t = kv.second.data.get();
+        writing.emplace(kv.first, Pending{write_async(bi, bj, t), t});
+        bytes += tile_bytes(bi, bj);
+        kv.second.dirty = false;
+      }
+    }
+    std::exception_ptr err;
+    for (auto &kv : writing) {
+      std::exception_ptr e = write_error(kv.second.done);
+      if (e && !err)
+        err = e;
+      bytes -= pending_bytes(kv.second);
+    }
+    writing.clear();
+    if (err)
+      std::rethrow_exception(err);
+  }
+
+  /// 把整个稠密矩阵切成 tile 写入
+  void assign(const Matrix<E> &A) {
+    assert(A.row_num() == row && A.col_num() == col);
+    for (int bi = 0; bi < tile_rows(); ++bi) {
+      for (int bj = 0; bj < tile_cols(); ++bj) {
+        Tile t = zero_tile(bi, bj);
+        for (int i = 0; i < rows_in(bi); ++i) {
+          const E *src = A.row_ptr(bi * ts + i) + bj * ts;
+          std::copy(src, src + cols_in(bj), t->row_ptr(i));
+        }
+        write_behind(bi, bj);
+      }
+    }
+    flush();
+  }
+
+  /// 读回整个矩阵 (需要能放进内存)
+  Matrix<E> load() {
+    Matrix<E> A(row, col);
+    for (int bi = 0; bi < tile_rows(); ++bi) {
+      for (int bj = 0; bj < tile_cols(); ++bj) {
+        if (bj + 1 < tile_cols())
+          prefetch(bi, bj + 1);
+        Tile t = tile(bi, bj);
+        for (int i = 0; i < rows_in(bi); ++i)
+          std::copy(t->row_ptr(i), t->row_ptr(i) + cols_in(bj), A.row_ptr(bi * ts + i) + bj * ts);
+      }
+    }
+    return A;
+  }
+};
+
+namespace ooc {
+
+/// C = alpha * A * B + beta * C, 三个矩阵的 tile 大小必须相同.
+/// 逐个 C tile 累加 A 的一行 tile 与 B 的一列 tile, 计算当前 tile 对时
+/// 后台已经在读下一对, C tile 完成后立即在后台写回
+template <typename E>
+void gemm(E alpha, TiledMatrix<E> &A, TiledMatrix<E> &B, E beta, TiledMatrix<E> &C) {
+  assert(A.col_num() == B.row_num() && A.row_num() == C.row_num() && B.col_num() == C.col_num());
+  assert(A.tile_size() == B.tile_size() && A.tile_size() == C.tile_size());
+  LA_OP_SCOPE("ooc::gemm", C.row_num(), C.col_num(), A.col_num(),
+              2.0 * C.row_num() * C.col_num() * A.col_num(), 0);
+
+  int mt = C.tile_rows(), nt = C.tile_cols(), kt = A.tile_cols();
+
+  /// 按执行顺序排列的 (i, j, p) 步骤, 第 s 步时预取第 s + 1 步的 tile
+  std::vector<std::tuple<int, int, int>> steps;
+  for (int i = 0; i < mt; ++i)
+    for (int j = 0; j < nt; ++j)
+      for (int p = 0; p < kt; ++p)
+        steps.emplace_back(i, j, p);
+
+  typename TiledMatrix<E>::Tile c;
+  for (std::size_t s = 0; s < steps.size(); ++s) {
+    int i, j, p;
+    std::tie(i, j, p) = steps[s];
+    if (s + 1 < steps.size()) {
+      A.prefetch(std::get<0>(steps[s + 1]), std::get<2>(steps[s + 1]));
+      B.prefetch(std::get<2>(steps[s + 1]), std::get<1>(steps[s + 1]));
+    }
+
+    if (p == 0) {
+      c = beta == E(0) ? C.zero_tile(i, j) : C.tile(i, j);
+      C.mark_dirty(i, j);
+    }
+
+    typename TiledMatrix<E>::Tile a = A.tile(i, p), b = B.tile(p, j);
+    blas::gemm(a->row_num(), b->col_num(), a->col_num(), alpha, a->data(), a->leading_dim(),
+               b->data(), b->leading_dim(), p == 0 ? beta : E(1), c->data(), c->leading_dim());
+
+    if (p == kt - 1) {
+      c.reset();
+      C.write_behind(i, j);
+    }
+  }
+  C.flush();
+}
+
+/// 外存 LU 的结果: ipiv[c] 是第 c 步与第 c 行交换的行 (LAPACK 的约定)
+struct OutOfCoreLU {
+  std::vector<int> ipiv;
+  bool singular = false;
+};
+
+namespace detail {
+
+/// 同一列 tile 里第 r 行 (全局行号) 的指针
+template <typename E>
+E *tile_row(std::vector<typename TiledMatrix<E>::Tile> &col, int first, int ts, int r) {
+  return col[r / ts - first]->row_ptr(r % ts);
+}
+}
+
+/// 原地外存 LU 分解 (分块右视, 部分选主元), A 被 L\U 覆盖.
+///
+/// 每一步把第 k 列 tile 作为面板读入并分解, 再逐列更新右侧的 tile 列:
+/// 行交换, 三角求解得到 U 的一行 tile, 以及 GEMM 更新下方的 tile.
+/// 处理第 j 列时后台预取第 j + 1 列. 行交换不作用于左侧已完成的列,
+/// 所以分解结果必须配合 lu_solve 使用. 内存中同时需要约三列 tile.
+/// 奇异判定与 LU 相同 (相对 max|A_ij|), 为此分解前先把矩阵读一遍
+template <typename E>
+OutOfCoreLU lu(TiledMatrix<E> &A) {
+  assert(A.row_num() == A.col_num() && A.tile_rows() == A.tile_cols());
+  LA_OP_SCOPE("ooc::lu", A.row_num(), A.col_num(), 0,
+              2.0 * A.row_num() * A.row_num() * A.row_num() / 3, 0);
+
+  typedef typename TiledMatrix<E>::Tile Tile;
+  int n = A.row_num(), nt = A.tile_rows(), ts = A.tile_size();
+  OutOfCoreLU res;
+  res.ipiv.resize(n);
+
+  /// 从最后一列扫到第 0 列, 扫完时第一个面板多半还在内存里
+  E amax = 0;
+  for (int j = nt - 1; j >= 0; --j)
+    for (int i = 0; i < nt; ++i) {
+      Tile t = A.tile(i, j);
+      amax = std::max(amax, LinearAlgebra::detail::max_abs(t->row_num(), t->col_num(), t->data(),
+                                                           t->leading_dim()));
+    }
+  const E pivotTol = E(kPivotTolerance) * amax;
+
+  for (int k = 0; k < nt; ++k) {
+    int k0 = k * ts, kw = A.cols_in(k);
+
+    std::vector<Tile> panel;
+    for (int i = k; i < nt; ++i)
+      A.prefetch(i, k);
+    for (int i = k; i < nt; ++i)
+      panel.push_back(A.tile(i, k));
+    auto prow = [&](int r) { return detail::tile_row<E>(panel, k, ts, r); };
+
+    /// 面板分解
+    for (int c = 0; c < kw; ++c) {
+      int gc = k0 + c;
+      int p = gc;
+      E maxVal = std::abs(prow(gc)[c]);
+      for (int r = gc + 1; r < n; ++r) {
+        E v = std::abs(prow(r)[c]);
+        if (v > maxVal) {
+          maxVal = v;
+          p = r;
+        }
+      }
+      res.ipiv[gc] = p;
+      if (p != gc)
+        std::swap_ranges(prow(gc), prow(gc) + kw, prow(p));
+
+      E pivot = prow(gc)[c];
+      if (!(std::abs(pivot) > pivotTol)) {
+        res.singular = true;
+        continue;
+      }
+
+      const E *prowc = prow(gc);
+      Parallel::for_range(gc + 1, n, 64, (long long)(n - gc) * (kw - c), [&](int lo, int hi) {
+        for (int r = lo; r < hi; ++r) {
+          E *row = prow(r);
+          row[c] /= pivot;
+          simd::axpy(kw - c - 1, E(-row[c]), prowc + c + 1, row + c + 1);
+        }
+      });
+    }
+    for (int i = k; i < nt; ++i)
+      A.mark_dirty(i, k);
+
+    /// 右侧每一列 tile
+    for (int j = k + 1; j < nt; ++j) {
+      if (j + 1 < nt)
+        for (int i = k; i < nt; ++i)
+          A.prefetch(i, j + 1);
+
+      std::vector<Tile> colj;
+      for (int i = k; i < nt; ++i)
+        colj.push_back(A.tile(i, j));
+      auto crow = [&](int r) { return detail::tile_row<E>(colj, k, ts, r); };
+      int w = A.cols_in(j);
+
+      for (int c = 0; c < kw; ++c)
+        if (res.ipiv[k0 + c] != k0 + c)
+          std::swap_ranges(crow(k0 + c), crow(k0 + c) + w, crow(res.ipiv[k0 + c]));
+
+      /// U(k, j) = L(k, k)^-1 * A(k, j)
+      const Matrix<E> &lkk = *panel[0];
+      Matrix<E> &ukj = *colj[0];
+      for (int r = 1; r < kw; ++r) {
+        const E *l = lkk.row_ptr(r);
+        E *u = ukj.row_ptr(r);
+        for (int c = 0; c < r; ++c)
+          simd::axpy(w, E(-l[c]), ukj.row_ptr(c), u);
+      }
+
+      /// A(i, j) -= L(i, k) * U(k, j)
+      for (int i = k + 1; i < nt; ++i) {
+        const Matrix<E> &lik = *panel[i - k];
+        Matrix<E> &aij = *colj[i - k];
+        blas::gemm(lik.row_num(), w, kw, E(-1), lik.data(), lik.leading_dim(), ukj.data(),
+                   ukj.leading_dim(), E(1), aij.data(), aij.leading_dim());
+      }
+
+      for (int i = k; i < nt; ++i) {
+        A.mark_dirty(i, j);
+        /// 下一步还会用到第 k + 1 列, 其余列先在后台写回, 淘汰时不用再等
+        if (j != k + 1)
+          A.write_behind(i, j);
+      }
+    }
+
+    panel.clear();
+    for (int i = k; i < nt; ++i)
+      A.write_behind(i, k);
+  }
+  A.flush();
+  return res;
+}
+
+/// 用 lu 的结果求解 A x = b, b 在内存里
+template <typename E>
+Vector<E> lu_solve(TiledMatrix<E> &LU, const OutOfCoreLU &f, const Vector<E> &b) {
+  assert(!f.singular && "matrix is singular");
+  int n = LU.row_num(), nt = LU.tile_rows(), ts = LU.tile_size();
+  assert(b.size() == n);
+
+  Vector<E> x(b);
+  E *xp = x.data();
+
+  /// 前代: 按步骤交换, 再用第 k 列 tile 的 L 消元
+  for (int k = 0; k < nt; ++k) {
+    int k0 = k * ts, kw = LU.cols_in(k);
+    for (int c = 0; c < kw; ++c)
+      std::swap(xp[k0 + c], xp[f.ipiv[k0 + c]]);
+    for (int i = k; i < nt; ++i)
+      LU.prefetch(i, k);
+
+    typename TiledMatrix<E>::Tile d = LU.tile(k, k);
+    for (int r = 1; r < kw; ++r)
+      xp[k0 + r] -= simd::dot(d->row_ptr(r), xp + k0, r);
+    d.reset();
+
+    for (int i = k + 1; i < nt; ++i) {
+      typename TiledMatrix<E>::Tile l = LU.tile(i, k);
+      for (int r = 0; r < l->row_num(); ++r)
+        xp[i * ts + r] -= simd::dot(l->row_ptr(r), xp + k0, kw);
+    }
+  }
+
+  /// 回代: 第 k 行 tile 先减去右侧已求出的部分, 再解对角 tile
+  for (int k = nt - 1; k >= 0; --k) {
+    int k0 = k * ts, kw = LU.rows_in(k);
+    for (int j = k; j < nt; ++j)
+      LU.prefetch(k, j);
+    for (int j = k + 1; j < nt; ++j) {
+      typename TiledMatrix<E>::Tile u = LU.tile(k, j);
+      for (int r = 0; r < kw; ++r)
+        xp[k0 + r] -= simd::dot(u->row_ptr(r), xp + j * ts, u->col_num());
+    }
+    typename TiledMatrix<E>::Tile d = LU.tile(k, k);
+    for (int r = kw - 1; r >= 0; --r) {
+      const E *row = d->row_ptr(r);
+      xp[k0 + r] = (xp[k0 + r] - simd::dot(row + r + 1, xp + k0 + r + 1, kw - r - 1)) / row[r];
+    }
+  }
+  return x;
+}
+}
+}
+
+#endif // LA_OUTOFCORE_H
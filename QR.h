@@ -0,0 +1,310 @@
+/**********************************
+ * File:     QR.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/30
+ ***********************************/
+
+#ifndef LA_QR_H
+#define LA_QR_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "Gemm.h"
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+/// Householder QR 分解: A = Q * R, A 为 m x n 且 m >= n
+///
+/// 原地分解: R 存在上三角, Householder 向量 v (首元素隐含为 1) 存在对角线以下.
+/// 按 NB 列分块, 每块的反射累积成紧凑 WY 形式 Q_k = I - Y T Y^T,
+/// 尾部更新和 Q 的应用都是 GEMM.
+template <typename E>
+class QR {
+private:
+  Matrix<E> qr;
+  std::vector<E> tau;
+  /// 每个列块的上三角因子 T
+  std::vector<Matrix<E>> Ts;
+  bool fullRank;
+
+  static constexpr int NB = 32;
+
+  /// 对列 [k, k + nb) 做非分块 Householder, 只更新块内的列
+  void factor_panel(int k, int nb) {
+    int m = qr.row_num();
+    int end = k + nb;
+    std::vector<E> w(nb);
+    std::mutex mtx;
+
+    for (int j = k; j < end; ++j) {
+      E alpha = qr(j, j);
+      E sigma = 0;
+      for (int i = j + 1; i < m; ++i)
+        sigma += qr(i, j) * qr(i, j);
+
+      if (sigma == E(0)) {
+        tau[j] = 0;
+        continue;
+      }
+
+      E norm = std::sqrt(alpha * alpha + sigma);
+      E beta = alpha <= E(0) ? norm : -norm;
+      tau[j] = (beta - alpha) / beta;
+      E s = E(1) / (alpha - beta);
+      for (int i = j + 1; i < m; ++i)
+        qr(i, j) *= s;
+      qr(j, j) = beta;
+
+      int len = end - j - 1;
+      if (len <= 0)
+        continue;
+
+      /// w = v^T * A[j:m, j+1:end], 按行累加, 各线程先求部分和
+      std::fill(w.begin(), w.begin() + len, E(0));
+      simd::axpy(len, E(1), qr.row_ptr(j) + j + 1, w.data());
+      Parallel::for_range(j + 1, m, 256, (long long)(m - j) * len, [&](int lo, int hi) {
+        std::vector<E> part(len, E(0));
+        for (int i = lo; i < hi; ++i)
+          simd::axpy(len, qr(i, j), qr.row_ptr(i) + j + 1, part.data());
+        std::lock_guard<std::mutex> lock(mtx);
+        simd::axpy(len, E(1), part.data(), w.data());
+      });
+
+      /// A[j:m, j+1:end] -= tau * v * w^T
+      E t = tau[j];
+      simd::axpy(len, E(-t), w.data(), qr.row_ptr(j) + j + 1);
+      Parallel::for_range(j + 1, m, 256, (long long)(m - j) * len, [&](int lo, int hi) {
+        for (int i = lo; i < hi; ++i)
+          simd::axpy(len, E(-t * qr(i, j)), w.data(), qr.row_ptr(i) + j + 1);
+      });
+    }
+  }
+
+  /// 上三角 T, 使 H_k H_{k+1} ... H_{k+nb-1} = I - Y T Y^T.
+  /// Y = [v_k, ..., v_{k+nb-1}] 直接从紧凑存储读取, v_j 的首元素隐含为 1
+  Matrix<E> build_t(int k, int nb) const {
+    int m = qr.row_num();
+    Matrix<E> T(nb, nb);
+    std::vector<E> z(nb);
+    for (int j = 0; j < nb; ++j) {
+      E t = tau[k + j];
+      T(j, j) = t;
+      if (j == 0 || t == E(0))
+        continue;
+
+      /// z = Y[:, 0:j]^T * v_j; 第 i >= j 行的前 j 个元素都在对角线以下
+      std::fill(z.begin(), z.begin() + j, E(0));
+      simd::axpy(j, E(1), qr.row_ptr(k + j) + k, z.data());
+      for (int i = k + j + 1; i < m; ++i)
+        simd::axpy(j, qr(i, k + j), qr.row_ptr(i) + k, z.data());
+
+      /// T[0:j, j] = -tau * T[0:j, 0:j] * z
+      for (int r = 0; r < j; ++r)
+        T(r, j) = -t * simd::dot(T.row_ptr(r) + r, z.data() + r, j - r);
+    }
+    return T;
+  }
+
+  /// 把第 b 个块反射作用到 B 的 [k, m) 行上: trans 为 true 时乘 Q_k^T, 否则乘 Q_k.
+  /// B 的元素 (i, j) 位于 B[i * ldb + j], 共 ncols 列.
+  /// Y 不复制: 下方 (m - k - nb) x nb 部分就是紧凑存储中的原样数据, 直接按 qr 的
+  /// 行距做 GEMM; 顶部 nb x nb 是隐含单位对角的下三角, 单独做一次小的三角修正
+  void apply_block(int b, E *B, int ldb, int ncols, bool trans) const {
+    int m = qr.row_num();
+    int k = b * NB;
+    int nb = std::min(NB, qr.col_num() - k);
+    int below = m - k - nb;
+    int ld = qr.leading_dim();
+    const Matrix<E> &T = Ts[b];
+    const E *Y1 = qr.data() + (std::size_t)k * ld + k;
+    const E *Y2 = Y1 + (std::size_t)nb * ld;
+    E *B1 = B + (std::size_t)k * ldb;
+    E *B2 = B1 + (std::size_t)nb * ldb;
+
+    /// W = Y1^T * B1 + Y2^T * B2
+    Matrix<E> W(nb, ncols);
+    for (int r = 0; r < nb; ++r) {
+      E *wr = W.row_ptr(r);
+      std::copy(B1 + (std::size_t)r * ldb, B1 + (std::size_t)r * ldb + ncols, wr);
+      for (int i = r + 1; i < nb; ++i)
+        simd::axpy(ncols, Y1[(std::size_t)i * ld + r], B1 + (std::size_t)i * ldb, wr);
+    }
+    if (below > 0)
+      blas::gemm(nb, ncols, below, E(1), Y2, 1, ld, B2, ldb, 1,
+                 E(1), W.data(), W.leading_dim(), 1);
+
+    /// W = op(T) * W
+    Matrix<E> TW(nb, ncols);
+    int ldt = T.leading_dim();
+    blas::gemm(nb, ncols, nb, E(1), T.data(), trans ? 1 : ldt, trans ? ldt : 1,
+               W.data(), W.leading_dim(), 1, E(0), TW.data(), TW.leading_dim(), 1);
+
+    /// B -= Y * W
+    if (below > 0)
+      blas::gemm(below, ncols, nb, E(-1), Y2, ld, TW.data(), TW.leading_dim(), E(1), B2, ldb);
+    for (int i = 0; i < nb; ++i) {
+      E *bi = B1 + (std::size_t)i * ldb;
+      simd::axpy(ncols, E(-1), TW.row_ptr(i), bi);
+      for (int r = 0; r < i; ++r)
+        simd::axpy(ncols, E(-Y1[(std::size_t)i * ld + r]), TW.row_ptr(r), bi);
+    }
+  }
+
+  void factor() {
+    int n = qr.col_num();
+    LA_OP_SCOPE("QR::factor", qr.row_num(), n, 0,
+                2.0 * n * n * (qr.row_num() - n / 3.0), (double)qr.row_num() * n * sizeof(E));
+    for (int k = 0; k < n; k += NB) {
+      int nb = std::min(NB, n - k);
+      factor_panel(k, nb);
+
+      Ts.push_back(build_t(k, nb));
+
+      int rest = n - k - nb;
+      if (rest > 0)
+        apply_block((int)Ts.size() - 1, qr.row_ptr(0) + k + nb, qr.leading_dim(), rest, true);
+    }
+
+    /// 对角元相对最大对角元过小时视为秩亏
+    E maxDiag = 0;
+    for (int j = 0; j < n; ++j)
+      maxDiag = std::max(maxDiag, (E)std::abs(qr(j, j)));
+    for (int j = 0; j < n; ++j)
+      if (!(std::abs(qr(j, j)) > maxDiag * 1e-10))
+        fullRank = false;
+  }
+
+public:
+  explicit QR(const Matrix<E> &A) : qr(A), tau(A.col_num()), fullRank(true) {
+    assert(A.row_num() >= A.col_num() && "QR requires rows >= cols");
+    factor();
+  }
+
+  /// 接管 A 的缓冲区原地分解, 不拷贝
+  explicit QR(Matrix<E> &&A) : qr(std::move(A)), tau(qr.col_num()), fullRank(true) {
+    assert(qr.row_num() >= qr.col_num() && "QR requires rows >= cols");
+    factor();
+  }
+
+  /// R 的对角元是否都非零, 秩亏时最小二乘解不唯一
+  bool is_full_rank() const {
+    return fullRank;
+  }
+
+  int row_num() const {
+    return qr.row_num();
+  }
+
+  int col_num() const {
+    return qr.col_num();
+  }
+
+  /// 紧凑存储: R 在上三角, Householder 向量在下三角
+  const Matrix<E> &packed() const {
+    return qr;
+  }
+
+  const std::vector<E> &coeffs() const {
+    return tau;
+  }
+
+  /// n x n 上三角因子 R
+  Matrix<E> matrixR() const {
+    int n = qr.col_num();
+    Matrix<E> R(n, n);
+    for (int i = 0; i < n; ++i)
+      std::copy(qr.row_ptr(i) + i, qr.row_ptr(i) + n, R.row_ptr(i) + i);
+    return R;
+  }
+
+  /// 经济型 Q, m x n, 列正交
+  Matrix<E> matrixQ() const {
+    int m = qr.row_num(), n = qr.col_num();
+    Matrix<E> Q(m, n);
+    for (int i = 0; i < n; ++i)
+      Q(i, i) = E(1);
+    apply_q(Q);
+    return Q;
+  }
+
+  /// B = Q^T * B, B 为 m 行
+  void apply_qt(Matrix<E> &B) const {
+    assert(B.row_num() == qr.row_num());
+    for (int b = 0; b < (int)Ts.size(); ++b)
+      apply_block(b, B.data(), B.leading_dim(), B.col_num(), true);
+  }
+
+  /// B = Q * B, B 为 m 行
+  void apply_q(Matrix<E> &B) const {
+    assert(B.row_num() == qr.row_num());
+    for (int b = (int)Ts.size() - 1; b >= 0; --b)
+      apply_block(b, B.data(), B.leading_dim(), B.col_num(), false);
+  }
+
+  /// 最小二乘解 min ||A x - b||, 返回长度为 n 的 x
+  Vector<E> solve(const Vector<E> &b) const {
+    assert(b.size() == qr.row_num());
+    assert(fullRank && "matrix is rank deficient");
+
+    int n = qr.col_num();
+    Vector<E> y(b);
+    for (int k = 0; k < (int)Ts.size(); ++k)
+      apply_block(k, y.data(), 1, 1, true);
+
+    /// R x = (Q^T b)[0:n]
+    for (int i = n - 1; i >= 0; --i) {
+      const E *r = qr.row_ptr(i);
+      y[i] = (y[i] - simd::dot(r + i + 1, y.data() + i + 1, n - i - 1)) / r[i];
+    }
+    return Vector<E>(y.data(), n);
+  }
+
+  /// 多右端项的最小二乘解, 返回 n x B.col_num()
+  Matrix<E> solve(const Matrix<E> &B) const {
+    assert(B.row_num() == qr.row_num());
+    assert(fullRank && "matrix is rank deficient");
+
+    int n = qr.col_num(), c = B.col_num();
+    Matrix<E> Y(B);
+    apply_qt(Y);
+
+    Matrix<E> X(n, c);
+    for (int i = n - 1; i >= 0; --i) {
+      const E *r = qr.row_ptr(i);
+      E *xi = X.row_ptr(i);
+      std::copy(Y.row_ptr(i), Y.row_ptr(i) + c, xi);
+      for (int j = i + 1; j < n; ++j)
+        if (r[j] != E(0))
+          simd::axpy(c, E(-r[j]), X.row_ptr(j), xi);
+      simd::scale(c, E(1) / r[i], xi, xi);
+    }
+    return X;
+  }
+};
+
+template <typename E>
+constexpr int QR<E>::NB;
+
+/// 最小二乘: 求 x 使 ||A x - b|| 最小, 不构造 A^T A
+template <typename E>
+Vector<E> lstsq(const Matrix<E> &A, const Vector<E> &b) {
+  return QR<E>(A).solve(b);
+}
+
+template <typename E>
+Matrix<E> lstsq(const Matrix<E> &A, const Matrix<E> &B) {
+  return QR<E>(A).solve(B);
+}
+}
+
+#endif // LA_QR_H
@@ -0,0 +1,986 @@
+/**********************************
+ * File:     Simd.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/26
+ ***********************************/
+
+#ifndef LA_SIMD_H
+#define LA_SIMD_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LA_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace LinearAlgebra {
+namespace simd {
+
+/// 向量内核使用的指令集级别, 启动时由 CPUID 选定一次
+enum class Level { Scalar = 0, SSE2 = 1, AVX2 = 2, AVX512 = 3 };
+
+inline const char *level_name(Level level) {
+  switch (level) {
+  case Level::SSE2: return "sse2";
+  case Level::AVX2: return "avx2";
+  case Level::AVX512: return "avx512";
+  default: return "scalar";
+  }
+}
+
+/// 标量实现, 任意元素类型都可用, 也是 SIMD 内核处理尾部的参照
+namespace scalar {
+
+template <typename E>
+E dot(const E *x, const E *y, int n) {
+  E s = 0;
+  for (int i = 0; i < n; ++i)
+    s += x[i] * y[i];
+  return s;
+}
+
+template <typename E>
+E sum_sq(const E *x, int n) {
+  E s = 0;
+  for (int i = 0; i < n; ++i)
+    s += x[i] * x[i];
+  return s;
+}
+
+/// 在 double 中累加的点积: float 的乘积在 double 中是精确的, 整数也不会溢出
+template <typename E>
+double dot_wide(const E *x, const E *y, int n) {
+  double s = 0;
+  for (int i = 0; i < n; ++i)
+    s += (double)x[i] * (double)y[i];
+  return s;
+}
+
+template <typename E>
+double sum_sq_wide(const E *x, int n) {
+  return dot_wide(x, x, n);
+}
+
+template <typename E>
+void axpy(int n, E a, const E *x, E *y) {
+  for (int i = 0; i < n; ++i)
+    y[i] += a * x[i];
+}
+
+template <typename E>
+void scale(int n, E a, const E *x, E *y) {
+  for (int i = 0; i < n; ++i)
+    y[i] = a * x[i];
+}
+
+template <typename E>
+void add(int n, const E *x, const E *y, E *z) {
+  for (int i = 0; i < n; ++i)
+    z[i] = x[i] + y[i];
+}
+
+template <typename E>
+void sub(int n, const E *x, const E *y, E *z) {
+  for (int i = 0; i < n; ++i)
+    z[i] = x[i] - y[i];
+}
+
+/// 平面旋转: x = c x + s y, y = c y - s x (与 BLAS 的 rot 相同)
+template <typename E>
+void rot(int n, E *x, E *y, E c, E s) {
+  for (int i = 0; i < n; ++i) {
+    E a = x[i], b = y[i];
+    x[i] = c * a + s * b;
+    y[i] = c * b - s * a;
+  }
+}
+
+/// B = A^T, A 为 m x n, 行跨度分别为 lda 和 ldb
+template <typename E>
+void transpose(int m, int n, const E *A, int lda, E *B, int ldb) {
+  for (int i = 0; i < m; ++i)
+    for (int j = 0; j < n; ++j)
+      B[(std::size_t)j * ldb + i] = A[(std::size_t)i * lda + j];
+}
+
+/// 矩形区域 [i0, m) x [0, n) 与 [0, i0) x [j0, n) 以外的部分已由微块处理, 这里补齐边缘
+template <typename E>
+void transpose_edges(int m, int n, int i0, int j0, const E *A, int lda, E *B, int ldb) {
+  for (int i = 0; i < i0; ++i)
+    for (int j = j0; j < n; ++j)
+      B[(std::size_t)j * ldb + i] = A[(std::size_t)i * lda + j];
+  for (int i = i0; i < m; ++i)
+    for (int j = 0; j < n; ++j)
+      B[(std::size_t)j * ldb + i] = A[(std::size_t)i * lda + j];
+}
+}
+
+#ifdef LA_SIMD_X86
+
+#define LA_TARGET_SSE2 __attribute__((target("sse2")))
+#define LA_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define LA_TARGET_AVX512 __attribute__((target("avx512f")))
+
+namespace sse2 {
+
+LA_TARGET_SSE2 inline double dot(const double *x, const double *y, int n) {
+  __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+  }
+  s0 = _mm_add_pd(s0, s1);
+  double s = _mm_cvtsd_f64(_mm_add_sd(s0, _mm_unpackhi_pd(s0, s0)));
+  for (; i < n; ++i)
+    s += x[i] * y[i];
+  return s;
+}
+
+LA_TARGET_SSE2 inline float dot(const float *x, const float *y, int n) {
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(y + i + 4)));
+  }
+  s0 = _mm_add_ps(s0, s1);
+  s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+  s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+  float s = _mm_cvtss_f32(s0);
+  for (; i < n; ++i)
+    s += x[i] * y[i];
+  return s;
+}
+
+LA_TARGET_SSE2 inline double sum_sq(const double *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_SSE2 inline float sum_sq(const float *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_SSE2 inline double dot_wide(const double *x, const double *y, int n) {
+  return dot(x, y, n);
+}
+
+/// 每 4 个 float 转换成两组 double 再乘加
+LA_TARGET_SSE2 inline double dot_wide(const float *x, const float *y, int n) {
+  __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_loadu_ps(x + i), b = _mm_loadu_ps(y + i);
+    s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_cvtps_pd(a), _mm_cvtps_pd(b)));
+    s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(a, a)),
+                                   _mm_cvtps_pd(_mm_movehl_ps(b, b))));
+  }
+  s0 = _mm_add_pd(s0, s1);
+  double s = _mm_cvtsd_f64(_mm_add_sd(s0, _mm_unpackhi_pd(s0, s0)));
+  for (; i < n; ++i)
+    s += (double)x[i] * y[i];
+  return s;
+}
+
+LA_TARGET_SSE2 inline double sum_sq_wide(const double *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_SSE2 inline double sum_sq_wide(const float *x, int n) {
+  return dot_wide(x, x, n);
+}
+
+LA_TARGET_SSE2 inline void axpy(int n, double a, const double *x, double *y) {
+  __m128d va = _mm_set1_pd(a);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+  for (; i < n; ++i)
+    y[i] += a * x[i];
+}
+
+LA_TARGET_SSE2 inline void axpy(int n, float a, const float *x, float *y) {
+  __m128 va = _mm_set1_ps(a);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+  for (; i < n; ++i)
+    y[i] += a * x[i];
+}
+
+LA_TARGET_SSE2 inline void scale(int n, double a, const double *x, double *y) {
+  __m128d va = _mm_set1_pd(a);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(y + i, _mm_mul_pd(va, _mm_loadu_pd(x + i)));
+  for (; i < n; ++i)
+    y[i] = a * x[i];
+}
+
+LA_TARGET_SSE2 inline void scale(int n, float a, const float *x, float *y) {
+  __m128 va = _mm_set1_ps(a);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(y + i, _mm_mul_ps(va, _mm_loadu_ps(x + i)));
+  for (; i < n; ++i)
+    y[i] = a * x[i];
+}
+
+LA_TARGET_SSE2 inline void add(int n, const double *x, const double *y, double *z) {
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(z + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] + y[i];
+}
+
+LA_TARGET_SSE2 inline void add(int n, const float *x, const float *y, float *z) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] + y[i];
+}
+
+LA_TARGET_SSE2 inline void sub(int n, const double *x, const double *y, double *z) {
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(z + i, _mm_sub_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] - y[i];
+}
+
+LA_TARGET_SSE2 inline void sub(int n, const float *x, const float *y, float *z) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(z + i, _mm_sub_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] - y[i];
+}
+
+LA_TARGET_SSE2 inline void rot(int n, double *x, double *y, double c, double s) {
+  __m128d vc = _mm_set1_pd(c), vs = _mm_set1_pd(s);
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d a = _mm_loadu_pd(x + i), b = _mm_loadu_pd(y + i);
+    _mm_storeu_pd(x + i, _mm_add_pd(_mm_mul_pd(vc, a), _mm_mul_pd(vs, b)));
+    _mm_storeu_pd(y + i, _mm_sub_pd(_mm_mul_pd(vc, b), _mm_mul_pd(vs, a)));
+  }
+  scalar::rot(n - i, x + i, y + i, c, s);
+}
+
+LA_TARGET_SSE2 inline void rot(int n, float *x, float *y, float c, float s) {
+  __m128 vc = _mm_set1_ps(c), vs = _mm_set1_ps(s);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_loadu_ps(x + i), b = _mm_loadu_ps(y + i);
+    _mm_storeu_ps(x + i, _mm_add_ps(_mm_mul_ps(vc, a), _mm_mul_ps(vs, b)));
+    _mm_storeu_ps(y + i, _mm_sub_ps(_mm_mul_ps(vc, b), _mm_mul_ps(vs, a)));
+  }
+  scalar::rot(n - i, x + i, y + i, c, s);
+}
+
+/// 4x4 微块在寄存器里转置, 边缘交给标量
+LA_TARGET_SSE2 inline void transpose(int m, int n, const float *A, int lda, float *B, int ldb) {
+  int i = 0, j = 0;
+  for (; i + 4 <= m; i += 4) {
+    for (j = 0; j + 4 <= n; j += 4) {
+      const float *a = A + (std::size_t)i * lda + j;
+      __m128 r0 = _mm_loadu_ps(a), r1 = _mm_loadu_ps(a + lda);
+      __m128 r2 = _mm_loadu_ps(a + 2 * lda), r3 = _mm_loadu_ps(a + 3 * lda);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      float *b = B + (std::size_t)j * ldb + i;
+      _mm_storeu_ps(b, r0);
+      _mm_storeu_ps(b + ldb, r1);
+      _mm_storeu_ps(b + 2 * ldb, r2);
+      _mm_storeu_ps(b + 3 * ldb, r3);
+    }
+  }
+  scalar::transpose_edges(m, n, i, n / 4 * 4, A, lda, B, ldb);
+}
+
+LA_TARGET_SSE2 inline void transpose(int m, int n, const double *A, int lda, double *B, int ldb) {
+  int i = 0, j = 0;
+  for (; i + 2 <= m; i += 2) {
+    for (j = 0; j + 2 <= n; j += 2) {
+      const double *a = A + (std::size_t)i * lda + j;
+      __m128d r0 = _mm_loadu_pd(a), r1 = _mm_loadu_pd(a + lda);
+      double *b = B + (std::size_t)j * ldb + i;
+      _mm_storeu_pd(b, _mm_unpacklo_pd(r0, r1));
+      _mm_storeu_pd(b + ldb, _mm_unpackhi_pd(r0, r1));
+    }
+  }
+  scalar::transpose_edges(m, n, i, n / 2 * 2, A, lda, B, ldb);
+}
+}
+
+namespace avx2 {
+
+LA_TARGET_AVX2 inline double hsum(__m256d v) {
+  __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+LA_TARGET_AVX2 inline float hsum(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+/// 四路独立累加器, 掩盖 FMA 的延迟
+LA_TARGET_AVX2 inline double dot(const double *x, const double *y, int n) {
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+    s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4), s1);
+    s2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8), s2);
+    s3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12), s3);
+  }
+  for (; i + 4 <= n; i += 4)
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+  double s = hsum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+  for (; i < n; ++i)
+    s += x[i] * y[i];
+  return s;
+}
+
+LA_TARGET_AVX2 inline float dot(const float *x, const float *y, int n) {
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8), s1);
+    s2 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 16), _mm256_loadu_ps(y + i + 16), s2);
+    s3 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 24), _mm256_loadu_ps(y + i + 24), s3);
+  }
+  for (; i + 8 <= n; i += 8)
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+  float s = hsum(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+  for (; i < n; ++i)
+    s += x[i] * y[i];
+  return s;
+}
+
+LA_TARGET_AVX2 inline double sum_sq(const double *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_AVX2 inline float sum_sq(const float *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_AVX2 inline double dot_wide(const double *x, const double *y, int n) {
+  return dot(x, y, n);
+}
+
+LA_TARGET_AVX2 inline double dot_wide(const float *x, const float *y, int n) {
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(x + i)),
+                         _mm256_cvtps_pd(_mm_loadu_ps(y + i)), s0);
+    s1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(x + i + 4)),
+                         _mm256_cvtps_pd(_mm_loadu_ps(y + i + 4)), s1);
+    s2 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(x + i + 8)),
+                         _mm256_cvtps_pd(_mm_loadu_ps(y + i + 8)), s2);
+    s3 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(x + i + 12)),
+                         _mm256_cvtps_pd(_mm_loadu_ps(y + i + 12)), s3);
+  }
+  for (; i + 4 <= n; i += 4)
+    s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(x + i)),
+                         _mm256_cvtps_pd(_mm_loadu_ps(y + i)), s0);
+  double s = hsum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+  for (; i < n; ++i)
+    s += (double)x[i] * y[i];
+  return s;
+}
+
+LA_TARGET_AVX2 inline double sum_sq_wide(const double *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_AVX2 inline double sum_sq_wide(const float *x, int n) {
+  return dot_wide(x, x, n);
+}
+
+LA_TARGET_AVX2 inline void axpy(int n, double a, const double *x, double *y) {
+  __m256d va = _mm256_set1_pd(a);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(y + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+  for (; i < n; ++i)
+    y[i] += a * x[i];
+}
+
+LA_TARGET_AVX2 inline void axpy(int n, float a, const float *x, float *y) {
+  __m256 va = _mm256_set1_ps(a);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  for (; i < n; ++i)
+    y[i] += a * x[i];
+}
+
+LA_TARGET_AVX2 inline void scale(int n, double a, const double *x, double *y) {
+  __m256d va = _mm256_set1_pd(a);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(y + i, _mm256_mul_pd(va, _mm256_loadu_pd(x + i)));
+  for (; i < n; ++i)
+    y[i] = a * x[i];
+}
+
+LA_TARGET_AVX2 inline void scale(int n, float a, const float *x, float *y) {
+  __m256 va = _mm256_set1_ps(a);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, _mm256_mul_ps(va, _mm256_loadu_ps(x + i)));
+  for (; i < n; ++i)
+    y[i] = a * x[i];
+}
+
+LA_TARGET_AVX2 inline void add(int n, const double *x, const double *y, double *z) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(z + i, _mm256_add_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] + y[i];
+}
+
+LA_TARGET_AVX2 inline void add(int n, const float *x, const float *y, float *z) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(z + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] + y[i];
+}
+
+LA_TARGET_AVX2 inline void sub(int n, const double *x, const double *y, double *z) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(z + i, _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] - y[i];
+}
+
+LA_TARGET_AVX2 inline void sub(int n, const float *x, const float *y, float *z) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(z + i, _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  for (; i < n; ++i)
+    z[i] = x[i] - y[i];
+}
+
+LA_TARGET_AVX2 inline void rot(int n, double *x, double *y, double c, double s) {
+  __m256d vc = _mm256_set1_pd(c), vs = _mm256_set1_pd(s);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d a = _mm256_loadu_pd(x + i), b = _mm256_loadu_pd(y + i);
+    _mm256_storeu_pd(x + i, _mm256_fmadd_pd(vc, a, _mm256_mul_pd(vs, b)));
+    _mm256_storeu_pd(y + i, _mm256_fnmadd_pd(vs, a, _mm256_mul_pd(vc, b)));
+  }
+  scalar::rot(n - i, x + i, y + i, c, s);
+}
+
+LA_TARGET_AVX2 inline void rot(int n, float *x, float *y, float c, float s) {
+  __m256 vc = _mm256_set1_ps(c), vs = _mm256_set1_ps(s);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 a = _mm256_loadu_ps(x + i), b = _mm256_loadu_ps(y + i);
+    _mm256_storeu_ps(x + i, _mm256_fmadd_ps(vc, a, _mm256_mul_ps(vs, b)));
+    _mm256_storeu_ps(y + i, _mm256_fnmadd_ps(vs, a, _mm256_mul_ps(vc, b)));
+  }
+  scalar::rot(n - i, x + i, y + i, c, s);
+}
+
+/// 8x8 微块: unpack / shuffle 在 128 位通道内转置, 再用 permute2f128 交换通道
+LA_TARGET_AVX2 inline void transpose(int m, int n, const float *A, int lda, float *B, int ldb) {
+  int i = 0, j = 0;
+  for (; i + 8 <= m; i += 8) {
+    for (j = 0; j + 8 <= n; j += 8) {
+      const float *a = A + (std::size_t)i * lda + j;
+      __m256 r0 = _mm256_loadu_ps(a), r1 = _mm256_loadu_ps(a + lda);
+      __m256 r2 = _mm256_loadu_ps(a + 2 * lda), r3 = _mm256_loadu_ps(a + 3 * lda);
+      __m256 r4 = _mm256_loadu_ps(a + 4 * lda), r5 = _mm256_loadu_ps(a + 5 * lda);
+      __m256 r6 = _mm256_loadu_ps(a + 6 * lda), r7 = _mm256_loadu_ps(a + 7 * lda);
+
+      __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+      __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+      __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+      __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+
+      __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+      __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+      __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+      __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+      __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+      float *b = B + (std::size_t)j * ldb + i;
+      _mm256_storeu_ps(b, _mm256_permute2f128_ps(s0, s4, 0x20));
+      _mm256_storeu_ps(b + ldb, _mm256_permute2f128_ps(s1, s5, 0x20));
+      _mm256_storeu_ps(b + 2 * ldb, _mm256_permute2f128_ps(s2, s6, 0x20));
+      _mm256_storeu_ps(b + 3 * ldb, _mm256_permute2f128_ps(s3, s7, 0x20));
+      _mm256_storeu_ps(b + 4 * ldb, _mm256_permute2f128_ps(s0, s4, 0x31));
+      _mm256_storeu_ps(b + 5 * ldb, _mm256_permute2f128_ps(s1, s5, 0x31));
+      _mm256_storeu_ps(b + 6 * ldb, _mm256_permute2f128_ps(s2, s6, 0x31));
+      _mm256_storeu_ps(b + 7 * ldb, _mm256_permute2f128_ps(s3, s7, 0x31));
+    }
+  }
+  scalar::transpose_edges(m, n, i, n / 8 * 8, A, lda, B, ldb);
+}
+
+LA_TARGET_AVX2 inline void transpose(int m, int n, const double *A, int lda, double *B, int ldb) {
+  int i = 0, j = 0;
+  for (; i + 4 <= m; i += 4) {
+    for (j = 0; j + 4 <= n; j += 4) {
+      const double *a = A + (std::size_t)i * lda + j;
+      __m256d r0 = _mm256_loadu_pd(a), r1 = _mm256_loadu_pd(a + lda);
+      __m256d r2 = _mm256_loadu_pd(a + 2 * lda), r3 = _mm256_loadu_pd(a + 3 * lda);
+      __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+      __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+      double *b = B + (std::size_t)j * ldb + i;
+      _mm256_storeu_pd(b, _mm256_permute2f128_pd(t0, t2, 0x20));
+      _mm256_storeu_pd(b + ldb, _mm256_permute2f128_pd(t1, t3, 0x20));
+      _mm256_storeu_pd(b + 2 * ldb, _mm256_permute2f128_pd(t0, t2, 0x31));
+      _mm256_storeu_pd(b + 3 * ldb, _mm256_permute2f128_pd(t1, t3, 0x31));
+    }
+  }
+  scalar::transpose_edges(m, n, i, n / 4 * 4, A, lda, B, ldb);
+}
+}
+
+/// AVX-512 用掩码加载处理尾部, 不再需要标量收尾循环
+namespace avx512 {
+
+/// 水平求和; 不用 _mm512_reduce_add_*, 它在 GCC 12 下会触发 -Wuninitialized 误报
+LA_TARGET_AVX512 inline double hsum(__m512d v) {
+  alignas(64) double t[8];
+  _mm512_store_pd(t, v);
+  return ((t[0] + t[4]) + (t[1] + t[5])) + ((t[2] + t[6]) + (t[3] + t[7]));
+}
+
+LA_TARGET_AVX512 inline float hsum(__m512 v) {
+  alignas(64) float t[16];
+  _mm512_store_ps(t, v);
+  float s = 0;
+  for (int i = 0; i < 8; ++i)
+    s += t[i] + t[i + 8];
+  return s;
+}
+
+LA_TARGET_AVX512 inline __mmask8 tail8(int r) {
+  return (__mmask8)((1u << r) - 1);
+}
+
+LA_TARGET_AVX512 inline __mmask16 tail16(int r) {
+  return (__mmask16)((1u << r) - 1);
+}
+
+LA_TARGET_AVX512 inline double dot(const double *x, const double *y, int n) {
+  __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), s0);
+    s1 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 8), _mm512_loadu_pd(y + i + 8), s1);
+  }
+  for (; i + 8 <= n; i += 8)
+    s0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), s0);
+  if (i < n) {
+    __mmask8 m = tail8(n - i);
+    s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, x + i), _mm512_maskz_loadu_pd(m, y + i), s1);
+  }
+  return hsum(_mm512_add_pd(s0, s1));
+}
+
+LA_TARGET_AVX512 inline float dot(const float *x, const float *y, int n) {
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), s0);
+    s1 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i + 16), _mm512_loadu_ps(y + i + 16), s1);
+  }
+  for (; i + 16 <= n; i += 16)
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), s0);
+  if (i < n) {
+    __mmask16 m = tail16(n - i);
+    s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i), s1);
+  }
+  return hsum(_mm512_add_ps(s0, s1));
+}
+
+LA_TARGET_AVX512 inline double sum_sq(const double *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_AVX512 inline float sum_sq(const float *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_AVX512 inline double dot_wide(const double *x, const double *y, int n) {
+  return dot(x, y, n);
+}
+
+/// 8 个 float 转换为 double; 用 maskz 形式, GCC 对 _mm512_cvtps_pd 会误报未初始化
+LA_TARGET_AVX512 inline __m512d widen8(const float *p) {
+  return _mm512_maskz_cvtps_pd((__mmask8)0xFF, _mm256_loadu_ps(p));
+}
+
+LA_TARGET_AVX512 inline double dot_wide(const float *x, const float *y, int n) {
+  __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm512_fmadd_pd(widen8(x + i), widen8(y + i), s0);
+    s1 = _mm512_fmadd_pd(widen8(x + i + 8), widen8(y + i + 8), s1);
+  }
+  for (; i + 8 <= n; i += 8)
+    s0 = _mm512_fmadd_pd(widen8(x + i), widen8(y + i), s0);
+  double s = hsum(_mm512_add_pd(s0, s1));
+  for (; i < n; ++i)
+    s += (double)x[i] * y[i];
+  return s;
+}
+
+LA_TARGET_AVX512 inline double sum_sq_wide(const double *x, int n) {
+  return dot(x, x, n);
+}
+
+LA_TARGET_AVX512 inline double sum_sq_wide(const float *x, int n) {
+  return dot_wide(x, x, n);
+}
+
+LA_TARGET_AVX512 inline void axpy(int n, double a, const double *x, double *y) {
+  __m512d va = _mm512_set1_pd(a);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(y + i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+  if (i < n) {
+    __mmask8 m = tail8(n - i);
+    _mm512_mask_storeu_pd(y + i, m, _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(m, x + i),
+                                                    _mm512_maskz_loadu_pd(m, y + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void axpy(int n, float a, const float *x, float *y) {
+  __m512 va = _mm512_set1_ps(a);
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+  if (i < n) {
+    __mmask16 m = tail16(n - i);
+    _mm512_mask_storeu_ps(y + i, m, _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i),
+                                                    _mm512_maskz_loadu_ps(m, y + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void scale(int n, double a, const double *x, double *y) {
+  __m512d va = _mm512_set1_pd(a);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(y + i, _mm512_mul_pd(va, _mm512_loadu_pd(x + i)));
+  if (i < n) {
+    __mmask8 m = tail8(n - i);
+    _mm512_mask_storeu_pd(y + i, m, _mm512_mul_pd(va, _mm512_maskz_loadu_pd(m, x + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void scale(int n, float a, const float *x, float *y) {
+  __m512 va = _mm512_set1_ps(a);
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(y + i, _mm512_mul_ps(va, _mm512_loadu_ps(x + i)));
+  if (i < n) {
+    __mmask16 m = tail16(n - i);
+    _mm512_mask_storeu_ps(y + i, m, _mm512_mul_ps(va, _mm512_maskz_loadu_ps(m, x + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void add(int n, const double *x, const double *y, double *z) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(z + i, _mm512_add_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+  if (i < n) {
+    __mmask8 m = tail8(n - i);
+    _mm512_mask_storeu_pd(z + i, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, x + i),
+                                                  _mm512_maskz_loadu_pd(m, y + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void add(int n, const float *x, const float *y, float *z) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(z + i, _mm512_add_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+  if (i < n) {
+    __mmask16 m = tail16(n - i);
+    _mm512_mask_storeu_ps(z + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, x + i),
+                                                  _mm512_maskz_loadu_ps(m, y + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void sub(int n, const double *x, const double *y, double *z) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(z + i, _mm512_sub_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+  if (i < n) {
+    __mmask8 m = tail8(n - i);
+    _mm512_mask_storeu_pd(z + i, m, _mm512_sub_pd(_mm512_maskz_loadu_pd(m, x + i),
+                                                  _mm512_maskz_loadu_pd(m, y + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void sub(int n, const float *x, const float *y, float *z) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(z + i, _mm512_sub_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+  if (i < n) {
+    __mmask16 m = tail16(n - i);
+    _mm512_mask_storeu_ps(z + i, m, _mm512_sub_ps(_mm512_maskz_loadu_ps(m, x + i),
+                                                  _mm512_maskz_loadu_ps(m, y + i)));
+  }
+}
+
+LA_TARGET_AVX512 inline void rot(int n, double *x, double *y, double c, double s) {
+  __m512d vc = _mm512_set1_pd(c), vs = _mm512_set1_pd(s);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d a = _mm512_loadu_pd(x + i), b = _mm512_loadu_pd(y + i);
+    _mm512_storeu_pd(x + i, _mm512_fmadd_pd(vc, a, _mm512_mul_pd(vs, b)));
+    _mm512_storeu_pd(y + i, _mm512_fnmadd_pd(vs, a, _mm512_mul_pd(vc, b)));
+  }
+  if (i < n) {
+    __mmask8 m = tail8(n - i);
+    __m512d a = _mm512_maskz_loadu_pd(m, x + i), b = _mm512_maskz_loadu_pd(m, y + i);
+    _mm512_mask_storeu_pd(x + i, m, _mm512_fmadd_pd(vc, a, _mm512_mul_pd(vs, b)));
+    _mm512_mask_storeu_pd(y + i, m, _mm512_fnmadd_pd(vs, a, _mm512_mul_pd(vc, b)));
+  }
+}
+
+LA_TARGET_AVX512 inline void rot(int n, float *x, float *y, float c, float s) {
+  __m512 vc = _mm512_set1_ps(c), vs = _mm512_set1_ps(s);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 a = _mm512_loadu_ps(x + i), b = _mm512_loadu_ps(y + i);
+    _mm512_storeu_ps(x + i, _mm512_fmadd_ps(vc, a, _mm512_mul_ps(vs, b)));
+    _mm512_storeu_ps(y + i, _mm512_fnmadd_ps(vs, a, _mm512_mul_ps(vc, b)));
+  }
+  if (i < n) {
+    __mmask16 m = tail16(n - i);
+    __m512 a = _mm512_maskz_loadu_ps(m, x + i), b = _mm512_maskz_loadu_ps(m, y + i);
+    _mm512_mask_storeu_ps(x + i, m, _mm512_fmadd_ps(vc, a, _mm512_mul_ps(vs, b)));
+    _mm512_mask_storeu_ps(y + i, m, _mm512_fnmadd_ps(vs, a, _mm512_mul_ps(vc, b)));
+  }
+}
+}
+
+#undef LA_TARGET_SSE2
+#undef LA_TARGET_AVX2
+#undef LA_TARGET_AVX512
+
+#endif // LA_SIMD_X86
+
+/// 当前 CPU 支持的最高级别; 环境变量 LA_SIMD=scalar|sse2|avx2|avx512 可以把它调低
+inline Level detect_level() {
+
+  Level best = Level::Scalar;
+#ifdef LA_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    best = Level::SSE2;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    best = Level::AVX2;
+  if (__builtin_cpu_supports("avx512f"))
+    best = Level::AVX512;
+#endif
+
+  const char *env = std::getenv("LA_SIMD");
+  if (env) {
+    for (int l = 0; l <= (int)best; ++l)
+      if (std::strcmp(env, level_name((Level)l)) == 0)
+        return (Level)l;
+  }
+  return best;
+}
+
+/// 一种元素类型的内核函数表
+template <typename E>
+struct Kernels {
+  E (*dot)(const E *, const E *, int);
+  E (*sum_sq)(const E *, int);
+  /// 在 double 中累加的 dot 和 sum_sq
+  double (*dot_wide)(const E *, const E *, int);
+  double (*sum_sq_wide)(const E *, int);
+  void (*axpy)(int, E, const E *, E *);
+  void (*scale)(int, E, const E *, E *);
+  void (*add)(int, const E *, const E *, E *);
+  void (*sub)(int, const E *, const E *, E *);
+  void (*transpose)(int, int, const E *, int, E *, int);
+  void (*rot)(int, E *, E *, E, E);
+  Level level;
+};
+
+namespace detail {
+
+/// 按级别填入 SIMD 内核, 只对 float 和 double 实例化
+template <typename E>
+void install_simd(Kernels<E> &k, Level level) {
+#ifdef LA_SIMD_X86
+  typedef E (*Dot)(const E *, const E *, int);
+  typedef E (*SumSq)(const E *, int);
+  typedef double (*DotWide)(const E *, const E *, int);
+  typedef double (*SumSqWide)(const E *, int);
+  typedef void (*Axpy)(int, E, const E *, E *);
+  typedef void (*Binary)(int, const E *, const E *, E *);
+  typedef void (*Trans)(int, int, const E *, int, E *, int);
+  typedef void (*Rot)(int, E *, E *, E, E);
+  switch (level) {
+  case Level::AVX512:
+    /// 转置受内存带宽限制, 沿用 AVX2 的 8x8 微块
+    k = {(Dot)&avx512::dot, (SumSq)&avx512::sum_sq, (DotWide)&avx512::dot_wide,
+         (SumSqWide)&avx512::sum_sq_wide, (Axpy)&avx512::axpy, (Axpy)&avx512::scale,
+         (Binary)&avx512::add, (Binary)&avx512::sub, (Trans)&avx2::transpose, (Rot)&avx512::rot,
+         Level::AVX512};
+    break;
+  case Level::AVX2:
+    k = {(Dot)&avx2::dot, (SumSq)&avx2::sum_sq, (DotWide)&avx2::dot_wide,
+         (SumSqWide)&avx2::sum_sq_wide, (Axpy)&avx2::axpy, (Axpy)&avx2::scale,
+         (Binary)&avx2::add, (Binary)&avx2::sub, (Trans)&avx2::transpose, (Rot)&avx2::rot,
+         Level::AVX2};
+    break;
+  case Level::SSE2:
+    k = {(Dot)&sse2::dot, (SumSq)&sse2::sum_sq, (DotWide)&sse2::dot_wide,
+         (SumSqWide)&sse2::sum_sq_wide, (Axpy)&sse2::axpy, (Axpy)&sse2::scale,
+         (Binary)&sse2::add, (Binary)&sse2::sub, (Trans)&sse2::transpose, (Rot)&sse2::rot,
+         Level::SSE2};
+    break;
+  default:
+    break;
+  }
+#else
+  (void)k;
+  (void)level;
+#endif
+}
+
+template <typename E>
+Kernels<E> make_kernels(Level level) {
+  Kernels<E> k = {&scalar::dot<E>, &scalar::sum_sq<E>, &scalar::dot_wide<E>,
+                  &scalar::sum_sq_wide<E>, &scalar::axpy<E>,
+                  &scalar::scale<E>, &scalar::add<E>, &scalar::sub<E>, &scalar::transpose<E>,
+                  &scalar::rot<E>, Level::Scalar};
+  if (level != Level::Scalar)
+    install_simd(k, level);
+  return k;
+}
+
+/// 只有 float 和 double 有 SIMD 内核, 其他类型始终走标量实现
+template <typename E>
+struct Dispatch {
+  static const Kernels<E> &get() {
+    static const Kernels<E> k = {&scalar::dot<E>, &scalar::sum_sq<E>, &scalar::dot_wide<E>,
+                                 &scalar::sum_sq_wide<E>, &scalar::axpy<E>,
+                                 &scalar::scale<E>, &scalar::add<E>, &scalar::sub<E>,
+                                 &scalar::transpose<E>, &scalar::rot<E>, Level::Scalar};
+    return k;
+  }
+};
+
+template <>
+struct Dispatch<float> {
+  static const Kernels<float> &get() {
+    static const Kernels<float> k = make_kernels<float>(detect_level());
+    return k;
+  }
+};
+
+template <>
+struct Dispatch<double> {
+  static const Kernels<double> &get() {
+    static const Kernels<double> k = make_kernels<double>(detect_level());
+    return k;
+  }
+};
+}
+
+/// 类型 E 当前使用的内核表, 首次调用时完成 CPUID 检测
+template <typename E>
+const Kernels<E> &kernels() {
+  return detail::Dispatch<E>::get();
+}
+
+/// x . y
+template <typename E>
+E dot(const E *x, const E *y, int n) {
+  return kernels<E>().dot(x, y, n);
+}
+
+/// sum(x[i]^2)
+template <typename E>
+E sum_sq(const E *x, int n) {
+  return kernels<E>().sum_sq(x, n);
+}
+
+/// x . y, 在 double 中累加, 用于返回 double 的 Vector::dot
+template <typename E>
+double dot_wide(const E *x, const E *y, int n) {
+  return kernels<E>().dot_wide(x, y, n);
+}
+
+/// sum(x[i]^2), 在 double 中累加
+template <typename E>
+double sum_sq_wide(const E *x, int n) {
+  return kernels<E>().sum_sq_wide(x, n);
+}
+
+/// y += a * x
+template <typename E>
+void axpy(int n, E a, const E *x, E *y) {
+  kernels<E>().axpy(n, a, x, y);
+}
+
+/// y = a * x, x 和 y 可以是同一块内存
+template <typename E>
+void scale(int n, E a, const E *x, E *y) {
+  kernels<E>().scale(n, a, x, y);
+}
+
+/// z = x + y
+template <typename E>
+void add(int n, const E *x, const E *y, E *z) {
+  kernels<E>().add(n, x, y, z);
+}
+
+/// z = x - y
+template <typename E>
+void sub(int n, const E *x, const E *y, E *z) {
+  kernels<E>().sub(n, x, y, z);
+}
+
+/// B = A^T, A 为 m x n; 适合 L1 大小的块, 大矩阵用 blas::transpose 分块
+template <typename E>
+void transpose(int m, int n, const E *A, int lda, E *B, int ldb) {
+  kernels<E>().transpose(m, n, A, lda, B, ldb);
+}
+
+/// x = c x + s y, y = c y - s x
+template <typename E>
+void rot(int n, E *x, E *y, E c, E s) {
+  kernels<E>().rot(n, x, y, c, s);
+}
+}
+}
+
+#endif // LA_SIMD_H
@@ -0,0 +1,333 @@
+/**********************************
+ * File:     SolverService.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/8
+ ***********************************/
+
+#ifndef LA_SOLVERSERVICE_H
+#define LA_SOLVERSERVICE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "Batched.h"
+#include "LU.h"
+#include "ThreadPool.h"
+
+namespace LinearAlgebra {
+
+struct SolverServiceOptions {
+  /// 排队中 (尚未开始求解) 的请求上限, 满了以后 submit 阻塞, try_submit 失败
+  int maxQueued = 1024;
+  /// 一批最多合并的请求个数
+  int maxBatch = 256;
+  /// 最早的请求最多等这么久, 以便凑齐同尺寸的一批
+  int maxDelayMicros = 200;
+  /// 不超过这个阶数的系统按批交错求解 (batch::solve), 更大的逐个做 LU
+  int batchedLimit = 32;
+};
+
+enum class SolveStatus { Solved, Singular, Cancelled };
+
+template <typename E>
+struct SolveResult {
+  SolveStatus status = SolveStatus::Cancelled;
+  /// 只有 status 为 Solved 时有意义
+  Vector<E> x;
+};
+
+namespace detail {
+
+template <typename E>
+struct SolveRequest {
+  enum State { Pending, Running, Cancelled };
+
+  Matrix<E> A;
+  Vector<E> b;
+  std::promise<SolveResult<E>> promise;
+  /// 只在服务的锁内修改
+  State state = Pending;
+  std::chrono::steady_clock::time_point arrived;
+
+  SolveRequest(Matrix<E> &&A, Vector<E> &&b)
+      : A(std::move(A)), b(std::move(b)), arrived(std::chrono::steady_clock::now()) {
+  }
+};
+}
+
+/// 提交后得到的凭据: 通过它等待结果, 或交给 SolverService::cancel 取消
+template <typename E>
+class SolveTicket {
+private:
+  template <typename>
+  friend class SolverService;
+
+  std::shared_ptr<detail::SolveRequest<E>> req;
+  std::future<SolveResult<E>> fut;
+
+public:
+  SolveTicket() = default;
+
+  bool valid() const {
+    return fut.valid();
+  }
+
+  /// 结果是否已经可以取出
+  bool ready() const {
+    return fut.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  void wait() const {
+    fut.wait();
+  }
+
+  /// 阻塞直到求解完成 (或被取消), 只能调用一次
+  SolveResult<E> get() {
+    SolveResult<E> r = fut.get();
+    req.reset();
+    return r;
+  }
+};
+
+/// 异步求解服务: submit 把 A x = b 放进队列并立即返回, 后台调度线程把
+/// 同阶的请求合并成一批, 在共享线程池上求解.
+///
+/// 小系统交错存放后整批消元 (与 batch::solve 相同), 大系统在线程池上逐个做
+/// 部分选主元 LU, 结果与 LinearSystem::gauss_jordan_elimination 一致.
+/// 调度线程总是先服务最早的请求, 它所在的批凑不满时最多等待 maxDelayMicros.
+/// 析构时会求解完已经排队的请求.
+template <typename E>
+class SolverService {
+private:
+  typedef detail::SolveRequest<E> Request;
+  typedef std::shared_ptr<Request> RequestPtr;
+  typedef std::chrono::steady_clock Clock;
+
+  SolverServiceOptions opts;
+  /// 按到达顺序排列, 已取消的请求留到调度线程经过时再丢弃
+  std::deque<RequestPtr> queue;
+  /// 排队中且未取消的请求个数, 以及按阶数的分布
+  int live;
+  std::map<int, int> pendingBySize;
+  bool stopping;
+  std::mutex mutex;
+  std::condition_variable hasWork;
+  std::condition_variable hasRoom;
+  std::thread dispatcher;
+
+  SolveTicket<E> enqueue(Matrix<E> &&A, Vector<E> &&b) {
+    SolveTicket<E> t;
+    t.req = std::make_shared<Request>(std::move(A), std::move(b));
+    t.fut = t.req->promise.get_future();
+    queue.push_back(t.req);
+    ++live;
+    int same = ++pendingBySize[t.req->A.row_num()];
+    /// 调度线程只在有新工作或某一阶凑满一批时需要醒来
+    if (live == 1 || same >= opts.maxBatch)
+      hasWork.notify_one();
+    return t;
+  }
+
+  static void check(const Matrix<E> &A, const Vector<E> &b) {
+    assert(A.row_num() == A.col_num() && "the coefficient matrix must be square");
+    assert(A.row_num() == b.size() && "the right-hand side must match the matrix");
+    (void)A;
+    (void)b;
+  }
+
+  /// 在锁内取出下一批: 最早的请求, 以及排在它后面同阶的请求.
+  /// 还需要等待凑批时返回 false, deadline 为最晚的等待时刻
+  bool take_batch(std::vector<RequestPtr> &batch, Clock::time_point &deadline) {
+    while (!queue.empty() && queue.front()->state == Request::Cancelled)
+      queue.pop_front();
+    if (queue.empty())
+      return false;
+
+    const RequestPtr &first = queue.front();
+    int n = first->A.row_num();
+    int same = pendingBySize[n];
+
+    deadline = first->arrived + std::chrono::microseconds(opts.maxDelayMicros);
+    if (same < opts.maxBatch && !stopping && Clock::now() < deadline)
+      return false;
+
+    std::deque<RequestPtr> rest;
+    for (RequestPtr &r : queue) {
+      if (r->state == Request::Cancelled)
+        continue;
+      if (r->A.row_num() == n && (int)batch.size() < opts.maxBatch) {
+        r->state = Request::Running;
+        batch.push_back(std::move(r));
+      } else {
+        rest.push_back(std::move(r));
+      }
+    }
+    queue.swap(rest);
+    live -= (int)batch.size();
+    if ((pendingBySize[n] -= (int)batch.size()) == 0)
+      pendingBySize.erase(n);
+    hasRoom.notify_all();
+    return true;
+  }
+
+  static SolveResult<E> solve_one(const Request &r) {
+    SolveResult<E> res;
+    LU<E> lu(r.A);
+    if (lu.is_singular()) {
+      res.status = SolveStatus::Singular;
+    } else {
+      res.status = SolveStatus::Solved;
+      res.x = lu.solve(r.b);
+    }
+    return res;
+  }
+
+  /// 求解一批同阶系统, 结果写入 out
+  void run_batch(const std::vector<RequestPtr> &batch, std::vector<SolveResult<E>> &out) {
+    int cnt = (int)batch.size(), n = batch[0]->A.row_num();
+    out.assign(cnt, SolveResult<E>());
+
+    if (cnt > 1 && n <= opts.batchedLimit) {
+      MatrixBatch<E> A(cnt, n, n), B(cnt, n, 1);
+      for (int c = 0; c < cnt; ++c) {
+        A.set(c, batch[c]->A);
+        for (int i = 0; i < n; ++i)
+          B(c, i, 0) = batch[c]->b[i];
+      }
+      std::vector<bool> singular;
+      batch::solve(A, B, &singular);
+      for (int c = 0; c < cnt; ++c) {
+        if (singular[c]) {
+          out[c].status = SolveStatus::Singular;
+          continue;
+        }
+        out[c].status = SolveStatus::Solved;
+        out[c].x = Vector<E>::zero(n);
+        for (int i = 0; i < n; ++i)
+          out[c].x[i] = B(c, i, 0);
+      }
+      return;
+    }
+
+    /// 每个系统一个任务; LU 内部的并行与之嵌套, 由线程池负责平衡
+    if (cnt == 1) {
+      out[0] = solve_one(*batch[0]);
+      return;
+    }
+    ThreadPool::instance().parallel_for(0, cnt, 1, [&](int lo, int hi) {
+      for (int c = lo; c < hi; ++c)
+        out[c] = solve_one(*batch[c]);
+    });
+  }
+
+  void loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      hasWork.wait(lock, [this]() { return stopping || live > 0; });
+      if (live == 0 && stopping)
+        return;
+
+      std::vector<RequestPtr> batch;
+      Clock::time_point deadline;
+      if (!take_batch(batch, deadline)) {
+        if (live > 0)
+          hasWork.wait_until(lock, deadline);
+        continue;
+      }
+
+      lock.unlock();
+      std::vector<SolveResult<E>> out;
+      try {
+        run_batch(batch, out);
+        for (std::size_t c = 0; c < batch.size(); ++c)
+          batch[c]->promise.set_value(std::move(out[c]));
+      } catch (...) {
+        for (const RequestPtr &r : batch)
+          r->promise.set_exception(std::current_exception());
+      }
+      batch.clear();
+      lock.lock();
+    }
+  }
+
+public:
+  explicit SolverService(SolverServiceOptions opts = SolverServiceOptions())
+      : opts(opts), live(0), stopping(false) {
+    assert(opts.maxQueued > 0 && opts.maxBatch > 0);
+    dispatcher = std::thread([this]() { loop(); });
+  }
+
+  ~SolverService() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    hasWork.notify_all();
+    dispatcher.join();
+  }
+
+  SolverService(const SolverService &) = delete;
+  SolverService &operator=(const SolverService &) = delete;
+
+  /// 提交 A x = b. 队列已满时阻塞, 直到有请求开始求解或被取消 (背压)
+  SolveTicket<E> submit(Matrix<E> A, Vector<E> b) {
+    check(A, b);
+    std::unique_lock<std::mutex> lock(mutex);
+    hasRoom.wait(lock, [this]() { return live < opts.maxQueued; });
+    return enqueue(std::move(A), std::move(b));
+  }
+
+  /// 不阻塞的提交, 队列已满时返回 false
+  bool try_submit(Matrix<E> A, Vector<E> b, SolveTicket<E> &ticket) {
+    check(A, b);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (live >= opts.maxQueued)
+      return false;
+    ticket = enqueue(std::move(A), std::move(b));
+    return true;
+  }
+
+  /// 取消尚未开始求解的请求, 它的结果为 Cancelled. 已经开始或完成时返回 false
+  bool cancel(const SolveTicket<E> &ticket) {
+    if (!ticket.req)
+      return false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (ticket.req->state != Request::Pending)
+        return false;
+      ticket.req->state = Request::Cancelled;
+      --live;
+      if (--pendingBySize[ticket.req->A.row_num()] == 0)
+        pendingBySize.erase(ticket.req->A.row_num());
+    }
+    hasRoom.notify_all();
+    ticket.req->promise.set_value(SolveResult<E>());
+    return true;
+  }
+
+  /// 排队中 (未开始, 未取消) 的请求个数
+  int queued() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return live;
+  }
+};
+}
+
+#endif // LA_SOLVERSERVICE_H
@@ -0,0 +1,447 @@
+/**********************************
+ * File:     SparseMatrix.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/31
+ ***********************************/
+
+#ifndef LA_SPARSEMATRIX_H
+#define LA_SPARSEMATRIX_H
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+/// 压缩存储格式: CSR 按行压缩, CSC 按列压缩
+enum class SparseFormat { CSR, CSC };
+
+namespace detail {
+
+/// 按非零元个数把外层下标 [0, outer) 切成 parts 段, 返回第 c 段的起点
+inline int nnz_split(const std::vector<long long> &ptr, int outer, int parts, int c) {
+  if (c >= parts)
+    return outer;
+  long long target = ptr[outer] * c / parts;
+  return (int)(std::lower_bound(ptr.begin(), ptr.begin() + outer + 1, target) - ptr.begin());
+}
+
+/// y[o] = sum(v(p) * x[idx[p]]), v(p) 为第 p 个非零元的值.
+/// 各外层下标互不相干, 按非零元均分给线程
+template <typename E, typename Val>
+void sparse_gather_by(int outer, const std::vector<long long> &ptr, const std::vector<int> &idx,
+                      Val v, const E *x, E *y) {
+  int parts = Parallel::num_threads() * 4;
+  Parallel::for_range(0, parts, 1, ptr[outer], [&](int lo, int hi) {
+    int o0 = nnz_split(ptr, outer, parts, lo), o1 = nnz_split(ptr, outer, parts, hi);
+    for (int o = o0; o < o1; ++o) {
+      long long p = ptr[o], end = ptr[o + 1];
+      E s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+      for (; p + 4 <= end; p += 4) {
+        s0 += v(p) * x[idx[p]];
+        s1 += v(p + 1) * x[idx[p + 1]];
+        s2 += v(p + 2) * x[idx[p + 2]];
+        s3 += v(p + 3) * x[idx[p + 3]];
+      }
+      for (; p < end; ++p)
+        s0 += v(p) * x[idx[p]];
+      y[o] = (s0 + s1) + (s2 + s3);
+    }
+  });
+}
+
+template <typename E>
+void sparse_gather(int outer, const std::vector<long long> &ptr, const std::vector<int> &idx,
+                   const std::vector<E> &val, const E *x, E *y) {
+  const E *v = val.data();
+  sparse_gather_by(outer, ptr, idx, [v](long long p) { return v[p]; }, x, y);
+}
+
+/// y[idx[p]] += val[p] * x[o], 串行; 不同外层下标会写同一个 y
+template <typename E>
+void sparse_scatter(int outer, const std::vector<long long> &ptr, const std::vector<int> &idx,
+                    const std::vector<E> &val, const E *x, E *y, int ny) {
+  std::fill(y, y + ny, E(0));
+  for (int o = 0; o < outer; ++o)
+    for (long long p = ptr[o]; p < ptr[o + 1]; ++p)
+      y[idx[p]] += val[p] * x[o];
+}
+
+/// 按另一方向压缩的下标: 新外层 o (原来的内层下标) 的第 p 个元素是原数组的
+/// 第 pos[p] 个非零元. 只记位置不记数值, 所以修改 values() 后依然有效
+struct CrossIndex {
+  std::vector<long long> ptr;
+  std::vector<int> idx;
+  std::vector<long long> pos;
+};
+
+/// 计数排序 O(nnz + 维数)
+inline CrossIndex build_cross(int outer, int inner, const std::vector<long long> &ptr,
+                              const std::vector<int> &idx) {
+  CrossIndex c;
+  long long nnz = ptr[outer];
+  c.ptr.assign(inner + 1, 0);
+  for (long long k = 0; k < nnz; ++k)
+    ++c.ptr[idx[k] + 1];
+  for (int i = 0; i < inner; ++i)
+    c.ptr[i + 1] += c.ptr[i];
+  c.idx.resize(nnz);
+  c.pos.resize(nnz);
+  std::vector<long long> next(c.ptr.begin(), c.ptr.end() - 1);
+  for (int o = 0; o < outer; ++o) {
+    for (long long k = ptr[o]; k < ptr[o + 1]; ++k) {
+      long long dst = next[idx[k]]++;
+      c.idx[dst] = o;
+      c.pos[dst] = k;
+    }
+  }
+  return c;
+}
+}
+
+/// 稀疏矩阵, CSR 或 CSC 压缩存储
+///
+/// ptr 长度为外层维数 + 1 (CSR 的外层是行, CSC 的外层是列), idx 存内层下标,
+/// 同一外层内按下标升序且没有重复. 内存和运算量都只与非零元个数成正比.
+/// 与存储方向相反的乘法 (CSC 的 A x, CSR 的 A^T x) 并行时要按另一方向读取,
+/// 第一次用到时建立一份另一方向的下标并缓存, 之后每次都是无写冲突的按行累加.
+template <typename E>
+class SparseMatrix {
+public:
+  typedef E value_type;
+
+private:
+  int row, col;
+  SparseFormat fmt;
+  std::vector<long long> ptr;
+  std::vector<int> idx;
+  std::vector<E> val;
+  /// 另一方向的下标, 第一次需要时建立; 只依赖稀疏结构, 拷贝之间可以共享
+  mutable std::shared_ptr<const detail::CrossIndex> cross;
+
+  int outer() const {
+    return fmt == SparseFormat::CSR ? row : col;
+  }
+
+  int inner() const {
+    return fmt == SparseFormat::CSR ? col : row;
+  }
+
+  /// 并发调用时可能各自建立一份, 结果相同, 保留最后一份
+  std::shared_ptr<const detail::CrossIndex> cross_index() const {
+    std::shared_ptr<const detail::CrossIndex> c = std::atomic_load(&cross);
+    if (!c) {
+      c = std::make_shared<const detail::CrossIndex>(detail::build_cross(outer(), inner(), ptr, idx));
+      std::atomic_store(&cross, c);
+    }
+    return c;
+  }
+
+  /// y[inner] = sum over outer, 与存储方向相反的乘法. 规模小或单线程时直接散射,
+  /// 否则用缓存的另一方向下标按输出分段累加, 不需要每线程一份输出缓冲区
+  void cross_dot(const E *x, E *y) const {
+    if (nnz() < Parallel::threshold() || Parallel::num_threads() == 1) {
+      detail::sparse_scatter(outer(), ptr, idx, val, x, y, inner());
+      return;
+    }
+    std::shared_ptr<const detail::CrossIndex> c = cross_index();
+    const E *v = val.data();
+    const long long *pos = c->pos.data();
+    detail::sparse_gather_by(inner(), c->ptr, c->idx, [v, pos](long long p) { return v[pos[p]]; },
+                             x, y);
+  }
+
+public:
+  SparseMatrix() : row(0), col(0), fmt(SparseFormat::CSR), ptr(1, 0) {
+  }
+
+  /// 直接接管压缩数组
+  SparseMatrix(int r, int c, SparseFormat format, std::vector<long long> &&ptr,
+               std::vector<int> &&idx, std::vector<E> &&val)
+      : row(r), col(c), fmt(format), ptr(std::move(ptr)), idx(std::move(idx)), val(std::move(val)) {
+    assert((int)this->ptr.size() == outer() + 1);
+    assert(this->idx.size() == this->val.size() && (long long)this->idx.size() == this->ptr.back());
+  }
+
+  /// 从稠密矩阵构造, 绝对值不大于 tol 的元素视为 0
+  explicit SparseMatrix(const Matrix<E> &A, SparseFormat format = SparseFormat::CSR, E tol = 0)
+      : row(A.row_num()), col(A.col_num()), fmt(SparseFormat::CSR), ptr(1, 0) {
+    ptr.reserve(row + 1);
+    for (int i = 0; i < row; ++i) {
+      const E *a = A.row_ptr(i);
+      for (int j = 0; j < col; ++j) {
+        if (std::abs(a[j]) > tol) {
+          idx.push_back(j);
+          val.push_back(a[j]);
+        }
+      }
+      ptr.push_back((long long)idx.size());
+    }
+    if (format == SparseFormat::CSC)
+      *this = to_csc();
+  }
+
+  int row_num() const {
+    return row;
+  }
+
+  int col_num() const {
+    return col;
+  }
+
+  long long nnz() const {
+    return ptr.back();
+  }
+
+  SparseFormat format() const {
+    return fmt;
+  }
+
+  const std::vector<long long> &outer_ptr() const {
+    return ptr;
+  }
+
+  const std::vector<int> &inner_idx() const {
+    return idx;
+  }
+
+  const std::vector<E> &values() const {
+    return val;
+  }
+
+  std::vector<E> &values() {
+    return val;
+  }
+
+  /// 元素 (i, j), 不存在时为 0; 在外层内二分查找
+  E operator()(int i, int j) const {
+    assert(i >= 0 && i < row && j >= 0 && j < col && "out of index");
+    int o = fmt == SparseFormat::CSR ? i : j;
+    int in = fmt == SparseFormat::CSR ? j : i;
+    auto first = idx.begin() + ptr[o], last = idx.begin() + ptr[o + 1];
+    auto it = std::lower_bound(first, last, in);
+    return it != last && *it == in ? val[it - idx.begin()] : E(0);
+  }
+
+  /// 对角线元素
+  Vector<E> diagonal() const {
+    int n = std::min(row, col);
+    Vector<E> d = Vector<E>::zero(n);
+    for (int i = 0; i < n; ++i)
+      d[i] = (*this)(i, i);
+    return d;
+  }
+
+  /// 转置: CSR 的 A 与 CSC 的 A^T 是同一组数组, 只交换维数和格式, 不重排.
+  /// 左值要拷贝这组数组, 右值 (例如 std::move(A).transpose()) 直接接管它们
+  SparseMatrix transpose() const & {
+    return SparseMatrix(*this).transpose();
+  }
+
+  SparseMatrix transpose() && {
+    SparseMatrix t(std::move(*this));
+    t.cross.reset();
+    std::swap(t.row, t.col);
+    t.fmt = fmt == SparseFormat::CSR ? SparseFormat::CSC : SparseFormat::CSR;
+    return t;
+  }
+
+  /// 在两种格式间转换, 计数排序 O(nnz + 维数)
+  SparseMatrix convert(SparseFormat format) const {
+    if (format == fmt)
+      return *this;
+
+    int no = outer(), ni = inner();
+    std::vector<long long> p(ni + 1, 0);
+    for (long long k = 0; k < nnz(); ++k)
+      ++p[idx[k] + 1];
+    for (int i = 0; i < ni; ++i)
+      p[i + 1] += p[i];
+
+    std::vector<int> id(nnz());
+    std::vector<E> v(nnz());
+    std::vector<long long> next(p.begin(), p.end() - 1);
+    for (int o = 0; o < no; ++o) {
+      for (long long k = ptr[o]; k < ptr[o + 1]; ++k) {
+        long long dst = next[idx[k]]++;
+        id[dst] = o;
+        v[dst] = val[k];
+      }
+    }
+    return SparseMatrix(row, col, format, std::move(p), std::move(id), std::move(v));
+  }
+
+  SparseMatrix to_csr() const {
+    return convert(SparseFormat::CSR);
+  }
+
+  SparseMatrix to_csc() const {
+    return convert(SparseFormat::CSC);
+  }
+
+  /// 转成稠密矩阵
+  Matrix<E> to_dense() const {
+    Matrix<E> res(row, col);
+    for (int o = 0; o < outer(); ++o) {
+      for (long long k = ptr[o]; k < ptr[o + 1]; ++k) {
+        if (fmt == SparseFormat::CSR)
+          res(o, idx[k]) = val[k];
+        else
+          res(idx[k], o) = val[k];
+      }
+    }
+    return res;
+  }
+
+  /// y = A * x
+  Vector<E> dot(const Vector<E> &x) const {
+    assert(x.size() == col);
+    Vector<E> y = Vector<E>::zero(row);
+    dot(x.data(), y.data());
+    return y;
+  }
+
+  /// y = A * x, x 长度为 col, y 长度为 row
+  void dot(const E *x, E *y) const {
+    LA_OP_SCOPE("SparseMatrix::dot", row, col, nnz(), 2.0 * nnz(),
+                (double)nnz() * (sizeof(E) + sizeof(int)) + (double)(row + col) * sizeof(E));
+    if (fmt == SparseFormat::CSR)
+      detail::sparse_gather(row, ptr, idx, val, x, y);
+    else
+      cross_dot(x, y);
+  }
+
+  /// y = A^T * x, 不构造转置
+  Vector<E> transpose_dot(const Vector<E> &x) const {
+    assert(x.size() == row);
+    Vector<E> y = Vector<E>::zero(col);
+    transpose_dot(x.data(), y.data());
+    return y;
+  }
+
+  void transpose_dot(const E *x, E *y) const {
+    if (fmt == SparseFormat::CSR)
+      cross_dot(x, y);
+    else
+      detail::sparse_gather(col, ptr, idx, val, x, y);
+  }
+
+  /// 稀疏乘稠密: C = A * B, 每个非零元对应 C 的一行上的一次 axpy
+  Matrix<E> dot(const Matrix<E> &B) const {
+    assert(B.row_num() == col);
+    if (fmt == SparseFormat::CSC)
+      return to_csr().dot(B);
+
+    int m = B.col_num();
+    Matrix<E> C(row, m);
+    int parts = Parallel::num_threads() * 4;
+    Parallel::for_range(0, parts, 1, nnz() * m, [&](int lo, int hi) {
+      int o0 = detail::nnz_split(ptr, row, parts, lo), o1 = detail::nnz_split(ptr, row, parts, hi);
+      for (int i = o0; i < o1; ++i) {
+        E *c = C.row_ptr(i);
+        for (long long k = ptr[i]; k < ptr[i + 1]; ++k)
+          simd::axpy(m, val[k], B.row_ptr(idx[k]), c);
+      }
+    });
+    return C;
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const SparseMatrix &A) {
+    os << "SparseMatrix(" << A.row << "x" << A.col << ", nnz=" << A.nnz() << std::endl;
+    for (int o = 0; o < A.outer(); ++o) {
+      for (long long k = A.ptr[o]; k < A.ptr[o + 1]; ++k) {
+        int i = A.fmt == SparseFormat::CSR ? o : A.idx[k];
+        int j = A.fmt == SparseFormat::CSR ? A.idx[k] : o;
+        os << "(" << i << "," << j << ")=" << A.val[k] << std::endl;
+      }
+    }
+    os << ")" << std::endl;
+    return os;
+  }
+};
+
+/// COO 三元组构造器: 任意顺序 add, 重复位置的值相加, build 时压缩
+template <typename E>
+class SparseBuilder {
+private:
+  int row, col;
+  std::vector<int> rows, cols;
+  std::vector<E> vals;
+
+public:
+  SparseBuilder(int r, int c) : row(r), col(c) {
+  }
+
+  void reserve(std::size_t n) {
+    rows.reserve(n);
+    cols.reserve(n);
+    vals.reserve(n);
+  }
+
+  void add(int i, int j, E v) {
+    assert(i >= 0 && i < row && j >= 0 && j < col && "out of index");
+    rows.push_back(i);
+    cols.push_back(j);
+    vals.push_back(v);
+  }
+
+  std::size_t size() const {
+    return vals.size();
+  }
+
+  /// 压缩为 CSR 或 CSC: 按外层计数排序, 外层内按下标排序并合并重复项
+  SparseMatrix<E> build(SparseFormat format = SparseFormat::CSR) const {
+    bool csr = format == SparseFormat::CSR;
+    const std::vector<int> &out = csr ? rows : cols;
+    const std::vector<int> &in = csr ? cols : rows;
+    int no = csr ? row : col;
+    std::size_t n = vals.size();
+
+    std::vector<long long> p(no + 1, 0);
+    for (std::size_t k = 0; k < n; ++k)
+      ++p[out[k] + 1];
+    for (int o = 0; o < no; ++o)
+      p[o + 1] += p[o];
+
+    std::vector<std::pair<int, E>> entries(n);
+    std::vector<long long> next(p.begin(), p.end() - 1);
+    for (std::size_t k = 0; k < n; ++k)
+      entries[next[out[k]]++] = std::make_pair(in[k], vals[k]);
+
+    std::vector<long long> ptr(no + 1, 0);
+    std::vector<int> idx;
+    std::vector<E> val;
+    idx.reserve(n);
+    val.reserve(n);
+    for (int o = 0; o < no; ++o) {
+      auto first = entries.begin() + p[o], last = entries.begin() + p[o + 1];
+      std::sort(first, last, [](const std::pair<int, E> &a, const std::pair<int, E> &b) {
+        return a.first < b.first;
+      });
+      for (auto it = first; it != last; ++it) {
+        if (!idx.empty() && (long long)idx.size() > ptr[o] && idx.back() == it->first)
+          val.back() += it->second;
+        else {
+          idx.push_back(it->first);
+          val.push_back(it->second);
+        }
+      }
+      ptr[o + 1] = (long long)idx.size();
+    }
+    return SparseMatrix<E>(row, col, format, std::move(ptr), std::move(idx), std::move(val));
+  }
+};
+}
+
+#endif // LA_SPARSEMATRIX_H
@@ -0,0 +1,285 @@
+/**********************************
+ * File:     ThreadPool.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/1/28
+ ***********************************/
+
+#ifndef LA_THREADPOOL_H
+#define LA_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LinearAlgebra {
+
+/// 库内部共享的工作窃取线程池
+///
+/// 每个工作线程有自己的双端队列: 自己从队尾取任务, 空闲时从其他线程的队首窃取.
+/// 提交任务的线程在等待时也会执行任务, 所以在任务里再次调用 parallel_for 不会死锁.
+class ThreadPool {
+public:
+  typedef std::function<void()> Task;
+
+  /// 全局线程池. 线程数取环境变量 LA_NUM_THREADS, 未设置时取硬件线程数
+  static ThreadPool &instance() {
+    static ThreadPool pool(default_threads());
+    return pool;
+  }
+
+  explicit ThreadPool(int threads) : queues(std::max(threads, 1)) {
+    start(std::max(threads, 1));
+  }
+
+  ~ThreadPool() {
+    stop();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// 参与计算的线程数 (包括调用线程)
+  int num_threads() const {
+    return (int)workers.size() + 1;
+  }
+
+  /// 调整线程数; 不能在池中有任务运行时调用
+  void set_num_threads(int threads) {
+    threads = std::max(threads, 1);
+    if (threads == num_threads())
+      return;
+    stop();
+    std::vector<Queue> fresh(threads);
+    queues.swap(fresh);
+    start(threads);
+  }
+
+  /// 提交一个任务. 任务不能抛出异常 (工作线程无处传递它);
+  /// 需要把异常带回调用方时用 parallel_for
+  void submit(Task task) {
+    int self = worker_index();
+    int q = self >= 0 ? self : (int)(next.fetch_add(1) % queues.size());
+    {
+      std::lock_guard<std::mutex> lock(queues[q].mutex);
+      queues[q].tasks.push_back(std::move(task));
+    }
+    pending.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+  }
+
+  /// 取出并执行一个任务, 没有任务时返回 false
+  bool run_one() {
+    Task task;
+    if (!take(worker_index(), task))
+      return false;
+    task();
+    return true;
+  }
+
+  /// 在 [begin, end) 上并行执行 fn(lo, hi), 每块至少 grain 个元素.
+  /// 调用线程也参与计算, 直到所有块完成才返回. 某块抛出异常时其余块照常
+  /// 执行完, 然后在调用线程上重新抛出第一个异常
+  template <typename Fn>
+  void parallel_for(int begin, int end, int grain, Fn fn) {
+
+    int n = end - begin;
+    if (n <= 0)
+      return;
+    grain = std::max(grain, 1);
+
+    /// 块数取线程数的几倍, 让窃取能够平衡负载
+    int chunks = std::min((n + grain - 1) / grain, num_threads() * 4);
+    if (chunks <= 1 || num_threads() == 1) {
+      fn(begin, end);
+      return;
+    }
+
+    /// 任务引用调用方的栈, 所以即使出错也要等所有块结束才能返回
+    std::shared_ptr<Join> join = std::make_shared<Join>(chunks);
+    int base = n / chunks, extra = n % chunks, lo = begin;
+    for (int c = 0; c < chunks; ++c) {
+      int hi = lo + base + (c < extra ? 1 : 0);
+      if (c == chunks - 1) {
+        join->run(fn, lo, hi);
+      } else {
+        submit([fn, lo, hi, join]() { join->run(fn, lo, hi); });
+      }
+      lo = hi;
+    }
+
+    while (join->remaining.load() > 0) {
+      if (!run_one())
+        std::this_thread::yield();
+    }
+    if (join->error)
+      std::rethrow_exception(join->error);
+  }
+
+private:
+  /// 一次 parallel_for 的完成计数与第一个异常
+  struct Join {
+    std::atomic<int> remaining;
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    explicit Join(int chunks) : remaining(chunks) {
+    }
+
+    template <typename Fn>
+    void run(const Fn &fn, int lo, int hi) {
+      try {
+        fn(lo, hi);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+          error = std::current_exception();
+      }
+      remaining.fetch_sub(1);
+    }
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<Queue> queues;
+  std::vector<std::thread> workers;
+  std::atomic<unsigned> next{0};
+  std::atomic<int> pending{0};
+  std::atomic<bool> stopping{false};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+
+  static int default_threads() {
+    const char *env = std::getenv("LA_NUM_THREADS");
+    if (env && std::atoi(env) > 0)
+      return std::atoi(env);
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw ? (int)hw : 1;
+  }
+
+  /// 当前线程在本池中的下标, 非工作线程返回 -1
+  int &current_index() const {
+    thread_local int index = -1;
+    return index;
+  }
+
+  static const ThreadPool *&current_pool() {
+    thread_local const ThreadPool *pool = nullptr;
+    return pool;
+  }
+
+  int worker_index() const {
+    return current_pool() == this ? current_index() : -1;
+  }
+
+  /// 工作线程 i (从 1 开始) 使用队列 i; 外部线程轮流提交到全部队列 (包括没有
+  /// 固定主人的队列 0), 空闲的线程从任意队列窃取
+  void start(int threads) {
+    stopping = false;
+    pending = 0;
+    for (int i = 1; i < threads; ++i)
+      workers.emplace_back([this, i]() { loop(i); });
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : workers)
+      t.join();
+    workers.clear();
+  }
+
+  bool take(int self, Task &task) {
+    int n = (int)queues.size();
+    if (self >= 0) {
+      std::lock_guard<std::mutex> lock(queues[self].mutex);
+      if (!queues[self].tasks.empty()) {
+        task = std::move(queues[self].tasks.back());
+        queues[self].tasks.pop_back();
+        pending.fetch_sub(1);
+        return true;
+      }
+    }
+    int start = self >= 0 ? self + 1 : 0;
+    for (int k = 0; k < n; ++k) {
+      Queue &q = queues[(start + k) % n];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.tasks.empty()) {
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        pending.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void loop(int index) {
+    current_pool() = this;
+    current_index() = index;
+    while (true) {
+      Task task;
+      if (take(index, task)) {
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [this]() { return stopping.load() || pending.load() > 0; });
+      if (stopping && pending.load() == 0)
+        return;
+    }
+  }
+};
+
+/// 并行执行的规模阈值: 工作量 (大致的乘加次数) 低于阈值时保持串行
+struct Parallel {
+  static long long &threshold() {
+    static long long value = 1 << 16;
+    return value;
+  }
+
+  static void set_threshold(long long work) {
+    threshold() = work;
+  }
+
+  static void set_num_threads(int threads) {
+    ThreadPool::instance().set_num_threads(threads);
+  }
+
+  static int num_threads() {
+    return ThreadPool::instance().num_threads();
+  }
+
+  /// 工作量足够大时并行, 否则直接在调用线程上执行 fn(begin, end)
+  template <typename Fn>
+  static void for_range(int begin, int end, int grain, long long work, Fn fn) {
+    if (work < threshold() || end - begin <= grain) {
+      fn(begin, end);
+      return;
+    }
+    ThreadPool::instance().parallel_for(begin, end, grain, fn);
+  }
+};
+}
+
+#endif // LA_THREADPOOL_H
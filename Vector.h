@@ -16,6 +16,14 @@
 #include <cassert>
 #include <cmath>
 #include <exception>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include "Memory.h"
+#include "MappedFile.h"
+#include "Simd.h"
+#include "Expression.h"
 
 namespace LinearAlgebra {
 
@@ -33,115 +41,211 @@ private:
   const char *msg;
 };
 
+/// 运行期维数的向量, 数据在堆上 64 字节对齐
 template <typename E>
-class Vector {
+class Vector<E, Dynamic> : public VecExpr<Vector<E>> {
+public:
+  typedef E value_type;
+
 private:
   E *value;
   int len;
+  /// 非空时 value 指向 owner 持有的外部内存(例如接管的 std::vector), 析构时不释放 value
+  std::shared_ptr<const void> owner;
+
+  /// 分配长度为 n 但未初始化的向量, 供运算结果直接写入
+  struct Uninit {};
+  Vector(int n, Uninit) : value(detail::allocate<E>(n)), len(n) {
+  }
+
+  /// 指向 owner 持有的外部内存, 不拷贝
+  Vector(E *data, int n, std::shared_ptr<const void> holder)
+      : value(data), len(n), owner(std::move(holder)) {
+  }
+
+  void release() {
+    if (!owner)
+      detail::deallocate(value);
+    owner.reset();
+    value = nullptr;
+    len = 0;
+  }
+
 public:
-  Vector() : len(0), value(nullptr) {
+  Vector() : value(nullptr), len(0) {
   }
 
-  Vector(std::vector<E> &vec) {
+  Vector(std::vector<E> &vec) : value(nullptr), len((int)vec.size()) {
     assert(vec.size() > 0 && "vec must greater zero");
-    len = vec.size();
-    value = new E[len];
-    for (int i = 0; i < len; ++i)
-      value[i] = vec[i];
+    value = detail::allocate<E>(len);
+    std::copy(vec.begin(), vec.end(), value);
+  }
+
+  /// 接管 std::vector 的缓冲区, 不拷贝数据
+  Vector(std::vector<E> &&vec) : value(nullptr), len((int)vec.size()) {
+    assert(vec.size() > 0 && "vec must greater zero");
+    std::shared_ptr<std::vector<E>> holder = std::make_shared<std::vector<E>>(std::move(vec));
+    value = holder->data();
+    owner = holder;
+  }
+
+  /// 从连续内存拷贝 n 个元素
+  Vector(const E *data, int n) : value(detail::allocate<E>(n)), len(n) {
+    assert(n > 0 && "vec must greater zero");
+    std::copy(data, data + n, value);
+  }
+
+  /// 从向量表达式构造, 在一个融合循环里求值
+  template <typename D>
+  Vector(const VecExpr<D> &e) : value(detail::allocate<E>(e.self().size())), len(e.self().size()) {
+    expr::assign(value, e.self());
   }
 
   ~Vector() {
-    if (value == nullptr)
-      delete[] value;
+    release();
   }
 
   /// 拷贝构造 (深拷贝)
-  Vector(const Vector &other) : len(other.len), value(new E[other.len]) {
-    for (int i = 0; i < len; ++i)
-      value[i] = other[i];
+  Vector(const Vector &other) : value(nullptr), len(other.len) {
+    if (other.value) {
+      value = detail::allocate<E>(len);
+      std::copy(other.value, other.value + len, value);
+      LA_COUNT_COPY(len * sizeof(E));
+    }
+  }
+
+  /// 移动构造, 只转移缓冲区
+  Vector(Vector &&other) noexcept
+      : value(other.value), len(other.len), owner(std::move(other.owner)) {
+    other.value = nullptr;
+    other.len = 0;
   }
 
   /// 拷贝赋值运算符
   Vector &operator=(const Vector &other) {
 
-    /// 先将值拷贝到临时位置（防止是自己赋值给自己）
-    E *temp = new E[other.len];
-    for (int i = 0; i < other.len; ++i)
-      temp[i] = other[i];
-
-    /// 释放旧数据
-    if (value)
-      delete [] value;
+    if (this == &other)
+      return *this;
 
-    /// 赋值新值
-    len = other.len;
-    value = temp;
+    /// 长度相同且缓冲区归自己所有时原地拷贝, 否则换一块新缓冲区
+    if (len != other.len || owner) {
+      Vector temp(other);
+      swap(temp);
+    } else {
+      std::copy(other.value, other.value + len, value);
+      LA_COUNT_COPY(len * sizeof(E));
+    }
+    return *this;
+  }
 
+  /// 移动赋值运算符
+  Vector &operator=(Vector &&other) noexcept {
+    if (this != &other) {
+      release();
+      value = other.value;
+      len = other.len;
+      owner = std::move(other.owner);
+      other.value = nullptr;
+      other.len = 0;
+    }
     return *this;
   }
 
-  Vector *operator=(const Vector *other) {
+  /// 表达式赋值; 表达式是逐元素的, 所以即使引用了自身也可以原地写入
+  template <typename D>
+  Vector &operator=(const VecExpr<D> &e) {
 
-    if (this == other)
-      return this;
+    const D &x = e.self();
+    if (x.size() != len || owner) {
+      Vector temp(x);
+      swap(temp);
+    } else {
+      expr::assign(value, x);
+    }
+    return *this;
+  }
 
-    /// 先将值拷贝到临时位置
-    E *temp = new E[other->len];
-    for (int i = 0; i < other->len; ++i)
-      temp[i] = other->value[i];
+  Vector *operator=(const Vector *other) {
+    *this = *other;
+    return this;
+  }
 
-    /// 释放旧对象
-    if (value)
-      delete [] value;
+  void swap(Vector &other) noexcept {
+    std::swap(value, other.value);
+    std::swap(len, other.len);
+    owner.swap(other.owner);
+  }
 
-    /// 赋值新值
-    len = other->len;
-    value = temp;
+  /// self += other
+  template <typename D>
+  Vector &operator+=(const VecExpr<D> &e) {
+    assert(len == e.self().size() && "Error in adding. Length of vectors must be same.");
+    expr::add_assign(value, e.self());
+    return *this;
+  }
 
-    return this;
+  /// self -= other
+  template <typename D>
+  Vector &operator-=(const VecExpr<D> &e) {
+    assert(len == e.self().size() && "Error in subbing. Length of vectors must be same.");
+    expr::sub_assign(value, e.self());
+    return *this;
   }
 
-  /// 返回向量的模
-  double norm() {
+  /// self *= k
+  Vector &operator*=(const E k) {
+    simd::scale(len, k, value, value);
+    return *this;
+  }
 
-    double sum = 0;
+  /// self /= k
+  Vector &operator/=(const E k) {
+    assert(k != 0);
     for (int i = 0; i < len; ++i)
-      sum += value[i] * value[i];
-    return sqrt(sum);
+      value[i] /= k;
+    return *this;
+  }
+
+  /// 返回向量的模, 在 double 中累加
+  double norm() const {
+    return std::sqrt(simd::sum_sq_wide(value, len));
   }
 
   /// 归一化, 单位向量
-  Vector normalize() {
+  Vector normalize() const {
 
     double normVal = norm();
     if (normVal < 1e-8) {
       throw ZeroDivisionError("Normalize error! norm is zero.");
     }
 
-    std::vector<E> res(len);
-    for (int i = 0; i < len; ++i)
-      res[i] = value[i] / normVal;
-    return Vector(res);
+    Vector res(len, Uninit());
+    simd::scale(len, E(1 / normVal), value, res.value);
+    return res;
   }
 
-  /// 向量点乘，返回结果标量
-  double dot(const Vector &other) {
+  /// 向量点乘，返回结果标量; 在 double 中累加
+  double dot(const Vector &other) const {
 
     assert(len == other.len && "Error in dot product. Length of vectors must be same.");
 
-    double res = 0.0;
-    for (int i = 0; i < len; ++i) {
-      res += other[i] * value[i];
-      if (abs(res) < 1e-8)
-        res = 0;
-    }
-    return res;
+    return simd::dot_wide(value, other.value, len);
+  }
+
+  /// 映射 io::save 写出的向量文件, 不拷贝也不占额外的常驻内存. 映射是写时复制的,
+  /// 原地修改只复制被写到的页, 文件不变; 映射在最后一个引用它的 Vector 析构时解除
+  static Vector map(const std::string &path) {
+    std::shared_ptr<io::MappedFile> f = io::MappedFile::open(path);
+    const io::FileHeader &h = f->header<E>(io::Kind::Vector, path);
+    E *data = reinterpret_cast<E *>(f->data() + h.offset);
+    return Vector(data, (int)h.rows, f);
   }
 
   /// 返回一个dim维的零向量
   static Vector zero(int dim) {
-    std::vector<E> res(dim, 0);
-    return Vector(res);
+    Vector res(dim, Uninit());
+    std::fill(res.value, res.value + dim, E(0));
+    return res;
   }
 
   /// getItem
@@ -156,81 +260,18 @@ public:
     return value[index];
   }
 
-  /// 向量加法，返回结果向量
-  Vector<E> operator+(const Vector<E>& other) {
-
-    assert(len == other.size() && "Error in adding. Length of vectors must be same.");
-
-    std::vector<E> res(len);
-    for (int i = 0; i < len; ++i)
-      res[i] = value[i] + other[i];
-    return Vector(res);
-  }
-
-  /// 向量减法，返回结果向量
-  Vector<E> operator-(const Vector<E>& other) {
-
-    assert(len == other.size() && "Error in subbing. Length of vectors must be same.");
-
-    std::vector<E> res(len);
-    for (int i = 0; i < len; ++i)
-      res[i] = value[i] - other[i];
-    return Vector(res);
-  }
-
-  /// neg
-  const Vector operator-() const {
-
-    std::vector<E> res(len);
-    for (int i = 0; i < len; ++i)
-      res[i] = value[i] * -1.0;
-    return Vector(res);
-  }
-
-  /// pos
-  const Vector operator+() const {
-
-    std::vector<E> res(len);
-    for (int i = 0; i < len; ++i)
-      res[i] = value[i];
-    return Vector(res);
-  }
-
   /// len
   int size() const{
     return len;
   }
 
-  /// friend 向量加法
-  friend Vector<E> operator+(const Vector<E> &self, const Vector<E>& other) {
-    return self + other;
+  /// 底层连续存储
+  E *data() {
+    return value;
   }
 
-  /// friedn 向量减法
-  friend Vector<E> operator-(const Vector<E> &self, const Vector<E>& other) {
-    return self - other;
-  }
-
-  /// 返回数量乘法的结果向量: self * k
-  friend Vector<E> operator*(const Vector<E> &self, const E k) {
-
-    std::vector<E> res(self.len);
-    for (int i = 0; i < self.len; ++i)
-      res[i] = self[i] * k;
-    return Vector(res);
-  }
-
-  /// 返回数量乘法的右乘结果: k * self
-  friend Vector<E> operator*(const E k, const Vector<E> &self) {
-    return self * k;
-  }
-
-  /// 返回数量除法 self / k
-  friend Vector<E> operator/(const Vector<E> &self, const E k) {
-
-    assert(k != 0);
-
-    return (1 / k) * self;
+  const E *data() const {
+    return value;
   }
 
   /// output
@@ -0,0 +1,280 @@
+/**********************************
+ * File:     View.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/7
+ ***********************************/
+
+#ifndef LA_VIEW_H
+#define LA_VIEW_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "Expression.h"
+#include "Gemm.h"
+#include "Simd.h"
+
+namespace LinearAlgebra {
+
+/// 跨步向量视图, 不拥有数据: 第 i 个元素位于 data()[i * stride()].
+/// 矩阵的行 (步长 1) 和列 (步长为行跨度) 都用它表示; E 可以是 const 类型.
+/// 视图只在底层矩阵存活期间有效
+template <typename E>
+class VectorView : public VecExpr<VectorView<E>> {
+public:
+  typedef typename std::remove_const<E>::type value_type;
+
+private:
+  E *ptr;
+  int len;
+  int inc;
+
+public:
+  VectorView(E *ptr, int len, int inc = 1) : ptr(ptr), len(len), inc(inc) {
+  }
+
+  VectorView(const VectorView &) = default;
+
+  operator VectorView<const E>() const {
+    return VectorView<const E>(ptr, len, inc);
+  }
+
+  /// 通过视图写入底层数据. 来源与视图重叠 (例如同一行错位) 时先拷到临时向量
+  template <typename D>
+  const VectorView &operator=(const VecExpr<D> &e) const {
+    const D &x = e.self();
+    assert(len == x.size() && "Length of vectors must be same.");
+    std::vector<value_type> tmp(len);
+    for (int i = 0; i < len; ++i)
+      tmp[i] = x[i];
+    for (int i = 0; i < len; ++i)
+      (*this)[i] = tmp[i];
+    return *this;
+  }
+
+  const VectorView &operator=(const VectorView &other) const {
+    return *this = static_cast<const VecExpr<VectorView> &>(other);
+  }
+
+  E &operator[](int index) const {
+    assert(index >= 0 && index < len && "out of index");
+    return ptr[(std::ptrdiff_t)index * inc];
+  }
+
+  int size() const {
+    return len;
+  }
+
+  int stride() const {
+    return inc;
+  }
+
+  E *data() const {
+    return ptr;
+  }
+
+  /// 与 Vector::dot 一致, 在 double 中累加
+  template <typename T>
+  double dot(const VectorView<T> &other) const {
+    static_assert(std::is_same<typename std::remove_const<T>::type, value_type>::value,
+                  "element types must match");
+    assert(len == other.size() && "Length of vectors must be same.");
+    if (inc == 1 && other.stride() == 1)
+      return simd::dot_wide(static_cast<const value_type *>(ptr), other.data(), len);
+    double s = 0;
+    for (int i = 0; i < len; ++i)
+      s += (double)(*this)[i] * other[i];
+    return s;
+  }
+
+  double norm() const {
+    if (inc == 1)
+      return std::sqrt(simd::sum_sq_wide(static_cast<const value_type *>(ptr), len));
+    return std::sqrt(dot(*this));
+  }
+};
+
+/// 跨步矩阵视图, 不拥有数据: 元素 (i, j) 位于 data()[i * row_stride() + j * col_stride()].
+/// 子块, 转置都只改变起点和步长, 不搬移数据. 作为矩阵表达式可以参与 +, -,
+/// 赋值给 Matrix 时才求值; E 可以是 const 类型. 视图只在底层矩阵存活期间有效
+template <typename E>
+class MatrixView : public MatExpr<MatrixView<E>> {
+public:
+  typedef typename std::remove_const<E>::type value_type;
+
+private:
+  E *ptr;
+  int row, col;
+  int rs, cs;
+
+public:
+  MatrixView(E *ptr, int r, int c, int rs, int cs) : ptr(ptr), row(r), col(c), rs(rs), cs(cs) {
+  }
+
+  MatrixView(const MatrixView &) = default;
+
+  operator MatrixView<const E>() const {
+    return MatrixView<const E>(ptr, row, col, rs, cs);
+  }
+
+  /// 通过视图写入底层数据, 例如 A.block(0, 0, 2, 2) = B. 来源引用了重叠的
+  /// 其他位置时 (例如写入自身的转置) 先求值到临时矩阵
+  template <typename D>
+  const MatrixView &operator=(const MatExpr<D> &e) const {
+    const D &x = e.self();
+    assert(row == x.row_num() && col == x.col_num() && "Shape of matrices must be same.");
+    if (cs != 1 || expr::Alias<D>::check(x, static_cast<const value_type *>(ptr), rs, row, col)) {
+      Matrix<value_type> tmp(x);
+      for (int i = 0; i < row; ++i)
+        for (int j = 0; j < col; ++j)
+          (*this)(i, j) = tmp(i, j);
+    } else {
+      expr::assign(ptr, rs, x);
+    }
+    return *this;
+  }
+
+  const MatrixView &operator=(const MatrixView &other) const {
+    return *this = static_cast<const MatExpr<MatrixView> &>(other);
+  }
+
+  E &operator()(int i, int j) const {
+    assert(i >= 0 && i < row && j >= 0 && j < col && "out of index");
+    return ptr[(std::ptrdiff_t)i * rs + (std::ptrdiff_t)j * cs];
+  }
+
+  int row_num() const {
+    return row;
+  }
+
+  int col_num() const {
+    return col;
+  }
+
+  int row_stride() const {
+    return rs;
+  }
+
+  int col_stride() const {
+    return cs;
+  }
+
+  E *data() const {
+    return ptr;
+  }
+
+  /// 转置视图
+  MatrixView T() const {
+    return MatrixView(ptr, col, row, cs, rs);
+  }
+
+  /// 从 (i, j) 开始的 r x c 子块
+  MatrixView block(int i, int j, int r, int c) const {
+    assert(i >= 0 && j >= 0 && r >= 0 && c >= 0 && i + r <= row && j + c <= col && "out of index");
+    return MatrixView(ptr + (std::ptrdiff_t)i * rs + (std::ptrdiff_t)j * cs, r, c, rs, cs);
+  }
+
+  VectorView<E> row_view(int index) const {
+    assert(index >= 0 && index < row && "out of index");
+    return VectorView<E>(ptr + (std::ptrdiff_t)index * rs, col, cs);
+  }
+
+  VectorView<E> col_view(int index) const {
+    assert(index >= 0 && index < col && "out of index");
+    return VectorView<E>(ptr + (std::ptrdiff_t)index * cs, row, rs);
+  }
+
+  /// view * vector: 行连续时按行点积, 列连续 (转置视图) 时按 axpy, 不生成转置
+  template <typename T>
+  Vector<value_type> dot(const VectorView<T> &x) const {
+    static_assert(std::is_same<typename std::remove_const<T>::type, value_type>::value,
+                  "element types must match");
+    assert(col == x.size());
+    Vector<value_type> res = Vector<value_type>::zero(row);
+    if (cs == 1)
+      blas::gemv(blas::Transpose::No, row, col, value_type(1),
+                 static_cast<const value_type *>(ptr), rs, x.data(), x.stride(),
+                 value_type(0), res.data(), 1);
+    else if (rs == 1)
+      blas::gemv(blas::Transpose::Yes, col, row, value_type(1),
+                 static_cast<const value_type *>(ptr), cs, x.data(), x.stride(),
+                 value_type(0), res.data(), 1);
+    else
+      for (int i = 0; i < row; ++i)
+        res[i] = (value_type)row_view(i).dot(VectorView<const value_type>(x));
+    return res;
+  }
+
+  Vector<value_type> dot(const Vector<value_type> &x) const {
+    return dot(VectorView<const value_type>(x.data(), x.size()));
+  }
+
+  /// view * view: 步长直接交给 GEMM 的打包, 不生成转置
+  template <typename T>
+  Matrix<value_type> dot(const MatrixView<T> &other) const {
+    static_assert(std::is_same<typename std::remove_const<T>::type, value_type>::value,
+                  "element types must match");
+    assert(col == other.row_num());
+    Matrix<value_type> res(row, other.col_num());
+    blas::gemm(row, other.col_num(), col, value_type(1), static_cast<const value_type *>(ptr),
+               rs, cs, other.data(), other.row_stride(), other.col_stride(), value_type(0),
+               res.data(), res.leading_dim(), 1);
+    return res;
+  }
+
+  Matrix<value_type> dot(const Matrix<value_type> &other) const {
+    return dot(other.view());
+  }
+};
+
+namespace expr {
+
+/// 视图与 dst 有重叠且布局不同时, 原地求值会读到已被改写的元素
+template <typename E>
+struct Alias<MatrixView<E>> {
+  template <typename T>
+  static bool check(const MatrixView<E> &v, const T *dst, int ld, int rows, int cols) {
+    if (v.row_num() == 0 || v.col_num() == 0 || rows == 0 || cols == 0)
+      return false;
+    if ((const void *)v.data() == (const void *)dst && v.row_stride() == ld && v.col_stride() == 1)
+      return false;
+    const T *vp = v.data();
+    std::ptrdiff_t a = (std::ptrdiff_t)(v.row_num() - 1) * v.row_stride(),
+                   b = (std::ptrdiff_t)(v.col_num() - 1) * v.col_stride();
+    const T *lo = vp + std::min<std::ptrdiff_t>(0, a) + std::min<std::ptrdiff_t>(0, b);
+    const T *hi = vp + std::max<std::ptrdiff_t>(0, a) + std::max<std::ptrdiff_t>(0, b) + 1;
+    const T *dhi = dst + (std::ptrdiff_t)(rows - 1) * ld + cols;
+    return lo < dhi && dst < hi;
+  }
+};
+
+/// 视图求值: 行连续时整行拷贝, 列连续 (转置视图) 时走分块转置, 其余逐元素读取
+template <typename E, typename T>
+void assign(E *dst, int ld, const MatrixView<T> &v) {
+  int rows = v.row_num(), cols = v.col_num();
+  if (v.row_stride() == 1 && v.col_stride() != 1) {
+    blas::transpose(cols, rows, static_cast<const E *>(v.data()), v.col_stride(), dst, ld);
+    return;
+  }
+  for (int i = 0; i < rows; ++i) {
+    E *d = dst + (std::size_t)i * ld;
+    const T *s = v.data() + (std::ptrdiff_t)i * v.row_stride();
+    if (v.col_stride() == 1) {
+      std::copy(s, s + cols, d);
+    } else {
+      for (int j = 0; j < cols; ++j)
+        d[j] = s[(std::ptrdiff_t)j * v.col_stride()];
+    }
+  }
+}
+}
+}
+
+#endif // LA_VIEW_H
@@ -0,0 +1,106 @@
+/**********************************
+ * File:     Woodbury.h
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/9
+ ***********************************/
+
+#ifndef LA_WOODBURY_H
+#define LA_WOODBURY_H
+
+#include <cassert>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "Gemm.h"
+#include "LU.h"
+
+namespace LinearAlgebra {
+
+/// 在已有分解上求解低秩修正后的系统 (A + U V^T) x = b, U 和 V 都是 n x k.
+///
+/// Sherman-Morrison-Woodbury: (A + U V^T)^-1 = A^-1 - Z (I + V^T Z)^-1 V^T A^-1,
+/// 其中 Z = A^-1 U. 构造时做 k 次求解和一个 k x k 的 LU, 之后每次求解是
+/// 一次原分解的求解加 O(n k). 不改动原分解, 适用于 LU, Cholesky, LDLT,
+/// 以及方阵的 QR (F 只需要提供 const 的 solve(const Vector<E> &)).
+/// 只保存原分解的引用, 求解期间它必须有效. 下降 A - U V^T 即传入 -U.
+template <typename E, typename F = LU<E>>
+class Woodbury {
+private:
+  const F &base;
+  Matrix<E> V;
+  Matrix<E> Z;
+  /// 电容矩阵 I + V^T Z 的分解
+  LU<E> cap;
+
+  static Matrix<E> solve_columns(const F &f, const Matrix<E> &U) {
+    int n = U.row_num(), k = U.col_num();
+    Matrix<E> Z(n, k);
+    std::vector<E> col(n);
+    for (int j = 0; j < k; ++j) {
+      for (int i = 0; i < n; ++i)
+        col[i] = U(i, j);
+      Vector<E> z = f.solve(Vector<E>(col));
+      for (int i = 0; i < n; ++i)
+        Z(i, j) = z[i];
+    }
+    return Z;
+  }
+
+  static Matrix<E> capacitance(const Matrix<E> &V, const Matrix<E> &Z) {
+    int n = V.row_num(), k = V.col_num();
+    Matrix<E> C = Matrix<E>::identify(k);
+    blas::gemm(k, k, n, E(1), V.data(), 1, V.leading_dim(), Z.data(), Z.leading_dim(), 1,
+               E(1), C.data(), C.leading_dim(), 1);
+    return C;
+  }
+
+public:
+  Woodbury(const F &f, const Matrix<E> &U, const Matrix<E> &V)
+      : base(f), V(V), Z(solve_columns(f, U)), cap(capacitance(V, Z)) {
+    assert(U.row_num() == V.row_num() && U.col_num() == V.col_num());
+  }
+
+  /// I + V^T A^-1 U 奇异时修正后的矩阵奇异, 不能求解
+  bool is_singular() const {
+    return cap.is_singular();
+  }
+
+  int size() const {
+    return V.row_num();
+  }
+
+  /// 修正的秩 k
+  int rank() const {
+    return V.col_num();
+  }
+
+  /// 求解 (A + U V^T) x = b
+  Vector<E> solve(const Vector<E> &b) const {
+    assert(!is_singular() && "updated matrix is singular");
+    assert(b.size() == V.row_num());
+    int n = V.row_num(), k = V.col_num();
+    Vector<E> x = base.solve(b);
+
+    /// t = (I + V^T Z)^-1 V^T x, x -= Z t
+    std::vector<E> t(k);
+    blas::gemv(blas::Transpose::Yes, n, k, E(1), V.data(), V.leading_dim(), x.data(), 1, E(0),
+               t.data(), 1);
+    cap.solve_in_place(t.data());
+    blas::gemv(blas::Transpose::No, n, k, E(-1), Z.data(), Z.leading_dim(), t.data(), 1, E(1),
+               x.data(), 1);
+    return x;
+  }
+};
+
+/// 推导元素类型的便捷构造
+template <typename E, typename F>
+Woodbury<E, F> woodbury(const F &f, const Matrix<E> &U, const Matrix<E> &V) {
+  return Woodbury<E, F>(f, U, V);
+}
+}
+
+#endif // LA_WOODBURY_H
@@ -0,0 +1,700 @@
+/**********************************
+ * File:     bench.cpp
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/4
+ ***********************************/
+
+/// 性能基准: 对各个内核扫描规模和元素类型, 报告中位数/分位数耗时, GFLOP/s 和 GB/s.
+///
+/// 用法: la_bench [--quick] [--reference] [--filter name] [--json out.json] [--threads n]
+///   --quick      只跑小规模, 每项最少运行时间缩短
+///   --reference  同时测量朴素实现, 报告加速比, 并核对两者的结果; 不一致时
+///                报告 MISMATCH, 程序以非零状态退出
+///   --filter     只运行名字包含 name 的项
+///   --json       把结果写成 JSON, 便于不同版本之间对比
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Vector.h"
+#include "Matrix.h"
+#include "LinearSystem.h"
+#include "Linalg.h"
+#include "LU.h"
+#include "Cholesky.h"
+#include "QR.h"
+#include "SparseMatrix.h"
+#include "IterativeSolver.h"
+#include "Batched.h"
+#include "MixedPrecision.h"
+#include "SolverService.h"
+#include "Woodbury.h"
+#include "Eigen.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+using namespace LinearAlgebra;
+
+namespace {
+
+/// 防止被测代码被优化掉; 同时是 --reference 核对的结果: 被测实现与朴素实现
+/// 各自从相同的初始状态运行一次后写入的 sink 应当一致
+volatile double sink;
+
+struct Options {
+  bool quick = false;
+  bool reference = false;
+  std::string filter;
+  std::string json;
+};
+
+struct Stats {
+  int reps = 0;
+  double median = 0, p10 = 0, p90 = 0, min = 0;
+};
+
+struct Record {
+  std::string name, dtype;
+  int n;
+  Stats stats;
+  double flops, bytes;
+  /// 朴素实现的中位数耗时, 没测时为 0
+  double refMedian;
+  /// 与朴素实现的结果是否一致 (容差内), 没测时为 true
+  bool refOk;
+};
+
+/// 先预热一次, 再重复运行直到达到最少次数和最少总时间, 取每次耗时的分位数
+Stats measure(const std::function<void()> &fn, double minSeconds) {
+  typedef std::chrono::steady_clock Clock;
+  fn();
+
+  std::vector<double> times;
+  double total = 0;
+  while ((times.size() < 5 || total < minSeconds) && times.size() < 10000) {
+    Clock::time_point t0 = Clock::now();
+    fn();
+    double t = std::chrono::duration<double>(Clock::now() - t0).count();
+    times.push_back(t);
+    total += t;
+  }
+
+  std::sort(times.begin(), times.end());
+  auto at = [&](double q) { return times[(std::size_t)(q * (times.size() - 1) + 0.5)]; };
+  Stats s;
+  s.reps = (int)times.size();
+  s.median = at(0.5);
+  s.p10 = at(0.1);
+  s.p90 = at(0.9);
+  s.min = times.front();
+  return s;
+}
+
+template <typename E> const char *dtype_name();
+template <> const char *dtype_name<float>() { return "f32"; }
+template <> const char *dtype_name<double>() { return "f64"; }
+
+/// 与朴素实现核对结果的相对容差
+double tolerance(const char *dtype) {
+  return std::strcmp(dtype, "f32") == 0 ? 1e-3 : 1e-8;
+}
+
+class Bench {
+private:
+  Options opts;
+  std::vector<Record> records;
+  int mismatches = 0;
+
+public:
+  explicit Bench(const Options &opts) : opts(opts) {
+  }
+
+  bool quick() const {
+    return opts.quick;
+  }
+
+  /// 与朴素实现结果不一致的项数
+  int mismatch_count() const {
+    return mismatches;
+  }
+
+  /// flops 和 bytes 是一次运行的浮点运算数与最少内存流量, 用于换算 GFLOP/s 和 GB/s
+  void run(const std::string &name, const char *dtype, int n, double flops, double bytes,
+           const std::function<void()> &fn, const std::function<void()> &ref = nullptr) {
+    if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+      return;
+
+    double minSeconds = opts.quick ? 0.05 : 0.3;
+    Record r;
+    r.name = name;
+    r.dtype = dtype;
+    r.n = n;
+    r.flops = flops;
+    r.bytes = bytes;
+    r.refOk = true;
+    double got = 0, want = 0;
+    if (opts.reference && ref) {
+      fn();
+      got = sink;
+      ref();
+      want = sink;
+      r.refOk = std::abs(got - want) <= tolerance(dtype) * std::max(1.0, std::abs(want));
+      mismatches += !r.refOk;
+    }
+    r.stats = measure(fn, minSeconds);
+    r.refMedian = opts.reference && ref ? measure(ref, minSeconds).median : 0;
+    records.push_back(r);
+
+    std::printf("%-22s %-4s %8d %8d %12.3f %12.3f %12.3f %9.2f %9.2f", name.c_str(), dtype, n,
+                r.stats.reps, r.stats.median * 1e6, r.stats.p10 * 1e6, r.stats.p90 * 1e6,
+                flops / r.stats.median * 1e-9, bytes / r.stats.median * 1e-9);
+    if (r.refMedian > 0)
+      std::printf(" %9.2fx", r.refMedian / r.stats.median);
+    if (!r.refOk)
+      std::printf("  MISMATCH: %.10g vs reference %.10g", got, want);
+    std::printf("\n");
+    std::fflush(stdout);
+  }
+
+  void header() const {
+    std::printf("simd: f32 %s, f64 %s; threads: %d\n",
+                simd::level_name(simd::kernels<float>().level),
+                simd::level_name(simd::kernels<double>().level), Parallel::num_threads());
+    std::printf("%-22s %-4s %8s %8s %12s %12s %12s %9s %9s%s\n", "name", "type", "n", "reps",
+                "median(us)", "p10(us)", "p90(us)", "GFLOP/s", "GB/s",
+                opts.reference ? "   speedup" : "");
+  }
+
+  void write_json() const {
+    if (opts.json.empty())
+      return;
+    std::ofstream out(opts.json);
+    out << "{\n  \"simd_f32\": \"" << simd::level_name(simd::kernels<float>().level) << "\",\n"
+        << "  \"simd_f64\": \"" << simd::level_name(simd::kernels<double>().level) << "\",\n"
+        << "  \"threads\": " << Parallel::num_threads() << ",\n  \"results\": [\n";
+    for (std::size_t i = 0; i < records.size(); ++i) {
+      const Record &r = records[i];
+      out << "    {\"name\": \"" << r.name << "\", \"dtype\": \"" << r.dtype << "\", \"n\": " << r.n
+          << ", \"reps\": " << r.stats.reps << ", \"median_ns\": " << r.stats.median * 1e9
+          << ", \"p10_ns\": " << r.stats.p10 * 1e9 << ", \"p90_ns\": " << r.stats.p90 * 1e9
+          << ", \"min_ns\": " << r.stats.min * 1e9
+          << ", \"gflops\": " << r.flops / r.stats.median * 1e-9
+          << ", \"gbps\": " << r.bytes / r.stats.median * 1e-9;
+      if (r.refMedian > 0)
+        out << ", \"reference_median_ns\": " << r.refMedian * 1e9
+            << ", \"reference_match\": " << (r.refOk ? "true" : "false");
+      out << "}" << (i + 1 < records.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    if (!out)
+      std::cerr << "cannot write " << opts.json << std::endl;
+    else
+      std::printf("results written to %s\n", opts.json.c_str());
+  }
+};
+
+template <typename E>
+std::vector<E> random_vec(int n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::vector<E> v(n);
+  for (E &x : v)
+    x = (E)dist(gen);
+  return v;
+}
+
+template <typename E>
+Matrix<E> random_mat(int r, int c, unsigned seed) {
+  std::vector<E> v = random_vec<E>(r * c, seed);
+  Matrix<E> A(r, c);
+  for (int i = 0; i < r; ++i)
+    std::copy(v.begin() + (std::size_t)i * c, v.begin() + (std::size_t)(i + 1) * c, A.row_ptr(i));
+  return A;
+}
+
+/// 对角占优, 保证 LU 和 Gauss-Jordan 数值稳定
+template <typename E>
+Matrix<E> random_nonsingular(int n, unsigned seed) {
+  Matrix<E> A = random_mat<E>(n, n, seed);
+  for (int i = 0; i < n; ++i)
+    A(i, i) += (E)n;
+  return A;
+}
+
+template <typename E>
+Matrix<E> random_spd(int n, unsigned seed) {
+  Matrix<E> B = random_mat<E>(n, n, seed);
+  Matrix<E> A = B.dot(B.t_view());
+  for (int i = 0; i < n; ++i)
+    A(i, i) += (E)n;
+  return A;
+}
+
+/// 二维泊松方程的五点差分矩阵, grid x grid 个未知数
+template <typename E>
+SparseMatrix<E> poisson2d(int grid) {
+  int n = grid * grid;
+  SparseBuilder<E> b(n, n);
+  for (int i = 0; i < grid; ++i) {
+    for (int j = 0; j < grid; ++j) {
+      int r = i * grid + j;
+      b.add(r, r, E(4));
+      if (i > 0) b.add(r, r - grid, E(-1));
+      if (i + 1 < grid) b.add(r, r + grid, E(-1));
+      if (j > 0) b.add(r, r - 1, E(-1));
+      if (j + 1 < grid) b.add(r, r + 1, E(-1));
+    }
+  }
+  return b.build();
+}
+
+template <typename E>
+void bench_level1(Bench &bench) {
+  const char *t = dtype_name<E>();
+  std::vector<int> sizes = bench.quick() ? std::vector<int>{1 << 10, 1 << 16}
+                                         : std::vector<int>{1 << 10, 1 << 16, 1 << 20, 1 << 24};
+  for (int n : sizes) {
+    Vector<E> x(random_vec<E>(n, 1)), y(random_vec<E>(n, 2));
+    const E *xp = x.data(), *yp = y.data();
+
+    bench.run("dot", t, n, 2.0 * n, 2.0 * n * sizeof(E),
+              [&]() { sink = x.dot(y); },
+              [&]() {
+                double s = 0;
+                for (int i = 0; i < n; ++i)
+                  s += (double)xp[i] * yp[i];
+                sink = s;
+              });
+
+    bench.run("norm", t, n, 2.0 * n, 1.0 * n * sizeof(E),
+              [&]() { sink = x.norm(); },
+              [&]() {
+                double s = 0;
+                for (int i = 0; i < n; ++i)
+                  s += (double)xp[i] * xp[i];
+                sink = std::sqrt(s);
+              });
+
+    /// 两边各用一份输出, 核对时从相同的初值开始
+    Vector<E> z(y), zr(y);
+    bench.run("axpy", t, n, 2.0 * n, 3.0 * n * sizeof(E),
+              [&]() {
+                simd::axpy(n, E(1e-3), xp, z.data());
+                sink = z[n - 1];
+              },
+              [&]() {
+                E *zp = zr.data();
+                for (int i = 0; i < n; ++i)
+                  zp[i] += E(1e-3) * xp[i];
+                sink = zp[n - 1];
+              });
+  }
+}
+
+template <typename E>
+void bench_level2(Bench &bench) {
+  const char *t = dtype_name<E>();
+  std::vector<int> sizes = bench.quick() ? std::vector<int>{128, 512}
+                                         : std::vector<int>{128, 512, 2048, 4096};
+  for (int n : sizes) {
+    Matrix<E> A = random_mat<E>(n, n, 3);
+    Vector<E> x(random_vec<E>(n, 4));
+
+    bench.run("matvec", t, n, 2.0 * n * n, (double)n * n * sizeof(E),
+              [&]() { sink = A.dot(x)[0]; },
+              [&]() {
+                std::vector<E> y(n);
+                for (int i = 0; i < n; ++i) {
+                  E s = 0;
+                  for (int j = 0; j < n; ++j)
+                    s += A(i, j) * x[j];
+                  y[i] = s;
+                }
+                sink = y[0];
+              });
+
+    /// 转置视图上的 matvec, 不生成转置
+    bench.run("matvec_t", t, n, 2.0 * n * n, (double)n * n * sizeof(E),
+              [&]() { sink = A.t_view().dot(x)[0]; },
+              [&]() {
+                std::vector<E> y(n);
+                for (int j = 0; j < n; ++j) {
+                  E s = 0;
+                  for (int i = 0; i < n; ++i)
+                    s += A(i, j) * x[i];
+                  y[j] = s;
+                }
+                sink = y[0];
+              });
+
+    bench.run("transpose", t, n, 0, 2.0 * n * n * sizeof(E),
+              [&]() {
+                Matrix<E> B = A.T();
+                sink = B(0, n - 1);
+              },
+              [&]() {
+                Matrix<E> B(n, n);
+                for (int i = 0; i < n; ++i)
+                  for (int j = 0; j < n; ++j)
+                    B(j, i) = A(i, j);
+                sink = B(0, n - 1);
+              });
+
+    /// 方阵原地转置, 两次之后复原; 两边各转置一份
+    Matrix<E> At(A), Ar(A);
+    bench.run("transpose_inplace", t, n, 0, 2.0 * n * n * sizeof(E),
+              [&]() {
+                At.transpose_in_place();
+                sink = At(0, 1);
+              },
+              [&]() {
+                for (int i = 0; i < n; ++i)
+                  for (int j = i + 1; j < n; ++j)
+                    std::swap(Ar(i, j), Ar(j, i));
+                sink = Ar(0, 1);
+              });
+  }
+}
+
+template <typename E>
+void bench_gemm(Bench &bench) {
+  const char *t = dtype_name<E>();
+  std::vector<int> sizes = bench.quick() ? std::vector<int>{64, 256}
+                                         : std::vector<int>{64, 256, 512, 1024, 2048};
+  for (int n : sizes) {
+    Matrix<E> A = random_mat<E>(n, n, 5), B = random_mat<E>(n, n, 6);
+    /// 朴素实现是 O(n^3) 的三重循环, 规模太大时跳过
+    std::function<void()> ref;
+    if (n <= 512)
+      ref = [&]() {
+        Matrix<E> C(n, n);
+        for (int i = 0; i < n; ++i)
+          for (int p = 0; p < n; ++p)
+            for (int j = 0; j < n; ++j)
+              C(i, j) += A(i, p) * B(p, j);
+        sink = C(0, 0);
+      };
+    bench.run("gemm", t, n, 2.0 * n * n * n, 3.0 * n * n * sizeof(E),
+              [&]() { sink = A.dot(B)(0, 0); }, ref);
+    bench.run("gemm_tn", t, n, 2.0 * n * n * n, 3.0 * n * n * sizeof(E),
+              [&]() { sink = A.t_view().dot(B)(0, 0); });
+  }
+}
+
+/// 稠密分解与求解. flops 按通常的主项计: LU 2n^3/3, Cholesky n^3/3, QR 4n^3/3,
+/// Gauss-Jordan 求解 n^3, 求逆 2n^3
+template <typename E>
+void bench_solvers(Bench &bench) {
+  const char *t = dtype_name<E>();
+  std::vector<int> sizes = bench.quick() ? std::vector<int>{64, 256}
+                                         : std::vector<int>{64, 256, 512, 1024};
+  for (int n : sizes) {
+    Matrix<E> A = random_nonsingular<E>(n, 7);
+    Matrix<E> S = random_spd<E>(n, 8);
+    Vector<E> b(random_vec<E>(n, 9));
+    double bytes = (double)n * n * sizeof(E);
+
+    bench.run("gauss_jordan", t, n, 1.0 * n * n * n, bytes, [&]() {
+      LinearSystem<E> ls(A, b);
+      sink = ls.gauss_jordan_elimination();
+    });
+
+    if (n <= 512)
+      bench.run("linalg_inv", t, n, 2.0 * n * n * n, bytes, [&]() {
+        bool ok;
+        sink = Linalg<E>::inv(A, &ok)(0, 0);
+      });
+
+    bench.run("lu_solve", t, n, 2.0 * n * n * n / 3, bytes, [&]() {
+      LU<E> lu(A);
+      sink = lu.solve(b)[0];
+    });
+
+    bench.run("cholesky_solve", t, n, 1.0 * n * n * n / 3, bytes, [&]() {
+      Cholesky<E> ch(S);
+      sink = ch.solve(b)[0];
+    });
+
+    bench.run("qr_solve", t, n, 4.0 * n * n * n / 3, bytes, [&]() {
+      QR<E> qr(A);
+      sink = qr.solve(b)[0];
+    });
+  }
+}
+
+/// 秩 4 修正: 每次运行先加上再减去同一个修正, 分解保持在原矩阵附近, 最后
+/// 用它解一次 A x = b 以便核对; 参考实现为两次重新分解加一次求解
+template <typename E>
+void bench_updates(Bench &bench) {
+  const char *t = dtype_name<E>();
+  const int k = 4;
+  std::vector<int> sizes = bench.quick() ? std::vector<int>{256} : std::vector<int>{256, 1024};
+  for (int n : sizes) {
+    Matrix<E> A = random_nonsingular<E>(n, 7);
+    Matrix<E> S = random_spd<E>(n, 8);
+    Matrix<E> U = random_mat<E>(n, k, 12), V = random_mat<E>(n, k, 13);
+    Matrix<E> Un = U * E(-1);
+    Matrix<E> S2 = S + U.dot(U.t_view()), A2 = A + U.dot(V.t_view());
+    Vector<E> b(random_vec<E>(n, 9));
+    double bytes = (double)n * n * sizeof(E);
+
+    Cholesky<E> ch(S);
+    bench.run("cholesky_update4", t, n, 2 * 3.0 * k * n * n + 2.0 * n * n, 2 * bytes,
+              [&]() {
+                ch.update(U);
+                ch.downdate(U);
+                sink = ch.solve(b)[0];
+              },
+              [&]() {
+                Cholesky<E> up(S2);
+                sink = Cholesky<E>(S).solve(b)[0];
+              });
+
+    LU<E> lu(A);
+    bench.run("lu_update4", t, n, 2 * 2.0 * k * n * n + 2.0 * n * n, 2 * bytes,
+              [&]() {
+                lu.update(U, V);
+                lu.update(Un, V);
+                sink = lu.solve(b)[0];
+              },
+              [&]() {
+                LU<E> up(A2);
+                sink = LU<E>(A).solve(b)[0];
+              });
+
+    LU<E> base(A);
+    Woodbury<E> w(base, U, V);
+    bench.run("woodbury_solve4", t, n, 2.0 * n * n + 4.0 * n * k, bytes,
+              [&]() { sink = w.solve(b)[0]; },
+              [&]() {
+                Matrix<E> A3 = A + U.dot(V.t_view());
+                sink = LU<E>(A3).solve(b)[0];
+              });
+  }
+}
+
+/// 稀疏矩阵向量乘与 CG, flops 按每个非零元 2 次计
+template <typename E>
+void bench_sparse(Bench &bench) {
+  const char *t = dtype_name<E>();
+  std::vector<int> grids = bench.quick() ? std::vector<int>{64} : std::vector<int>{64, 256, 1024};
+  for (int g : grids) {
+    SparseMatrix<E> A = poisson2d<E>(g);
+    int n = A.row_num();
+    Vector<E> x(random_vec<E>(n, 10)), y = Vector<E>::zero(n);
+    double nnz = (double)A.nnz();
+
+    bench.run("spmv", t, n, 2.0 * nnz, nnz * (sizeof(E) + sizeof(int)) + 2.0 * n * sizeof(E),
+              [&]() {
+                A.dot(x.data(), y.data());
+                sink = y[0];
+              });
+
+    /// 固定迭代次数, 便于换算吞吐
+    SolverOptions so;
+    so.maxIterations = 50;
+    so.tolerance = 0;
+    ConjugateGradient<E> cg(so);
+    SparseOperator<E> op(A);
+    bench.run("cg_50it", t, n, 50 * (2.0 * nnz + 10.0 * n), 50 * (nnz * sizeof(E) + 6.0 * n * sizeof(E)),
+              [&]() {
+                Vector<E> z = Vector<E>::zero(n);
+                cg.solve(op, x, z);
+                sink = z[0];
+              });
+  }
+}
+
+/// 特征值: 稠密对称矩阵的全部特征对 (flops 按三对角化 4n^3/3 加 QR 迭代与回代的
+/// 约 8n^3/3 计), 以及泊松矩阵和对流扩散矩阵的 10 个最大特征对.
+/// Krylov 方法的 flops 与收敛步数有关, 不计; 参考实现为稠密的全部特征值
+template <typename E>
+void bench_eigen(Bench &bench) {
+  const char *t = dtype_name<E>();
+  std::vector<int> sizes = bench.quick() ? std::vector<int>{64, 256}
+                                         : std::vector<int>{64, 256, 512, 1024};
+  for (int n : sizes) {
+    Matrix<E> S = random_spd<E>(n, 8);
+    bench.run("sym_eigen", t, n, 4.0 * n * n * n, (double)n * n * sizeof(E), [&]() {
+      SymmetricEigen<E> es(S);
+      sink = es.eigenvalues()[0];
+    });
+  }
+
+  EigenOptions eo;
+  eo.tolerance = sizeof(E) == 4 ? 1e-4 : 1e-8;
+  std::vector<int> grids = bench.quick() ? std::vector<int>{32} : std::vector<int>{32, 128};
+  for (int g : grids) {
+    SparseMatrix<E> A = poisson2d<E>(g);
+    int n = A.row_num();
+    SparseOperator<E> op(A);
+    Lanczos<E> lz(eo);
+    Vector<E> vals;
+    Matrix<E> vecs(1, 1);
+    std::function<void()> ref = nullptr;
+    if (n <= 1024)
+      ref = [&]() { sink = SymmetricEigen<E>(A.to_dense(), false).eigenvalues()[n - 1]; };
+    bench.run("lanczos_top10", t, n, 0, 0,
+              [&]() {
+                lz.solve(op, 10, EigenWhich::Largest, vals, vecs);
+                sink = vals[0];
+              },
+              ref);
+
+    /// 一阶导数项取不对称的差分, 矩阵不对称
+    SparseBuilder<E> b(n, n);
+    for (int i = 0; i < g; ++i) {
+      for (int j = 0; j < g; ++j) {
+        int r = i * g + j;
+        b.add(r, r, E(4));
+        if (i > 0) b.add(r, r - g, E(-1.3));
+        if (i + 1 < g) b.add(r, r + g, E(-0.7));
+        if (j > 0) b.add(r, r - 1, E(-1));
+        if (j + 1 < g) b.add(r, r + 1, E(-1));
+      }
+    }
+    SparseMatrix<E> C = b.build();
+    SparseOperator<E> cop(C);
+    Arnoldi<E> ar(eo);
+    std::vector<std::complex<E>> cvals;
+    bench.run("arnoldi_top10", t, n, 0, 0, [&]() {
+      ar.solve(cop, 10, EigenWhich::Largest, cvals, vecs);
+      sink = cvals[0].real();
+    });
+  }
+}
+
+/// 批量 4x4 求解, flops 按每个系统 n^3 * 2/3 + 2n^2 计
+template <typename E>
+void bench_batched(Bench &bench) {
+  const char *t = dtype_name<E>();
+  int count = bench.quick() ? 4096 : 65536;
+  MatrixBatch<E> A(count, 4, 4), B(count, 4, 1);
+  std::vector<E> v = random_vec<E>(count * 20, 11);
+  for (int b = 0; b < count; ++b)
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j)
+        A(b, i, j) = v[b * 20 + i * 4 + j] + (i == j ? E(4) : E(0));
+      B(b, i, 0) = v[b * 20 + 16 + i];
+    }
+  bench.run("batch_solve4", t, count, count * (2.0 * 64 / 3 + 2 * 16),
+            count * 20.0 * sizeof(E), [&]() {
+              MatrixBatch<E> X(B);
+              batch::solve(A, X);
+              sink = X(count - 1, 0, 0);
+            },
+            [&]() {
+              for (int b = 0; b < count; ++b) {
+                LU<E> lu(A.get(b));
+                sink = lu.solve(Vector<E>(std::vector<E>{B(b, 0, 0), B(b, 1, 0), B(b, 2, 0), B(b, 3, 0)}))[0];
+              }
+            });
+}
+
+/// 通过 SolverService 提交一串独立的 8x8 系统并等待全部结果,
+/// 参考实现为逐个 LinearSystem + Gauss-Jordan
+template <typename E>
+void bench_service(Bench &bench) {
+  const char *t = dtype_name<E>();
+  const int n = 8;
+  int count = bench.quick() ? 256 : 4096;
+  std::vector<Matrix<E>> As;
+  std::vector<Vector<E>> bs;
+  for (int c = 0; c < count; ++c) {
+    As.push_back(random_nonsingular<E>(n, 100 + c));
+    bs.push_back(Vector<E>(random_vec<E>(n, 200 + c)));
+  }
+  SolverService<E> service;
+  bench.run("service_solve8", t, count, count * (2.0 * n * n * n / 3 + 2.0 * n * n),
+            count * (n * n + 2.0 * n) * sizeof(E),
+            [&]() {
+              std::vector<SolveTicket<E>> tickets;
+              tickets.reserve(count);
+              for (int c = 0; c < count; ++c)
+                tickets.push_back(service.submit(As[c], bs[c]));
+              for (SolveTicket<E> &ticket : tickets)
+                sink = ticket.get().x[0];
+            },
+            [&]() {
+              for (int c = 0; c < count; ++c) {
+                LinearSystem<E> ls(As[c], bs[c]);
+                ls.gauss_jordan_elimination();
+                sink = ls.getVectorSolution()[0];
+              }
+            });
+}
+
+/// float 分解 + double 精化, 与 lu_solve (f64) 对比
+void bench_mixed(Bench &bench) {
+  std::vector<int> sizes = bench.quick() ? std::vector<int>{64, 256}
+                                         : std::vector<int>{64, 256, 512, 1024};
+  for (int n : sizes) {
+    Matrix<double> A = random_nonsingular<double>(n, 7);
+    Vector<double> b(random_vec<double>(n, 9));
+    bench.run("mixed_solve", "f64", n, 2.0 * n * n * n / 3, (double)n * n * sizeof(double), [&]() {
+      MixedPrecisionLU<double, float> mp(A);
+      sink = mp.solve(b)[0];
+    });
+  }
+}
+
+template <typename E>
+void bench_all(Bench &bench) {
+  bench_level1<E>(bench);
+  bench_level2<E>(bench);
+  bench_gemm<E>(bench);
+  bench_solvers<E>(bench);
+  bench_updates<E>(bench);
+  bench_sparse<E>(bench);
+  bench_eigen<E>(bench);
+  bench_batched<E>(bench);
+  bench_service<E>(bench);
+}
+}
+
+int main(int argc, char **argv) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--quick") {
+      opts.quick = true;
+    } else if (arg == "--reference") {
+      opts.reference = true;
+    } else if (arg == "--filter" && i + 1 < argc) {
+      opts.filter = argv[++i];
+    } else if (arg == "--json" && i + 1 < argc) {
+      opts.json = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc) {
+      Parallel::set_num_threads(std::atoi(argv[++i]));
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--quick] [--reference] [--filter name] [--json out.json] [--threads n]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  Bench bench(opts);
+  bench.header();
+  bench_all<float>(bench);
+  bench_all<double>(bench);
+  bench_mixed(bench);
+  bench.write_json();
+  if (bench.mismatch_count() > 0) {
+    std::cerr << bench.mismatch_count() << " result(s) differ from the reference" << std::endl;
+    return 1;
+  }
+  return 0;
+}
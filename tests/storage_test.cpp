@@ -0,0 +1,202 @@
+/**********************************
+ * File:     storage_test.cpp
+ *
+ * Author:   caipeng
+ *
+ * Email:    iiicp@outlook.com
+ *
+ * Date:     2021/2/4
+ ***********************************/
+
+/// 文件格式, 外存 tile 矩阵和编译期定长矩阵的回归测试. 失败时返回非零
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include "Vector.h"
+#include "Matrix.h"
+#include "MatrixIO.h"
+#include "OutOfCore.h"
+#include "FixedSize.h"
+
+using namespace LinearAlgebra;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                       \
+  do {                                                                                    \
+    if (!(cond)) {                                                                        \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+      ++failures;                                                                         \
+    }                                                                                     \
+  } while (0)
+
+template <typename E>
+Matrix<E> random_mat(int r, int c, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  Matrix<E> A(r, c);
+  for (int i = 0; i < r; ++i)
+    for (int j = 0; j < c; ++j)
+      A(i, j) = (E)dist(gen);
+  return A;
+}
+
+template <typename E>
+double max_diff(const Matrix<E> &A, const Matrix<E> &B) {
+  double d = 0;
+  for (int i = 0; i < A.row_num(); ++i)
+    for (int j = 0; j < A.col_num(); ++j)
+      d = std::max(d, std::abs((double)A(i, j) - (double)B(i, j)));
+  return d;
+}
+
+/// save 之后 map 和 load 都得到原来的数据; 映射上的修改不写回文件
+void test_save_map() {
+  Matrix<double> A = random_mat<double>(37, 23, 1);
+  io::save("storage_test_A.lamx", A);
+  Matrix<double> M = Matrix<double>::map("storage_test_A.lamx");
+  CHECK(M.row_num() == 37 && M.col_num() == 23);
+  CHECK(max_diff(A, M) == 0);
+  M(0, 0) = 42;
+  CHECK(io::load_matrix<double>("storage_test_A.lamx")(0, 0) == A(0, 0));
+
+  Vector<float> v(std::vector<float>{1, 2, 3, 4, 5});
+  io::save("storage_test_v.lamx", v);
+  Vector<float> w = Vector<float>::map("storage_test_v.lamx");
+  CHECK(w.size() == 5 && w[4] == 5);
+
+  bool threw = false;
+  try {
+    Matrix<float>::map("storage_test_A.lamx");
+  } catch (const IOError &) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+/// tile 不整除矩阵的外存 GEMM 与内存结果一致
+void test_ooc_gemm(std::size_t budget) {
+  const int n = 70, ts = 16;
+  OutOfCoreOptions opts;
+  opts.memoryBudget = budget;
+  Matrix<double> A = random_mat<double>(n, n, 2), B = random_mat<double>(n, n, 3);
+  TiledMatrix<double> ta("storage_test_ta", n, n, ts, opts), tb("storage_test_tb", n, n, ts, opts),
+      tc("storage_test_tc", n, n, ts, opts);
+  ta.assign(A);
+  tb.assign(B);
+  CHECK(max_diff(ta.load(), A) == 0);
+  ooc::gemm(1.0, ta, tb, 0.0, tc);
+  CHECK(max_diff(tc.load(), A.dot(B)) < 1e-12);
+}
+
+/// 外存 LU 分解后求解, 残差在舍入误差范围内
+void test_ooc_lu(std::size_t budget, double scale = 1) {
+  const int n = 70, ts = 16;
+  OutOfCoreOptions opts;
+  opts.memoryBudget = budget;
+  Matrix<double> A = random_mat<double>(n, n, 4);
+  for (int i = 0; i < n; ++i)
+    A(i, i) += n;
+  A *= scale;
+  Vector<double> b = Vector<double>::zero(n);
+  for (int i = 0; i < n; ++i)
+    b[i] = (i % 7 - 3) * scale;
+
+  TiledMatrix<double> ta("storage_test_lu", n, n, ts, opts);
+  ta.assign(A);
+  ooc::OutOfCoreLU f = ooc::lu(ta);
+  CHECK(!f.singular);
+  Vector<double> x = ooc::lu_solve(ta, f, b);
+  double r = 0;
+  for (int i = 0; i < n; ++i)
+    r = std::max(r, std::abs(simd::dot(A.row_ptr(i), x.data(), n) - b[i]));
+  CHECK(r < 1e-10 * scale);
+}
+
+constexpr bool is_singular(const Matrix<double, 2, 2> &a) {
+  bool ok = true;
+  a.inverse(&ok);
+  return !ok;
+}
+
+/// 预算只够一个 tile 时逐个读 tile: 正在取的 tile 不能被淘汰
+void test_tiny_budget() {
+  Matrix<double> A = random_mat<double>(64, 64, 5);
+  TiledMatrix<double> ta("storage_test_tiny", 64, 64, 8);
+  ta.assign(A);
+  ta.set_budget(1);
+  double d = 0;
+  for (int bi = 0; bi < ta.tile_rows(); ++bi)
+    for (int bj = 0; bj < ta.tile_cols(); ++bj) {
+      TiledMatrix<double>::Tile t = ta.tile(bi, bj);
+      for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+          d = std::max(d, std::abs((*t)(i, j) - A(bi * 8 + i, bj * 8 + j)));
+    }
+  CHECK(d == 0);
+}
+
+/// 后台写回失败时 flush 抛出异常
+void test_write_failure() {
+  TiledMatrix<double> ta("storage_test_gone", 16, 16, 8);
+  std::remove("storage_test_gone/meta.txt");
+  std::remove("storage_test_gone");
+  (*ta.zero_tile(0, 0))(0, 0) = 1;
+  ta.write_behind(0, 0);
+  bool threw = false;
+  try {
+    ta.flush();
+  } catch (const IOError &) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+/// 定长矩阵的逆在编译期求出
+void test_fixed_inverse() {
+  typedef Matrix<double, 2, 2> M2;
+  constexpr M2 inv2 = M2(4, 7, 2, 6).inverse();
+  static_assert(inv2(0, 0) == 0.6 && inv2(1, 1) == 0.4, "2x2 inverse");
+
+  typedef Matrix<double, 3, 3> M3;
+  constexpr M3 a3(2, 0, 0, 0, 4, 0, 0, 0, 8);
+  constexpr M3 inv3 = a3.inverse();
+  static_assert(inv3(0, 0) == 0.5 && inv3(1, 1) == 0.25 && inv3(2, 2) == 0.125, "3x3 inverse");
+
+  static_assert(is_singular(M2(1, 2, 2, 4)), "singular 2x2");
+
+  typedef Matrix<double, 4, 4> M4;
+  M4 a4(4, 1, 0, 2, 1, 5, 1, 0, 0, 1, 6, 1, 2, 0, 1, 7);
+  bool ok = false;
+  M4 p = a4.dot(a4.inverse(&ok));
+  CHECK(ok);
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      CHECK(std::abs(p(i, j) - (i == j ? 1 : 0)) < 1e-14);
+}
+
+int main() {
+  test_save_map();
+  test_ooc_gemm(OutOfCoreOptions().memoryBudget);
+  test_ooc_lu(OutOfCoreOptions().memoryBudget);
+  /// 预算小于三列 tile (每列 5 个 16x16 tile), 只能超出预算而不能出错
+  const std::size_t tileBytes = 16 * 16 * sizeof(double);
+  test_ooc_gemm(5 * tileBytes);
+  test_ooc_lu(5 * tileBytes);
+  test_ooc_gemm(1);
+  test_ooc_lu(1);
+  /// 奇异判定相对于 max|A_ij|, 整体缩小的矩阵仍可分解
+  test_ooc_lu(OutOfCoreOptions().memoryBudget, 1e-9);
+  test_tiny_budget();
+  test_write_failure();
+  test_fixed_inverse();
+  if (failures) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "all storage tests passed" << std::endl;
+  return 0;
+}